@@ -134,7 +134,7 @@ namespace xcore
         s32 const bi0 = xfindFirstBit(~m_l0);
         if (bi0 >= 0 && count > 32)
         {
-            u32 const wi1 = bi0 * 16;
+            u32 const wi1 = bi0;
             s32 const bi1 = xfindFirstBit((u16)~l1[wi1]);
             ASSERT(bi1 >= 0);
             u32 const wi2 = wi1 * 16 + bi1;
@@ -145,6 +145,68 @@ namespace xcore
         return bi0;
     }
 
+    s32 binmap_t::upper(u32 count, u16 const* l1, u16 const* l2, u32 pivot) const
+    {
+        if (pivot >= count)
+            return -1;
+
+        if (count <= 32)
+        {
+            u32 const wd0 = ~m_l0 & (0xffffffff << pivot);
+            return xfindFirstBit(wd0);
+        }
+
+        // Remaining bits in the level 2 word that holds 'pivot'
+        u32 const wi2 = pivot / 16;
+        u16 const wd2 = (u16)(~l2[wi2] & (0xffff << (pivot & (16 - 1))));
+        if (wd2 != 0)
+            return (wi2 * 16) + xfindFirstBit(wd2);
+
+        // Remaining level 2 words that belong to the same level 1 word
+        u32 const wi1 = wi2 / 16;
+        u16 const wd1 = (u16)(~l1[wi1] & ((u32)0xffff << ((wi2 & (16 - 1)) + 1)));
+        if (wd1 != 0)
+        {
+            u32 const ni2 = (wi1 * 16) + xfindFirstBit(wd1);
+            return (ni2 * 16) + xfindFirstBit((u16)~l2[ni2]);
+        }
+
+        // Remaining level 1 words
+        if (wi1 == 31)
+            return -1;
+        u32 const wd0 = ~m_l0 & (0xffffffff << (wi1 + 1));
+        if (wd0 == 0)
+            return -1;
+        u32 const ni1 = xfindFirstBit(wd0);
+        u32 const ni2 = (ni1 * 16) + xfindFirstBit((u16)~l1[ni1]);
+        return (ni2 * 16) + xfindFirstBit((u16)~l2[ni2]);
+    }
+
+    s32 binmap_t::next(u32 count, u16 const* l2, u32 pivot) const
+    {
+        if (pivot >= count)
+            return -1;
+
+        // The bits beyond 'count' are always '1', so any result at or beyond 'count' means 'not found'
+        s32 k = -1;
+        if (count <= 32)
+        {
+            u32 const wd0 = m_l0 & (0xffffffff << pivot);
+            k             = xfindFirstBit(wd0);
+        }
+        else
+        {
+            u32 const len2 = (count + (16 - 1)) / 16;
+            u32       wi2  = pivot / 16;
+            u16       wd2  = (u16)(l2[wi2] & (0xffff << (pivot & (16 - 1))));
+            while (wd2 == 0 && ++wi2 < len2)
+                wd2 = l2[wi2];
+            if (wd2 != 0)
+                k = (wi2 * 16) + xfindFirstBit(wd2);
+        }
+        return (k < 0 || (u32)k >= count) ? -1 : k;
+    }
+
     s32 binmap_t::findandset(u32 count, u16* l1, u16* l2)
     {
         s32 const bi0 = xfindFirstBit(~m_l0);
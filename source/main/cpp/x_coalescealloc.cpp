@@ -0,0 +1,388 @@
+#include "xbase/x_target.h"
+#include "xbase/x_debug.h"
+#include "xbase/x_allocator.h"
+#include "xbase/x_integer.h"
+
+#include "xvmem/private/x_doubly_linked_list.h"
+#include "xvmem/private/x_binmap.h"
+#include "xvmem/x_virtual_memory.h"
+#include "xvmem/x_virtual_coalesce_allocator.h"
+
+#include <new>
+
+namespace xcore
+{
+    static inline void* toaddress(void* base, u64 offset) { return (void*)((u64)base + offset); }
+    static inline u64   todistance(void* base, void* ptr)
+    {
+        ASSERT(ptr >= base);
+        return (u64)((u64)ptr - (u64)base);
+    }
+
+    // Coalesce Allocator Direct
+    //
+    // Best-fit allocator where every allocation or free range is a node, all nodes are kept in
+    // a separate array so nothing is ever written into the managed memory.
+    //
+    // - Size-DB: A list of free nodes per size (in units of 'size step') and a binmap that tells
+    //            us which of those lists are not empty. The last size entry also holds all the
+    //            free nodes that are larger than 'size max'.
+    // - Addr-DB: The managed range is divided into address nodes of 2 x 'size max', an entry holds
+    //            the first node that starts in that address node. Together with the address
+    //            ordered neighbour links of every node we can find the node of a pointer.
+    // - Pages:   Physical pages are committed on allocation and decommitted on deallocation, we
+    //            keep a reference count per page since small allocations can share a page.
+    //
+    class coalescealloc_t : public alloc_t
+    {
+    public:
+        coalescealloc_t()
+            : m_main_heap(nullptr)
+            , m_vmem(nullptr)
+            , m_address(nullptr)
+            , m_address_range(0)
+        {
+        }
+
+        void initialize(alloc_t* main_heap, xvmem* vmem, xcoalesce_config const& cfg);
+        void deinitialize();
+
+    protected:
+        virtual void* v_allocate(u32 size, u32 alignment);
+        virtual u32   v_deallocate(void* ptr);
+        virtual void  v_release();
+
+        struct node_t
+        {
+            llnode_t m_size_link; // Size-DB list (free nodes) or the list of unused nodes
+            u32      m_addr_prev; // Address ordered neighbours, used and free nodes
+            u32      m_addr_next; // ..
+            u32      m_addr;      // Offset into the managed range, in units of 'size step'
+            u32      m_size : 31; // Size, in units of 'size step'
+            u32      m_used : 1;
+        };
+
+        inline u32 size2bin(u32 size) const { return size < m_size_max ? size : m_size_max; }
+        inline u32 addr2region(u32 addr) const { return addr >> m_region_shift; }
+
+        void size_db_insert(u32 inode);
+        void size_db_remove(u32 inode);
+        void addr_db_link_after(u32 inode, u32 inew);
+        void addr_db_unlink(u32 inode);
+        u32  addr_db_find(u32 addr) const;
+        u32  node_checkout();
+        void node_release(u32 inode);
+
+        void commit_range(u32 addr, u32 size);
+        void decommit_range(u32 addr, u32 size);
+
+        alloc_t*  m_main_heap;
+        xvmem*    m_vmem;
+        void*     m_address;
+        u64       m_address_range;
+        u32       m_page_size;
+        u32       m_page_shift;
+        u32       m_step_shift;   // e.g. 8 (1<<8 = 256 B)
+        u32       m_size_min;     // In units of 'size step'
+        u32       m_size_max;     // In units of 'size step'
+        u32       m_alloc_count;  // Number of live allocations
+        u32       m_alloc_max;    // Maximum number of live allocations
+        u32       m_region_shift; // Address node size, in units of 'size step'
+        u32       m_region_count; //
+        u32*      m_addr_db;      // First node that starts in an address node, or NIL
+        u32       m_size_count;   // Number of Size-DB entries
+        binmap_t  m_size_db;      // A '0' bit means that the size entry has free nodes
+        u16*      m_size_db_l1;
+        u16*      m_size_db_l2;
+        llhead_t* m_size_lists;
+        node_t*   m_nodes;
+        u32       m_node_count;
+        lldata_t  m_node_data; // Maps a node index to the 'm_size_link' of a node
+        llhead_t  m_node_free_list;
+        u16*      m_page_refs; // Number of nodes in use that overlap a page
+    };
+
+    void coalescealloc_t::initialize(alloc_t* main_heap, xvmem* vmem, xcoalesce_config const& cfg)
+    {
+        ASSERT(xispo2(cfg.m_size_step));
+        ASSERT(cfg.m_size_min >= cfg.m_size_step && cfg.m_size_min <= cfg.m_size_max);
+
+        m_main_heap     = main_heap;
+        m_vmem          = vmem;
+        m_address_range = cfg.m_address_range;
+        u32 const attrs = xvmem::ATTR_MANAGED;
+        m_vmem->reserve(m_address_range, m_page_size, attrs, m_address);
+        m_page_shift = xcountTrailingZeros(m_page_size);
+        m_step_shift = xcountTrailingZeros(cfg.m_size_step);
+        m_size_min   = cfg.m_size_min >> m_step_shift;
+        m_size_max   = cfg.m_size_max >> m_step_shift;
+        ASSERT((m_address_range >> m_step_shift) < ((u64)1 << 31));
+
+        m_alloc_count = 0;
+        m_alloc_max   = cfg.m_max_allocs;
+
+        // Addr-DB, an address node is 2 x 'size max'
+        m_region_shift = xcountTrailingZeros(xceilpo2(m_size_max)) + 1;
+        m_region_count = (u32)((m_address_range >> m_step_shift) >> m_region_shift);
+        m_addr_db      = (u32*)m_main_heap->allocate(sizeof(u32) * m_region_count);
+        for (u32 i = 0; i < m_region_count; ++i)
+            m_addr_db[i] = llnode_t::NIL;
+
+        // Size-DB, all size entries start out empty
+        m_size_count = m_size_max + 1;
+        ASSERT(m_size_count <= (32 * 16 * 16));
+        u32 const l2len = (m_size_count + 15) / 16;
+        u32 const l1len = (l2len + 15) / 16;
+        m_size_db_l1    = (u16*)m_main_heap->allocate(sizeof(u16) * l1len);
+        m_size_db_l2    = (u16*)m_main_heap->allocate(sizeof(u16) * l2len);
+        m_size_db.init1(m_size_count, m_size_db_l1, l1len, m_size_db_l2, l2len);
+        m_size_lists = (llhead_t*)m_main_heap->allocate(sizeof(llhead_t) * m_size_count);
+        for (u32 i = 0; i < m_size_count; ++i)
+            m_size_lists[i].reset();
+
+        // Adjacent free nodes are always merged, so there can never be more than 'used + 1' free nodes
+        m_node_count           = (2 * m_alloc_max) + 1;
+        m_nodes                = (node_t*)m_main_heap->allocate(sizeof(node_t) * m_node_count);
+        m_node_data.m_data     = &m_nodes[0].m_size_link;
+        m_node_data.m_itemsize = sizeof(node_t);
+        m_node_free_list.reset();
+        for (u32 i = m_node_count - 1; i > 0; --i)
+            m_node_free_list.insert(m_node_data, i);
+
+        u32 const page_count = (u32)(m_address_range >> m_page_shift);
+        m_page_refs          = (u16*)m_main_heap->allocate(sizeof(u16) * page_count);
+        for (u32 i = 0; i < page_count; ++i)
+            m_page_refs[i] = 0;
+
+        // Node 0 is the one free node that covers the whole range
+        node_t* node      = &m_nodes[0];
+        node->m_addr_prev = llnode_t::NIL;
+        node->m_addr_next = llnode_t::NIL;
+        node->m_addr      = 0;
+        node->m_size      = (u32)(m_address_range >> m_step_shift);
+        node->m_used      = 0;
+        m_addr_db[0]      = 0;
+        size_db_insert(0);
+    }
+
+    void coalescealloc_t::deinitialize()
+    {
+        m_vmem->release(m_address, m_address_range);
+        m_main_heap->deallocate(m_page_refs);
+        m_main_heap->deallocate(m_nodes);
+        m_main_heap->deallocate(m_size_lists);
+        m_main_heap->deallocate(m_size_db_l2);
+        m_main_heap->deallocate(m_size_db_l1);
+        m_main_heap->deallocate(m_addr_db);
+        m_address       = nullptr;
+        m_address_range = 0;
+        m_vmem          = nullptr;
+    }
+
+    void* coalescealloc_t::v_allocate(u32 alloc_size, u32 alignment)
+    {
+        ASSERT(alignment <= ((u32)1 << m_step_shift));
+        u32 size = (alloc_size + ((1 << m_step_shift) - 1)) >> m_step_shift;
+        if (size < m_size_min)
+            size = m_size_min;
+        if (size > m_size_max || m_alloc_count == m_alloc_max)
+            return nullptr;
+
+        // Best-fit, the first non-empty size entry at or above the requested size
+        s32 const bin = m_size_db.upper(m_size_count, m_size_db_l1, m_size_db_l2, size);
+        if (bin < 0)
+            return nullptr;
+
+        u32 const inode = m_size_lists[bin].m_index;
+        size_db_remove(inode);
+
+        node_t* node = &m_nodes[inode];
+        if (node->m_size > size)
+        {
+            // Split, the remainder stays free
+            u32 const irest = node_checkout();
+            node_t*   rest  = &m_nodes[irest];
+            rest->m_addr    = node->m_addr + size;
+            rest->m_size    = node->m_size - size;
+            rest->m_used    = 0;
+            node->m_size    = size;
+            addr_db_link_after(inode, irest);
+            size_db_insert(irest);
+        }
+        node->m_used = 1;
+        m_alloc_count += 1;
+
+        commit_range(node->m_addr, node->m_size);
+        return toaddress(m_address, (u64)node->m_addr << m_step_shift);
+    }
+
+    u32 coalescealloc_t::v_deallocate(void* ptr)
+    {
+        if (ptr == nullptr)
+            return 0;
+        ASSERT(ptr >= m_address && ptr < ((xbyte*)m_address + m_address_range));
+        u64 const offset = todistance(m_address, ptr);
+        ASSERT((offset & ((1 << m_step_shift) - 1)) == 0);
+
+        u32     inode = addr_db_find((u32)(offset >> m_step_shift));
+        node_t* node  = &m_nodes[inode];
+        ASSERT(node->m_used == 1);
+        u32 const size = node->m_size << m_step_shift;
+        decommit_range(node->m_addr, node->m_size);
+        node->m_used = 0;
+        m_alloc_count -= 1;
+
+        // Coalesce with the next and previous node when they are free
+        u32 const inext = node->m_addr_next;
+        if (inext != llnode_t::NIL && m_nodes[inext].m_used == 0)
+        {
+            size_db_remove(inext);
+            node->m_size += m_nodes[inext].m_size;
+            addr_db_unlink(inext);
+            node_release(inext);
+        }
+        u32 const iprev = node->m_addr_prev;
+        if (iprev != llnode_t::NIL && m_nodes[iprev].m_used == 0)
+        {
+            size_db_remove(iprev);
+            m_nodes[iprev].m_size += node->m_size;
+            addr_db_unlink(inode);
+            node_release(inode);
+            inode = iprev;
+        }
+        size_db_insert(inode);
+        return size;
+    }
+
+    void coalescealloc_t::v_release()
+    {
+        alloc_t* main_heap = m_main_heap;
+        deinitialize();
+        main_heap->deallocate(this);
+    }
+
+    void coalescealloc_t::size_db_insert(u32 inode)
+    {
+        u32 const bin = size2bin(m_nodes[inode].m_size);
+        if (m_size_lists[bin].is_nil())
+            m_size_db.clr(m_size_count, m_size_db_l1, m_size_db_l2, bin);
+        m_size_lists[bin].insert(m_node_data, inode);
+    }
+
+    void coalescealloc_t::size_db_remove(u32 inode)
+    {
+        u32 const bin = size2bin(m_nodes[inode].m_size);
+        m_size_lists[bin].remove_item(m_node_data, inode);
+        if (m_size_lists[bin].is_nil())
+            m_size_db.set(m_size_count, m_size_db_l1, m_size_db_l2, bin);
+    }
+
+    void coalescealloc_t::addr_db_link_after(u32 inode, u32 inew)
+    {
+        node_t* node      = &m_nodes[inode];
+        node_t* nnew      = &m_nodes[inew];
+        nnew->m_addr_prev = inode;
+        nnew->m_addr_next = node->m_addr_next;
+        if (node->m_addr_next != llnode_t::NIL)
+            m_nodes[node->m_addr_next].m_addr_prev = inew;
+        node->m_addr_next = inew;
+
+        u32 const region = addr2region(nnew->m_addr);
+        u32 const ifirst = m_addr_db[region];
+        if (ifirst == llnode_t::NIL || m_nodes[ifirst].m_addr > nnew->m_addr)
+            m_addr_db[region] = inew;
+    }
+
+    void coalescealloc_t::addr_db_unlink(u32 inode)
+    {
+        node_t* node = &m_nodes[inode];
+
+        u32 const region = addr2region(node->m_addr);
+        if (m_addr_db[region] == inode)
+        {
+            u32 const inext   = node->m_addr_next;
+            bool const same   = inext != llnode_t::NIL && addr2region(m_nodes[inext].m_addr) == region;
+            m_addr_db[region] = same ? inext : llnode_t::NIL;
+        }
+
+        if (node->m_addr_prev != llnode_t::NIL)
+            m_nodes[node->m_addr_prev].m_addr_next = node->m_addr_next;
+        if (node->m_addr_next != llnode_t::NIL)
+            m_nodes[node->m_addr_next].m_addr_prev = node->m_addr_prev;
+        node->m_addr_prev = llnode_t::NIL;
+        node->m_addr_next = llnode_t::NIL;
+    }
+
+    u32 coalescealloc_t::addr_db_find(u32 addr) const
+    {
+        u32 inode = m_addr_db[addr2region(addr)];
+        while (inode != llnode_t::NIL && m_nodes[inode].m_addr < addr)
+            inode = m_nodes[inode].m_addr_next;
+        ASSERT(inode != llnode_t::NIL && m_nodes[inode].m_addr == addr);
+        return inode;
+    }
+
+    u32 coalescealloc_t::node_checkout()
+    {
+        // Can never run out, 'm_alloc_max' bounds the number of nodes
+        u32 const inode = m_node_free_list.remove_headi(m_node_data);
+        ASSERT(inode != llnode_t::NIL);
+        return inode;
+    }
+
+    void coalescealloc_t::node_release(u32 inode) { m_node_free_list.insert(m_node_data, inode); }
+
+    void coalescealloc_t::commit_range(u32 addr, u32 size)
+    {
+        u64 const begin      = (u64)addr << m_step_shift;
+        u64 const end        = (u64)(addr + size) << m_step_shift;
+        u32 const page_begin = (u32)(begin >> m_page_shift);
+        u32 const page_end   = (u32)((end + (m_page_size - 1)) >> m_page_shift);
+
+        // Commit the pages that are not yet committed, in runs of consecutive pages
+        u32 run = page_begin;
+        for (u32 p = page_begin; p < page_end; ++p)
+        {
+            if (m_page_refs[p]++ != 0)
+            {
+                if (run < p)
+                    m_vmem->commit(toaddress(m_address, (u64)run << m_page_shift), m_page_size, p - run);
+                run = p + 1;
+            }
+        }
+        if (run < page_end)
+            m_vmem->commit(toaddress(m_address, (u64)run << m_page_shift), m_page_size, page_end - run);
+    }
+
+    void coalescealloc_t::decommit_range(u32 addr, u32 size)
+    {
+        u64 const begin      = (u64)addr << m_step_shift;
+        u64 const end        = (u64)(addr + size) << m_step_shift;
+        u32 const page_begin = (u32)(begin >> m_page_shift);
+        u32 const page_end   = (u32)((end + (m_page_size - 1)) >> m_page_shift);
+
+        // Decommit the pages that are not used anymore, in runs of consecutive pages
+        u32 run = page_begin;
+        for (u32 p = page_begin; p < page_end; ++p)
+        {
+            ASSERT(m_page_refs[p] > 0);
+            if (--m_page_refs[p] != 0)
+            {
+                if (run < p)
+                    m_vmem->decommit(toaddress(m_address, (u64)run << m_page_shift), m_page_size, p - run);
+                run = p + 1;
+            }
+        }
+        if (run < page_end)
+            m_vmem->decommit(toaddress(m_address, (u64)run << m_page_shift), m_page_size, page_end - run);
+    }
+
+    alloc_t* gCreateVmCoalesceAllocator(alloc_t* main_heap, xvmem* vmem, xcoalesce_config const& cfg)
+    {
+        void*            mem       = main_heap->allocate(sizeof(coalescealloc_t), sizeof(void*));
+        coalescealloc_t* allocator = new (mem) coalescealloc_t();
+        allocator->initialize(main_heap, vmem, cfg);
+        return allocator;
+    }
+
+}; // namespace xcore
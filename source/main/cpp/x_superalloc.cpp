@@ -2,11 +2,35 @@
 #include "xbase/x_debug.h"
 #include "xbase/x_allocator.h"
 #include "xbase/x_integer.h"
+#include "xbase/x_memory.h"
 
 #include "xvmem/private/x_doubly_linked_list.h"
 #include "xvmem/private/x_binmap.h"
+#include "xvmem/x_virtual_main_allocator.h"
 #include "xvmem/x_virtual_memory.h"
 
+#include <new>
+#include <atomic>
+
+#if defined TARGET_LINUX || defined TARGET_MAC
+#include <pthread.h>
+#include <errno.h>
+#include <sched.h>
+#include <signal.h>
+#include <unistd.h>
+#endif
+#if defined TARGET_LINUX
+#include <stddef.h>
+#if defined __x86_64__ && defined __has_include
+#if __has_include(<sys/rseq.h>)
+#include <linux/membarrier.h>
+#include <sys/rseq.h>
+#include <sys/syscall.h>
+#define XVMEM_RSEQ // glibc 2.35 and later registers an rseq area for every thread
+#endif
+#endif
+#endif
+
 namespace xcore
 {
     // @TODO: We could also include an index to an array of superchunks_t. 
@@ -14,8 +38,6 @@ namespace xcore
     //        In this way we could create multiple regions with different page-size or other attributes.
     // @TODO: Deal with jittering between block checkout/release
 
-    #define SUPERALLOC_DEBUG
-
     static inline void* toaddress(void* base, u64 offset) { return (void*)((u64)base + offset); }
     static inline u64   todistance(void* base, void* ptr)
     {
@@ -23,13 +45,39 @@ namespace xcore
         return (u64)((u64)ptr - (u64)base);
     }
 
-    // Can only allocate, used internally to allocate initially required memory
+    class superheap_t;
+    class superfsa_t;
+    struct superchunks_t;
+
+    // The hard limit on the committed bytes of an allocator (chunks and bookkeeping), every commit that is made while
+    // allocating asks it first. The pressure callback is not invoked here, see superallocator_t::commit_limits.
+    struct superlimit_t
+    {
+        superlimit_t()
+            : m_hard_limit(0)
+            , m_heap(nullptr)
+            , m_fsa(nullptr)
+            , m_chunks(nullptr)
+        {
+        }
+
+        bool allows(u64 bytes) const;
+
+        u64                  m_hard_limit; // 0 is no limit
+        superheap_t const*   m_heap;
+        superfsa_t const*    m_fsa;
+        superchunks_t const* m_chunks;
+    };
+
+    // Can only allocate, used internally to allocate initially required memory. It is only used while the allocator
+    // is set up, so its commits are not checked against the limit (they are counted though).
     class superheap_t
     {
     public:
         void  initialize(xvmem* vmem, u64 memory_range, u64 size_to_pre_allocate);
         void  deinitialize();
         void* allocate(u32 size);
+        u64   committed() const { return (u64)m_page_count_current * m_page_size; }
 
         void*  m_address;
         u64    m_address_range;
@@ -91,11 +139,85 @@ namespace xcore
         return toaddress(m_address, offset);
     }
 
-    struct superpage_t
+    // Collects page ranges and commits or decommits them with one call to the xvmem, a range that starts where the
+    // last one ends is merged with it. With 'bridge' a range is also merged across a gap, the caller knows that the
+    // pages in the gap are not committed, e.g. the chunks of a block that is released.
+    class superbatch_t
+    {
+    public:
+        superbatch_t(xvmem* vmem, u32 page_size, bool commit, bool bridge)
+            : m_vmem(vmem)
+            , m_page_size(page_size)
+            , m_page_shift(xcountTrailingZeros(page_size))
+            , m_count(0)
+            , m_commit(commit)
+            , m_bridge(bridge)
+        {
+        }
+
+        void add(void* address, u32 page_count)
+        {
+            if (page_count == 0)
+                return;
+            if (m_count > 0)
+            {
+                xvmem_range& last = m_ranges[m_count - 1];
+                xbyte* const end  = (xbyte*)last.m_address + ((u64)last.m_page_count << m_page_shift);
+                if (end == (xbyte*)address || (m_bridge && end < (xbyte*)address))
+                {
+                    last.m_page_count = (u32)(((u64)((xbyte*)address - (xbyte*)last.m_address) >> m_page_shift) + page_count);
+                    return;
+                }
+            }
+            if (m_count == c_ranges_max)
+                flush(false);
+            m_ranges[m_count].m_address    = address;
+            m_ranges[m_count].m_page_count = page_count;
+            m_count += 1;
+        }
+
+        // With 'prefault' the committed ranges are also faulted in. Returns false when the xvmem failed, some of the
+        // ranges may not be committed then.
+        bool flush(bool prefault)
+        {
+            if (m_count == 0)
+                return true;
+            bool ok = true;
+            if (m_commit)
+            {
+                ok = m_vmem->commit_ranges(m_ranges, m_count, m_page_size);
+                if (ok && prefault)
+                {
+                    for (u32 i = 0; i < m_count; ++i)
+                        m_vmem->prefault(m_ranges[i].m_address, m_page_size, m_ranges[i].m_page_count);
+                }
+            }
+            else
+            {
+                ok = m_vmem->decommit_ranges(m_ranges, m_count, m_page_size);
+            }
+            m_count = 0;
+            return ok;
+        }
+
+    private:
+        static const u32 c_ranges_max = 32;
+
+        xvmem*      m_vmem;
+        u32         m_page_size;
+        u32         m_page_shift;
+        u32         m_count;
+        bool        m_commit;
+        bool        m_bridge;
+        xvmem_range m_ranges[c_ranges_max];
+    };
+
+    // A page of the internal FSA, the entries are in an array next to the pages and link a page into a list
+    struct superpage_t : llnode_t
     {
         static const u16 NIL = 0xffff;
 
-        u16 m_item_size;
+        u32 m_item_size;
         u16 m_item_count;
         u16 m_item_max;
         u16 m_item_freelist;
@@ -132,91 +254,175 @@ namespace xcore
             return NIL;
         }
 
-        void deallocate(void* page_address, u16 item_index)
+        void deallocate(void* page_address, u16 item_index, bool poison)
         {
             ASSERT(m_item_count > 0);
             ASSERT(item_index < m_item_max);
             u16* const pelem = (u16*)idx2ptr(page_address, item_index);
-#ifdef SUPERALLOC_DEBUG
-            x_memset(pelem, 0xFEFEFEFE, m_item_size);
-#endif
+            if (poison)
+                x_memset(pelem, 0xFEFEFEFE, m_item_size);
             pelem[0]        = m_item_freelist;
             m_item_freelist = item_index;
             m_item_count -= 1;
         }
     };
 
+    // The pages of the internal FSA, an index is the offset in the address range in granules of 8 bytes, so 32 bits
+    // address 32 GB. The address range and the array of page entries are only reserved, the page entries are
+    // committed when the first page they describe is checked out.
     struct superpages_t
     {
-        void  initialize(superheap_t& heap, xvmem* vmem, u64 address_range, u32 size_to_pre_allocate);
-        void  deinitialize(superheap_t& heap);
+        void  initialize(xvmem* vmem, u64 address_range, u32 size_to_pre_allocate, bool poison, superlimit_t const* limit);
+        void  deinitialize();
         u32   checkout_page(u32 const alloc_size);
+        u32   checkout_free_page(superbatch_t* batch);
         void  release_page(u32 index);
-        void* address_of_page(u32 ipage) const { return toaddress(m_address, (u64)ipage * m_page_size); }
+        u32   prewarm(bool prefault);
+        u32   flush();
+        u32   page_array_pages(u32 page_count) const;
+        bool  commit_page_array(u32 page_count);
+        void* address_of_page(u32 ipage) const { return toaddress(m_address, (u64)ipage << m_page_shift); }
+        u64   committed() const { return ((u64)m_page_committed + m_page_array_committed) << m_page_shift; }
 
         inline void* idx2ptr(u32 i) const
         {
             if (i == 0xffffffff)
                 return nullptr;
-            u16 const                pageindex = i >> 16;
-            u16 const                itemindex = i & 0xFFFF;
-            superpage_t const* const ppage     = &m_page_array[pageindex];
-            void* const              paddr     = address_of_page(pageindex);
-            return ppage->idx2ptr(paddr, itemindex);
+            return toaddress(m_address, (u64)i << c_granule_shift);
         }
 
         inline u32 ptr2idx(void* ptr) const
         {
             if (ptr == nullptr)
                 return 0xffffffff;
-            u32 const                pageindex = (u32)(todistance(m_address, ptr) / m_page_size);
-            superpage_t const* const ppage     = &m_page_array[pageindex];
-            void* const              paddr     = address_of_page(pageindex);
-            u32 const                itemindex = ppage->ptr2idx(paddr, ptr);
-            return (pageindex << 16) | (itemindex & 0xFFFF);
+            return (u32)(todistance(m_address, ptr) >> c_granule_shift);
         }
 
+        static const u32 c_cached_pages_min = 32; // The minimum capacity of the cache of committed pages
+        static const u32 c_granule_shift    = 3;  // Every item size is a multiple of 8 bytes
+        static const u64 c_address_range_max = (u64)0xffffffff << c_granule_shift; // The last granule is NIL
+
         xvmem*       m_vmem;
         void*        m_address;
         u64          m_address_range;
         u32          m_page_count;
         u32          m_page_size;
+        u32          m_page_shift;
+        u32          m_page_never_used;      // Pages at and above this index have never been checked out
+        u32          m_page_committed;       // Pages that are checked out or in the cache
+        u32          m_page_array_committed; // Committed pages of 'm_page_array'
+        u64          m_page_array_range;
         superpage_t* m_page_array;
         lldata_t     m_page_list_data;
-        llist_t      m_free_page_list;
+        llhead_t     m_free_page_list;  // Decommitted pages that were used before
         llist_t      m_cached_page_list;
+        bool         m_poison;
+        superlimit_t const* m_limit;
     };
 
-    void superpages_t::initialize(superheap_t& heap, xvmem* vmem, u64 address_range, u32 size_to_pre_allocate)
+    void superpages_t::initialize(xvmem* vmem, u64 address_range, u32 size_to_pre_allocate, bool poison, superlimit_t const* limit)
     {
         m_vmem         = vmem;
+        m_poison       = poison;
+        m_limit        = limit;
         u32 attributes = 0;
+        if (address_range > c_address_range_max)
+            address_range = c_address_range_max;
         m_vmem->reserve(address_range, m_page_size, attributes, m_address);
         m_address_range = address_range;
-
-        m_page_count = (u32)(address_range / (u64)m_page_size);
-        m_page_array = (superpage_t*)heap.allocate(m_page_count * sizeof(superpage_t));
-#ifdef SUPERALLOC_DEBUG
-        x_memset(m_page_array, 0xCDCDCDCD, m_page_count * sizeof(superpage_t));
-#endif
-
-        m_page_list_data.m_data     = heap.allocate(m_page_count * sizeof(llnode_t));
-        m_page_list_data.m_itemsize = sizeof(llnode_t);
-        m_page_list_data.m_pagesize = m_page_count * sizeof(llnode_t);
-
+        m_page_shift    = xcountTrailingZeros(m_page_size);
+        m_page_count    = (u32)(address_range >> m_page_shift);
+
+        m_page_array_committed    = 0;
+        m_page_array_range        = xalignUp((u64)m_page_count * sizeof(superpage_t), (u64)m_page_size);
+        void* page_array          = nullptr;
+        u32   page_array_page_size = 0;
+        m_vmem->reserve(m_page_array_range, page_array_page_size, attributes, page_array);
+        m_page_array                = (superpage_t*)page_array;
+        m_page_list_data.m_data     = m_page_array;
+        m_page_list_data.m_itemsize = sizeof(superpage_t);
+
+        // Pages are handed out in order, only the pre-committed pages are linked into the cache
         u32 const num_pages_to_cache = xalignUp(size_to_pre_allocate, m_page_size) / m_page_size;
+        u32 const num_pages_cache_max = (num_pages_to_cache > c_cached_pages_min) ? num_pages_to_cache : c_cached_pages_min;
         ASSERT(num_pages_to_cache <= m_page_count);
-        m_free_page_list.initialize(m_page_list_data, num_pages_to_cache, m_page_count - num_pages_to_cache, m_page_count);
+        m_page_never_used = num_pages_to_cache;
+        m_page_committed  = num_pages_to_cache;
+        m_free_page_list.reset();
+        m_cached_page_list = llist_t(0, (num_pages_cache_max < m_page_count ? num_pages_cache_max : m_page_count));
+        m_cached_page_list.m_head.reset();
         if (num_pages_to_cache > 0)
         {
-            m_cached_page_list.initialize(m_page_list_data, 0, num_pages_to_cache, num_pages_to_cache);
+            commit_page_array(num_pages_to_cache);
+            m_cached_page_list.initialize(m_page_list_data, 0, num_pages_to_cache, m_cached_page_list.m_size_max);
             m_vmem->commit(m_address, m_page_size, num_pages_to_cache);
         }
     }
 
-    void superpages_t::deinitialize(superheap_t& heap)
+    // The number of pages of 'm_page_array' that are still to be committed for the page entries of the first 'page_count' pages
+    u32 superpages_t::page_array_pages(u32 page_count) const
+    {
+        u64 const array_size = (u64)page_count * sizeof(superpage_t);
+        u64 const committed  = (u64)m_page_array_committed << m_page_shift;
+        if (array_size <= committed)
+            return 0;
+        return (u32)((xalignUp(array_size, (u64)m_page_size) - committed) >> m_page_shift);
+    }
+
+    // Commits the page entries of the first 'page_count' pages, returns false when the xvmem fails
+    bool superpages_t::commit_page_array(u32 page_count)
+    {
+        u32 const pages = page_array_pages(page_count);
+        if (pages > 0)
+        {
+            u64 const committed = (u64)m_page_array_committed << m_page_shift;
+            if (!m_vmem->commit((xbyte*)m_page_array + committed, m_page_size, pages))
+                return false;
+            if (m_poison)
+                x_memset((xbyte*)m_page_array + committed, 0xCDCDCDCD, (u64)pages << m_page_shift);
+            m_page_array_committed += pages;
+        }
+        return true;
+    }
+
+    // A page that is not cached has to be committed (now or by 'batch'), recycled pages are used before never used ones.
+    // Returns NIL when there is no page left, when committing it would cross the hard limit or when the xvmem fails.
+    u32 superpages_t::checkout_free_page(superbatch_t* batch)
+    {
+        u32 ipage = llnode_t::NIL;
+        if (!m_free_page_list.is_nil())
+        {
+            if (!m_limit->allows(m_page_size))
+                return llnode_t::NIL;
+            ipage = m_free_page_list.remove_headi(m_page_list_data);
+        }
+        else if (m_page_never_used < m_page_count)
+        {
+            if (!m_limit->allows((u64)(1 + page_array_pages(m_page_never_used + 1)) << m_page_shift))
+                return llnode_t::NIL;
+            if (!commit_page_array(m_page_never_used + 1))
+                return llnode_t::NIL;
+            ipage = m_page_never_used++;
+        }
+        else
+            return llnode_t::NIL;
+        if (batch != nullptr)
+        {
+            batch->add(address_of_page(ipage), 1);
+        }
+        else if (!m_vmem->commit(address_of_page(ipage), m_page_size, 1))
+        {
+            m_free_page_list.insert(m_page_list_data, ipage);
+            return llnode_t::NIL;
+        }
+        m_page_committed += 1;
+        return ipage;
+    }
+
+    void superpages_t::deinitialize()
     {
         // NOTE: Do we need to decommit physical pages, or is 'release' enough?
+        m_vmem->release(m_page_array, m_page_array_range);
         m_vmem->release(m_address, m_address_range);
     }
 
@@ -228,27 +434,71 @@ namespace xcore
         {
             ipage = m_cached_page_list.remove_headi(m_page_list_data);
         }
-        else if (!m_free_page_list.is_empty())
+        else
         {
-            ipage       = m_free_page_list.remove_headi(m_page_list_data);
-            void* apage = address_of_page(ipage);
-            m_vmem->commit(apage, m_page_size, 1);
+            ipage = checkout_free_page(nullptr);
+            if (ipage == llnode_t::NIL)
+                return llnode_t::NIL;
         }
-#ifdef SUPERALLOC_DEBUG
-        u64* apage = (u64*)address_of_page(ipage);
-        x_memset(apage, 0xCDCDCDCD, m_page_size);
-#endif
+        if (m_poison)
+            x_memset(address_of_page(ipage), 0xCDCDCDCD, m_page_size);
         superpage_t* ppage = &m_page_array[ipage];
         ppage->initialize(alloc_size, m_page_size);
         return ipage;
     }
 
+    // Fills up the cache of committed pages, returns the number of pages that were committed
+    u32 superpages_t::prewarm(bool prefault)
+    {
+        superbatch_t batch(m_vmem, m_page_size, true, false);
+        u32          count = 0;
+        while (!m_cached_page_list.is_full())
+        {
+            u32 const ipage = checkout_free_page(&batch);
+            if (ipage == llnode_t::NIL)
+                break;
+            m_cached_page_list.insert(m_page_list_data, ipage);
+            count += 1;
+        }
+        if (!batch.flush(prefault))
+        {
+            // The xvmem failed, the pages that were added to the cache are not (all) committed
+            superbatch_t undo(m_vmem, m_page_size, false, false);
+            for (u32 i = 0; i < count; ++i)
+            {
+                u32 const ipage = m_cached_page_list.remove_headi(m_page_list_data);
+                undo.add(address_of_page(ipage), 1);
+                m_free_page_list.insert(m_page_list_data, ipage);
+            }
+            undo.flush(false);
+            m_page_committed -= count;
+            return 0;
+        }
+        return count;
+    }
+
+    // Decommits the cache of committed pages, returns the number of pages that were decommitted
+    u32 superpages_t::flush()
+    {
+        superbatch_t batch(m_vmem, m_page_size, false, false);
+        u32          count = 0;
+        while (!m_cached_page_list.is_empty())
+        {
+            u32 const ipage = m_cached_page_list.remove_headi(m_page_list_data);
+            batch.add(address_of_page(ipage), 1);
+            m_free_page_list.insert(m_page_list_data, ipage);
+            count += 1;
+        }
+        batch.flush(false);
+        m_page_committed -= count;
+        return count;
+    }
+
     void superpages_t::release_page(u32 pageindex)
     {
         superpage_t* const ppage = &m_page_array[pageindex];
-#ifdef SUPERALLOC_DEBUG
-        x_memset(ppage, 0xFEFEFEFE, sizeof(superpage_t));
-#endif
+        if (m_poison)
+            x_memset(ppage, 0xFEFEFEFE, sizeof(superpage_t));
         if (!m_cached_page_list.is_full())
         {
             m_cached_page_list.insert(m_page_list_data, pageindex);
@@ -258,28 +508,53 @@ namespace xcore
             void* const paddr = address_of_page(pageindex);
             m_vmem->decommit(paddr, m_page_size, 1);
             m_free_page_list.insert(m_page_list_data, pageindex);
+            m_page_committed -= 1;
         }
     }
 
-    // Power-of-2 sizes, minimum size = 8, maximum_size = 32768
-    // @note: returned index to the user is u32[u16(page-index):u16(item-index)]
+    // Size classes of 8, 16 and then 2 per power-of-2 (24, 32, 48, 64, 96, ...), maximum size = page size
+    // @note: returned index to the user is the offset of the item in granules of 8 bytes, see superpages_t
     class superfsa_t
     {
     public:
         static const u32 NIL = 0xffffffff;
 
-        void initialize(superheap_t& heap, xvmem* vmem, u64 address_range, u32 size_to_pre_allocate);
-        void deinitialize(superheap_t& heap);
+        void initialize(xvmem* vmem, u64 address_range, u32 size_to_pre_allocate, bool poison, superlimit_t const* limit);
+        void deinitialize();
 
-        u32  alloc(u32 size);
-        u32  allocsizeof(u32 size) const;
+        u32  alloc(u32 size); // NIL when a page cannot be committed
+        static u32 allocsizeof(u32 size) { return class_size(size_class(size)); }
         void dealloc(u32 index);
+        bool is_valid(u32 index) const;
+        u32  prewarm(bool prefault) { return m_pages.prewarm(prefault); }
+        u32  flush() { return m_pages.flush(); }
+        u64  committed() const { return m_pages.committed(); }
 
         inline void* idx2ptr(u32 i) const { return m_pages.idx2ptr(i); }
         inline u32   ptr2idx(void* ptr) const { return m_pages.ptr2idx(ptr); }
 
         void* baseptr() const { return m_pages.m_address; }
         u32   pagesize() const { return m_pages.m_page_size; }
+        u64   address_range() const { return m_pages.m_address_range; }
+        void  rebind(xvmem* vmem) { m_pages.m_vmem = vmem; }
+
+        static inline u32 size_class(u32 size)
+        {
+            if (size <= 8)
+                return 0;
+            if (size <= 16)
+                return 1;
+            u32 const p = xceilpo2(size);
+            s32 const k = xcountTrailingZeros(p);
+            return (size <= ((p >> 2) * 3)) ? (u32)(2 * k - 8) : (u32)(2 * k - 7);
+        }
+
+        static inline u32 class_size(u32 c)
+        {
+            if (c < 2)
+                return 8 << c;
+            return (c & 1) ? (1u << ((c + 7) >> 1)) : (3u << ((c + 4) >> 1));
+        }
 
     private:
         superpages_t     m_pages;
@@ -287,26 +562,28 @@ namespace xcore
         llhead_t         m_used_page_list_per_size[c_max_num_sizes];
     };
 
-    void superfsa_t::initialize(superheap_t& heap, xvmem* vmem, u64 address_range, u32 size_to_pre_allocate)
+    void superfsa_t::initialize(xvmem* vmem, u64 address_range, u32 size_to_pre_allocate, bool poison, superlimit_t const* limit)
     {
-        m_pages.initialize(heap, vmem, address_range, size_to_pre_allocate);
+        m_pages.initialize(vmem, address_range, size_to_pre_allocate, poison, limit);
         for (u32 i = 0; i < c_max_num_sizes; i++)
             m_used_page_list_per_size[i].reset();
     }
 
-    void superfsa_t::deinitialize(superheap_t& heap) { m_pages.deinitialize(heap); }
+    void superfsa_t::deinitialize() { m_pages.deinitialize(); }
 
     u32 superfsa_t::alloc(u32 alloc_size)
     {
-        alloc_size      = xceilpo2(alloc_size);
-        s32 const c     = xcountTrailingZeros(alloc_size);
+        u32 const c     = size_class(alloc_size);
         u32       ipage = 0xffffffff;
-        ASSERT(c >= 0 && c < c_max_num_sizes);
+        ASSERT(c < c_max_num_sizes);
+        alloc_size = class_size(c);
+        ASSERT(alloc_size <= m_pages.m_page_size);
         if (m_used_page_list_per_size[c].is_nil())
         {
             // Get a page and initialize that page for this size
             ipage = m_pages.checkout_page(alloc_size);
-            m_used_page_list_per_size[c].insert(m_pages.m_page_list_data, ipage);
+            if (ipage != llnode_t::NIL)
+                m_used_page_list_per_size[c].insert(m_pages.m_page_list_data, ipage);
         }
         else
         {
@@ -322,7 +599,8 @@ namespace xcore
             {
                 m_used_page_list_per_size[c].remove_item(m_pages.m_page_list_data, ipage);
             }
-            return (ipage << 16) + itemidx;
+            u64 const offset = ((u64)ipage << m_pages.m_page_shift) + ((u64)itemidx * alloc_size);
+            return (u32)(offset >> superpages_t::c_granule_shift);
         }
         else
         {
@@ -330,28 +608,53 @@ namespace xcore
         }
     }
 
-    u32 superfsa_t::allocsizeof(u32 alloc_size) const { return xceilpo2(alloc_size); }
-
     void superfsa_t::dealloc(u32 i)
     {
-        u16 const          pageindex = i >> 16;
-        u16 const          itemindex = i & 0xFFFF;
+        if (i == NIL)
+            return;
+        u64 const          offset    = (u64)i << superpages_t::c_granule_shift;
+        u32 const          pageindex = (u32)(offset >> m_pages.m_page_shift);
         superpage_t* const ppage     = &m_pages.m_page_array[pageindex];
+        u32 const          itemindex = (u32)(offset & (m_pages.m_page_size - 1)) / ppage->m_item_size;
         void* const        paddr     = m_pages.address_of_page(pageindex);
-        ppage->deallocate(paddr, itemindex);
+        bool const         was_full  = ppage->is_full();
+        u32 const          c         = size_class(ppage->m_item_size);
+        ASSERT(c < c_max_num_sizes);
+        ppage->deallocate(paddr, (u16)itemindex, m_pages.m_poison);
         if (ppage->is_empty())
         {
-            s32 const c = xcountTrailingZeros(ppage->m_item_size);
-            ASSERT(c >= 0 && c < c_max_num_sizes);
-            m_used_page_list_per_size[c].remove_item(m_pages.m_page_list_data, pageindex);
+            // A page that was full is not part of the used list
+            if (!was_full)
+                m_used_page_list_per_size[c].remove_item(m_pages.m_page_list_data, pageindex);
             m_pages.release_page(pageindex);
         }
+        else if (was_full)
+        {
+            m_used_page_list_per_size[c].insert(m_pages.m_page_list_data, pageindex);
+        }
+    }
+
+    // True when 'i' is the index of an item on a page that has been used, the page entry is not trusted
+    bool superfsa_t::is_valid(u32 i) const
+    {
+        if (i == NIL)
+            return false;
+        u64 const offset    = (u64)i << superpages_t::c_granule_shift;
+        u32 const pageindex = (u32)(offset >> m_pages.m_page_shift);
+        if (pageindex >= m_pages.m_page_never_used)
+            return false;
+        superpage_t const* const ppage  = &m_pages.m_page_array[pageindex];
+        u32 const                inpage = (u32)(offset & (m_pages.m_page_size - 1));
+        if (ppage->m_item_size == 0 || ppage->m_item_size > m_pages.m_page_size || (inpage % ppage->m_item_size) != 0)
+            return false;
+        return (inpage / ppage->m_item_size) < ppage->m_item_max;
     }
 
     struct superbin_t
     {
-        inline superbin_t(u32 allocsize_mb, u32 allocsize_kb, u32 allocsize_b, u8 binidx, u8 allocindex, u8 use_binmap, u16 count, u16 l1len, u16 l2len)
-            : m_alloc_size((xMB * allocsize_mb) + (xKB * allocsize_kb) + (allocsize_b))
+        // constexpr, the bin tables have to be valid before any static constructor has run (see the malloc shim)
+        constexpr superbin_t(u32 allocsize, u16 binidx, u8 allocindex, u8 use_binmap, u32 count, u16 l1len, u16 l2len)
+            : m_alloc_size(allocsize)
             , m_alloc_bin_index(binidx)
             , m_alloc_index(allocindex)
             , m_use_binmap(use_binmap)
@@ -362,14 +665,326 @@ namespace xcore
         }
 
         u32 m_alloc_size;
-        u32 m_alloc_bin_index : 8; // Only one indirection is allowed
-        u32 m_alloc_index : 8;     // The index into the allocator that manages us
-        u32 m_use_binmap : 1;      // How do we manage a chunk (binmap or page-count)
+        u32 m_alloc_bin_index : 16; // Only one indirection is allowed
+        u32 m_alloc_index : 8;      // The index into the allocator that manages us
+        u32 m_use_binmap : 1;       // How do we manage a chunk (binmap or page-count)
         u32 m_alloc_count;
         u16 m_binmap_l1len;
         u16 m_binmap_l2len;
     };
 
+    // Parameters of a bin table, every power of two is divided into 2^bin_shift size classes. A size class is
+    // managed by the allocator with the smallest chunk size in which it leaves at most 'chunk_waste' percent of
+    // the committed pages unused.
+    struct superbin_params_t
+    {
+        constexpr superbin_params_t(u32 bin_shift, u32 min_size, u32 size_alignment, u32 max_size, u32 page_shift, u32 chunk_shift_min, u32 chunk_shift_max, u32 chunk_waste)
+            : m_bin_shift(bin_shift)
+            , m_min_size(min_size)
+            , m_size_alignment(size_alignment)
+            , m_max_size(max_size)
+            , m_page_shift(page_shift)
+            , m_chunk_shift_min(chunk_shift_min)
+            , m_chunk_shift_max(chunk_shift_max)
+            , m_chunk_waste(chunk_waste)
+        {
+        }
+
+        u32 m_bin_shift;       // 2 = ~25%, 3 = ~12.5% and 4 = ~6% allocation waste
+        u32 m_min_size;        // The smallest size class
+        u32 m_size_alignment;  // Size classes that are not a multiple of this are redirected to the next one that is
+        u32 m_max_size;        // The largest allocation size
+        u32 m_page_shift;      // Chunks are committed in pages of this size
+        u32 m_chunk_shift_min; // The chunk size of allocator 0, allocator 'n' has chunks of 2^(m_chunk_shift_min + n)
+        u32 m_chunk_shift_max;
+        u32 m_chunk_waste;     // Percentage
+    };
+
+    // The bin table generator, it replaces the tables that were pasted from the output of docs/allocation_sizes.cs.
+    // Everything is constexpr (C++11, so one return statement per function) and the same functions are used at
+    // runtime, e.g. to build a table that fits a histogram of allocation sizes.
+    constexpr u32 superbin_msb(u32 v) { return (v <= 1) ? 0 : (1 + superbin_msb(v >> 1)); }
+    constexpr u32 superbin_ceilpo2(u32 v) { return (v <= 1) ? v : ((u32)1 << (superbin_msb(v - 1) + 1)); }
+    constexpr u32 superbin_max(u32 a, u32 b) { return (a > b) ? a : b; }
+    constexpr u32 superbin_align(u32 v, u32 a) { return (v + (a - 1)) & ~(a - 1); }
+
+    // The index of the size class that 'size' rounds up to, sizes below 2^bin_shift map to themselves
+    constexpr u32 superbin_size2bin_msb(u32 size, u32 bin_shift, u32 msb)
+    {
+        return (msb < bin_shift) ? size : (((size + ((((u32)1 << msb) - 1) >> bin_shift)) >> (msb - bin_shift)) + ((msb - bin_shift) << bin_shift));
+    }
+    constexpr u32 superbin_size2bin(u32 size, u32 bin_shift) { return superbin_size2bin_msb(size, bin_shift, superbin_msb(size)); }
+
+    // The size of size class 'bin', the inverse of superbin_size2bin
+    constexpr u32 superbin_bin2size(u32 bin, u32 bin_shift)
+    {
+        return (bin < ((u32)2 << bin_shift)) ? bin : ((((u32)1 << bin_shift) + (bin & (((u32)1 << bin_shift) - 1))) << ((bin >> bin_shift) - 1));
+    }
+
+    constexpr u32 superbin_num_bins(superbin_params_t const& p) { return superbin_size2bin(p.m_max_size, p.m_bin_shift) + 1; }
+    constexpr u32 superbin_size(superbin_params_t const& p, u32 bin) { return superbin_max(p.m_min_size, superbin_bin2size(bin, p.m_bin_shift)); }
+    constexpr u32 superbin_redirect(superbin_params_t const& p, u32 bin) { return superbin_size2bin(superbin_align(superbin_size(p, bin), p.m_size_alignment), p.m_bin_shift); }
+
+    // The number of allocations of 'size' in a chunk of 2^chunk_shift, 0 when it wastes too much. Starting with
+    // the chunk filled up, every step drops the allocations that fit in the last committed page.
+    constexpr u64 superbin_committed(u32 size, u32 page_shift, u32 count) { return (((u64)count * size) + ((u64)1 << page_shift) - 1) & ~(((u64)1 << page_shift) - 1); }
+    constexpr bool superbin_fits(u32 size, u32 page_shift, u32 chunk_waste, u32 count)
+    {
+        return ((superbin_committed(size, page_shift, count) - ((u64)count * size)) * 100) <= (superbin_committed(size, page_shift, count) * chunk_waste);
+    }
+    constexpr u32 superbin_count_from(u32 size, u32 page_shift, u32 chunk_waste, u32 count)
+    {
+        return (count == 0) ? 0 : (superbin_fits(size, page_shift, chunk_waste, count) ? count : superbin_count_from(size, page_shift, chunk_waste, (u32)((superbin_committed(size, page_shift, count) - ((u64)1 << page_shift)) / size)));
+    }
+    constexpr u32 superbin_count(superbin_params_t const& p, u32 size, u32 chunk_shift) { return (size > ((u32)1 << chunk_shift)) ? 0 : superbin_count_from(size, p.m_page_shift, p.m_chunk_waste, ((u32)1 << chunk_shift) / size); }
+
+    // The smallest chunk that fits, otherwise the smallest chunk that holds a single allocation
+    constexpr u32 superbin_chunk_shift(superbin_params_t const& p, u32 size, u32 chunk_shift)
+    {
+        return (chunk_shift > p.m_chunk_shift_max) ? superbin_max(p.m_chunk_shift_min, superbin_msb(superbin_ceilpo2(size)))
+                                                   : ((superbin_count(p, size, chunk_shift) > 0) ? chunk_shift : superbin_chunk_shift(p, size, chunk_shift + 1));
+    }
+
+    // Binmap level lengths for a chunk that has room for 'capacity' allocations
+    constexpr u16 superbin_l2len(u32 capacity) { return (u16)((capacity <= 32) ? 0 : superbin_ceilpo2((capacity + 15) / 16)); }
+    constexpr u16 superbin_l1len(u32 capacity) { return (u16)((capacity <= 32) ? 0 : superbin_ceilpo2(superbin_max((superbin_l2len(capacity) + 15) / 16, 2))); }
+
+    constexpr superbin_t superbin_generate_count(superbin_params_t const& p, u32 bin, u32 size, u32 chunk_shift, u32 count)
+    {
+        return superbin_t(size, (u16)superbin_redirect(p, bin), (u8)(chunk_shift - p.m_chunk_shift_min), (count > 1) ? 1 : 0, count, (count > 1) ? superbin_l1len(((u32)1 << chunk_shift) / size) : 0,
+                          (count > 1) ? superbin_l2len(((u32)1 << chunk_shift) / size) : 0);
+    }
+    constexpr superbin_t superbin_generate_chunk(superbin_params_t const& p, u32 bin, u32 size, u32 chunk_shift) { return superbin_generate_count(p, bin, size, chunk_shift, superbin_max(1, superbin_count(p, size, chunk_shift))); }
+    constexpr superbin_t superbin_generate(superbin_params_t const& p, u32 bin) { return superbin_generate_chunk(p, bin, superbin_size(p, bin), superbin_chunk_shift(p, superbin_size(p, bin), p.m_chunk_shift_min)); }
+
+    // A bin table as a constant, 'P::params()' returns the superbin_params_t and 'S' is superbin_make_seq_t<num bins>::type
+    template <u32... I> struct superbin_seq_t
+    {
+    };
+    template <u32 N, u32... I> struct superbin_make_seq_t : superbin_make_seq_t<N - 1, N - 1, I...>
+    {
+    };
+    template <u32... I> struct superbin_make_seq_t<0, I...>
+    {
+        typedef superbin_seq_t<I...> type;
+    };
+
+    template <typename P, typename S> struct superbin_table_t;
+    template <typename P, u32... I> struct superbin_table_t<P, superbin_seq_t<I...>>
+    {
+        static constexpr superbin_t c_bins[sizeof...(I)] = {superbin_generate(P::params(), I)...};
+    };
+    template <typename P, u32... I> constexpr superbin_t superbin_table_t<P, superbin_seq_t<I...>>::c_bins[sizeof...(I)];
+
+    // The runtime version of superbin_size2bin
+    static inline u32 superbin_size2bin_fast(u32 size, u32 bin_shift)
+    {
+        if (size < ((u32)1 << bin_shift))
+            return size;
+        u32 const msb = 31 - xcountLeadingZeros(size);
+        u32 const t   = (((u32)1 << msb) - 1) >> bin_shift;
+        return ((size + t) >> (msb - bin_shift)) + ((msb - bin_shift) << bin_shift);
+    }
+
+    static const u32 c_superbin_max_bins = 512; // Enough for a bin shift of 4
+
+    // Builds a bin table at runtime, 'bins' has room for superbin_num_bins(p) entries. With a list of size classes
+    // only those are kept. With a histogram the size classes that hold less than 1/1000 of the observed allocations
+    // are merged into the next size class, apart from the ones on a coarse (~25% waste) grid so that sizes that were
+    // not observed do not waste too much. Returns the number of bins.
+    static s32 superbin_generate(superbin_params_t const& p, superbin_t* bins, xvmem_size_histogram const* histogram, u32 const* bin_sizes, u32 num_bin_sizes)
+    {
+        u32 const num_bins = superbin_num_bins(p);
+        ASSERT(num_bins <= c_superbin_max_bins);
+        for (u32 b = 0; b < num_bins; ++b)
+            bins[b] = superbin_generate(p, b);
+
+        bool const listed = bin_sizes != nullptr && num_bin_sizes > 0;
+        if (!listed && (histogram == nullptr || histogram->m_count == 0))
+            return (s32)num_bins;
+
+        u64 observed[c_superbin_max_bins];
+        u64 total = 0;
+        for (u32 b = 0; b < num_bins; ++b)
+            observed[b] = 0;
+        u32 const  count  = listed ? num_bin_sizes : histogram->m_count;
+        u32 const* sizes  = listed ? bin_sizes : histogram->m_sizes;
+        for (u32 i = 0; i < count; ++i)
+        {
+            u64 const n = listed ? 1 : histogram->m_counts[i];
+            if (sizes[i] <= p.m_max_size)
+                observed[bins[superbin_size2bin_fast(sizes[i], p.m_bin_shift)].m_alloc_bin_index] += n;
+            total += n;
+        }
+
+        // Walking down, a bin that is not kept is redirected to the nearest kept bin above it
+        u32 const c_coarse_shift = 2;
+        u32       kept           = num_bins - 1;
+        for (s32 b = (s32)num_bins - 1; b >= 0; --b)
+        {
+            u32 const redirect = bins[b].m_alloc_bin_index;
+            if (redirect != (u32)b)
+            {
+                bins[b].m_alloc_bin_index = bins[redirect].m_alloc_bin_index;
+                continue;
+            }
+            u32 const  size   = bins[b].m_alloc_size;
+            bool const coarse = !listed && superbin_bin2size(superbin_size2bin_fast(size, c_coarse_shift), c_coarse_shift) == size;
+            bool const hot    = observed[b] > 0 && (listed || (observed[b] * 1000) >= total);
+            if (coarse || hot || b == (s32)num_bins - 1)
+                kept = (u32)b;
+            bins[b].m_alloc_bin_index = (u16)kept;
+        }
+        return (s32)num_bins;
+    }
+
+    // The waste of an allocation in size class 'bin', per allocation: its share of the unused tail of a chunk
+    static inline u64 superbin_tail_waste(superbin_params_t const& p, superbin_t const& bin)
+    {
+        u64 const committed = superbin_committed(bin.m_alloc_size, p.m_page_shift, bin.m_alloc_count);
+        return (committed - ((u64)bin.m_alloc_count * bin.m_alloc_size)) / bin.m_alloc_count;
+    }
+
+    // The bytes that 'histogram' wastes with bin table 'bins', internal waste plus the chunk tail waste
+    static u64 superbin_waste(superbin_params_t const& p, superbin_t const* bins, xvmem_size_histogram const& histogram)
+    {
+        u64 waste = 0;
+        for (u32 i = 0; i < histogram.m_count; ++i)
+        {
+            u32 const size = histogram.m_sizes[i];
+            if (size == 0 || size > p.m_max_size)
+                continue;
+            superbin_t const& bin = bins[bins[superbin_size2bin_fast(size, p.m_bin_shift)].m_alloc_bin_index];
+            waste += histogram.m_counts[i] * ((bin.m_alloc_size - size) + superbin_tail_waste(p, bin));
+        }
+        return waste;
+    }
+
+    // Picks at most 'max_bins' size classes out of the table of 'p' that minimize superbin_waste for 'histogram'.
+    // Dynamic programming over the candidate size classes in ascending order, every candidate covers the sizes above
+    // the previous kept candidate. Above the largest observed size the classes of a coarse (~25% waste) grid follow,
+    // these are not part of 'max_bins'. Returns the number of sizes in 'bin_sizes', which has room for 'max_sizes'.
+    static u32 superbin_fit(superbin_params_t const& p, xvmem_size_histogram const& histogram, u32 max_bins, u32* bin_sizes, u32 max_sizes, alloc_t* heap)
+    {
+        u32 const num_bins = superbin_num_bins(p);
+        ASSERT(num_bins <= c_superbin_max_bins && max_bins > 0);
+        superbin_t* bins = (superbin_t*)heap->allocate(sizeof(superbin_t) * num_bins, sizeof(void*));
+        superbin_generate(p, bins, nullptr, nullptr, 0);
+
+        // The candidates, with the number of allocations and the total size that they would serve
+        u16 candidate[c_superbin_max_bins];
+        u64 count[c_superbin_max_bins + 1];
+        u64 bytes[c_superbin_max_bins + 1];
+        u32 slot[c_superbin_max_bins];
+        u32 num = 0;
+        for (u32 b = 0; b < num_bins; ++b)
+        {
+            if (bins[b].m_alloc_bin_index == b)
+            {
+                slot[b]          = num;
+                candidate[num++] = (u16)b;
+            }
+        }
+        for (u32 c = 0; c <= num; ++c)
+        {
+            count[c] = 0;
+            bytes[c] = 0;
+        }
+        for (u32 i = 0; i < histogram.m_count; ++i)
+        {
+            u32 const size = histogram.m_sizes[i];
+            if (size == 0 || size > p.m_max_size)
+                continue;
+            u32 const c = slot[bins[superbin_size2bin_fast(size, p.m_bin_shift)].m_alloc_bin_index];
+            count[c + 1] += histogram.m_counts[i];
+            bytes[c + 1] += histogram.m_counts[i] * size;
+        }
+        u32 last = 0; // The candidate of the largest observed size
+        for (u32 c = 1; c <= num; ++c)
+        {
+            if (count[c] > 0)
+                last = c - 1;
+        }
+        for (u32 c = 1; c <= num; ++c) // prefix sums, [c + 1] holds the candidates up to and including 'c'
+        {
+            count[c] += count[c - 1];
+            bytes[c] += bytes[c - 1];
+        }
+        if (count[num] == 0)
+        {
+            heap->deallocate(bins);
+            return 0;
+        }
+
+        // cost[j] is the waste of all sizes up to candidate 'j' when 'j' is the k-th kept candidate
+        u32 const levels = (max_bins < (last + 1)) ? max_bins : (last + 1);
+        u64*      cost   = (u64*)heap->allocate(sizeof(u64) * num * 2, sizeof(u64));
+        u16*      from   = (u16*)heap->allocate(sizeof(u16) * num * levels, sizeof(u16));
+        u64*      prev   = cost;
+        u64*      next   = cost + num;
+        u64 const c_inf  = 0xffffffffffffffffull;
+
+        u32 best_level = 0;
+        u64 best_cost  = c_inf;
+        for (u32 k = 0; k < levels; ++k)
+        {
+            for (u32 j = 0; j <= last; ++j)
+            {
+                superbin_t const& bin  = bins[candidate[j]];
+                u64 const         unit = bin.m_alloc_size + superbin_tail_waste(p, bin);
+                next[j]                = c_inf;
+                from[k * num + j]      = 0xffff;
+                if (k == 0)
+                {
+                    next[j] = (unit * count[j + 1]) - bytes[j + 1];
+                    continue;
+                }
+                for (u32 i = k - 1; i < j; ++i)
+                {
+                    if (prev[i] == c_inf)
+                        continue;
+                    u64 const c = prev[i] + (unit * (count[j + 1] - count[i + 1])) - (bytes[j + 1] - bytes[i + 1]);
+                    if (c < next[j])
+                    {
+                        next[j]           = c;
+                        from[k * num + j] = (u16)i;
+                    }
+                }
+            }
+            if (next[last] < best_cost)
+            {
+                best_cost  = next[last];
+                best_level = k;
+            }
+            u64* t = prev;
+            prev   = next;
+            next   = t;
+        }
+
+        // Walk back from the candidate of the largest observed size
+        u32 n = (best_level < max_sizes) ? (best_level + 1) : max_sizes;
+        u32 j = last;
+        for (s32 k = (s32)best_level; k >= 0; --k)
+        {
+            if ((u32)k < n)
+                bin_sizes[k] = bins[candidate[j]].m_alloc_size;
+            j = from[k * num + j];
+        }
+
+        u32 const c_coarse_shift = 2;
+        for (u32 c = last + 1; c < num && n < max_sizes; ++c)
+        {
+            u32 const size = bins[candidate[c]].m_alloc_size;
+            if (c == (num - 1) || superbin_bin2size(superbin_size2bin_fast(size, c_coarse_shift), c_coarse_shift) == size)
+                bin_sizes[n++] = size;
+        }
+
+        heap->deallocate(from);
+        heap->deallocate(cost);
+        heap->deallocate(bins);
+        return n;
+    }
+
     // Managing requests of different chunk-sizes but managed through first a division into blocks, 
     // where blocks are divided into segments. Segments contain chunks.
     //
@@ -392,23 +1007,27 @@ namespace xcore
     {
         struct chain_t
         {
-            u16 m_block_index;
-            u16 m_block_chunk_index;
+            u32 m_block_index;
+            u32 m_block_chunk_index;
             u32 m_chunk_index;
         };
 
+        // One cache line, a deallocation only reads 'm_chunks_array' and 'm_chunks_shift'
         struct block_t : llnode_t
         {
-            u16* m_chunks_physical_pages;
             u32* m_chunks_array;
+            u16  m_chunks_shift; // c_configs[m_config_index].m_chunks_shift
+            u16  m_config_index;
+            u16  m_chunks_used;
+            u16  m_padding[5];
+            u16* m_chunks_physical_pages;
             u32* m_chunks_alloc_tracking_array;
             u32  m_binmap_chunks_free;
             u32  m_binmap_chunks_cached;
             u32  m_count_chunks_cached;
             u32  m_count_chunks_free;
-            u16  m_config_index;
-            u16  m_chunks_used;
         };
+        static_assert(sizeof(block_t) == 64, "block_t is one cache line");
 
         struct config_t
         {
@@ -431,23 +1050,34 @@ namespace xcore
             config_t(64, 24, 2, 4),     config_t(32, 25, 0, 0),     config_t(16, 26, 0, 0),     config_t(8, 27, 0, 0),      config_t(4, 28, 0, 0),     config_t(2, 29, 0, 0),    config_t(0, 0, 0, 0),     config_t(0, 0, 0, 0),
         };
 
-        void initialize(xvmem* vmem, u64 address_range, u64 block_range, superheap_t* heap, superfsa_t* fsa)
+        void initialize(xvmem* vmem, u64 address_range, u64 block_range, superheap_t* heap, superfsa_t* fsa, bool poison, superlimit_t const* limit)
         {
             m_vmem          = vmem;
+            m_poison        = poison;
+            m_limit         = limit;
             m_address_range = address_range;
             u32 const attrs = 0;
-            m_vmem->reserve(address_range, m_page_size, attrs, m_address_base);
+            m_vmem->reserve(address_range, m_page_size, xvmem::ATTR_MANAGED, m_address_base);
             m_page_shift = xcountTrailingZeros(m_page_size);
             m_page_count = 0;
+            m_page_count_cached = 0;
 
             m_fsa = fsa;
 
+            // The block array is only reserved, blocks are handed out in order and the pages of the array are
+            // committed when the first block on them is checked out. Released blocks are recycled first.
             m_blocks_shift                = xcountTrailingZeros(block_range);
-            u32 const num_blocks          = (u32)(m_address_range >> m_blocks_shift);
-            m_blocks_array                = (block_t*)heap->allocate(num_blocks * sizeof(block_t));
+            m_blocks_max                  = (u32)(m_address_range >> m_blocks_shift);
+            m_blocks_never_used           = 0;
+            m_blocks_array_committed      = 0;
+            m_blocks_array_range          = xalignUp((u64)m_blocks_max * sizeof(block_t), (u64)m_page_size);
+            void* blocks_array            = nullptr;
+            u32   blocks_array_page_size  = 0;
+            m_vmem->reserve(m_blocks_array_range, blocks_array_page_size, attrs, blocks_array);
+            m_blocks_array                = (block_t*)blocks_array;
             m_blocks_list_data.m_data     = m_blocks_array;
             m_blocks_list_data.m_itemsize = sizeof(block_t);
-            m_blocks_list_free.initialize(m_blocks_list_data, 0, num_blocks, num_blocks);
+            m_blocks_list_free.reset();
 
             for (s32 i = 0; i < 32; i++)
             {
@@ -455,25 +1085,65 @@ namespace xcore
             }
         }
 
-        void deinitialize(superheap_t& heap) {}
+        void deinitialize(superheap_t& heap)
+        {
+            m_vmem->release(m_blocks_array, m_blocks_array_range);
+            m_vmem->release(m_address_base, m_address_range);
+            m_blocks_array = nullptr;
+            m_address_base = nullptr;
+        }
+
+        // Returns NIL when the page of the block array that it is on cannot be committed (hard limit or xvmem)
+        u32 checkout_block_index()
+        {
+            if (!m_blocks_list_free.is_nil())
+                return m_blocks_list_free.remove_headi(m_blocks_list_data);
+
+            ASSERT(m_blocks_never_used < m_blocks_max); // Out of address space
+            u64 const array_size = (u64)(m_blocks_never_used + 1) * sizeof(block_t);
+            u64 const committed  = (u64)m_blocks_array_committed << m_page_shift;
+            if (array_size > committed)
+            {
+                u32 const pages = (u32)((xalignUp(array_size, (u64)m_page_size) - committed) >> m_page_shift);
+                if (!m_limit->allows((u64)pages << m_page_shift) || !m_vmem->commit((xbyte*)m_blocks_array + committed, m_page_size, pages))
+                    return llnode_t::NIL;
+                m_blocks_array_committed += pages;
+            }
+            return m_blocks_never_used++;
+        }
 
-        void initialize_binmap(u32 const binmap_index, config_t const& config, bool set)
+        // Returns NIL when the fsa cannot commit
+        u32 checkout_binmap(config_t const& config, bool set)
         {
+            u32 const binmap_index = m_fsa->alloc(sizeof(binmap_t));
+            u32 const l2index      = (config.m_binmap_l2 > 0) ? m_fsa->alloc(sizeof(u16) * config.m_binmap_l2) : superfsa_t::NIL;
+            u32 const l1index      = (config.m_binmap_l1 > 2) ? m_fsa->alloc(sizeof(u16) * config.m_binmap_l1) : superfsa_t::NIL;
+            if (binmap_index == superfsa_t::NIL || (config.m_binmap_l2 > 0 && l2index == superfsa_t::NIL) || (config.m_binmap_l1 > 2 && l1index == superfsa_t::NIL))
+            {
+                m_fsa->dealloc(binmap_index);
+                m_fsa->dealloc(l2index);
+                m_fsa->dealloc(l1index);
+                return superfsa_t::NIL;
+            }
             binmap_t* bm    = (binmap_t*)m_fsa->idx2ptr(binmap_index);
 
-			u16* l2;
-			bm->m_l2_offset = m_fsa->alloc(sizeof(u16) * config.m_binmap_l2);
-			l2 = (u16*)m_fsa->idx2ptr(bm->m_l2_offset);
-			
+			u16* l2 = nullptr;
+			bm->m_l2_offset = l2index;
+			if (config.m_binmap_l2 > 0)
+			{
+				l2 = (u16*)m_fsa->idx2ptr(bm->m_l2_offset);
+			}
+
+			// A level 1 of at most 2 words is stored in 'm_l1_offset' itself
 			u16* l1;
 			if (config.m_binmap_l1 > 2)
 			{
-				bm->m_l1_offset = m_fsa->alloc(sizeof(u16) * config.m_binmap_l1);
+				bm->m_l1_offset = l1index;
 				l1 = (u16*)m_fsa->idx2ptr(bm->m_l1_offset);
 			}
 			else
 			{
-				bm->m_l1_offset = set ? 0xffffffff : 0;
+				bm->m_l1_offset = 0;
 				l1 = (u16*)&bm->m_l1_offset;
 			}
 
@@ -481,41 +1151,66 @@ namespace xcore
                 bm->init1(config.m_chunks_max, l1, config.m_binmap_l1, l2, config.m_binmap_l2);
             else
                 bm->init(config.m_chunks_max, l1, config.m_binmap_l1, l2, config.m_binmap_l2);
+            return binmap_index;
+        }
+
+        void deinitialize_binmap(u32 const binmap_index, config_t const& config)
+        {
+            binmap_t* bm = (binmap_t*)m_fsa->idx2ptr(binmap_index);
+            if (config.m_binmap_l1 > 2)
+                m_fsa->dealloc(bm->m_l1_offset);
+            if (config.m_binmap_l2 > 0)
+                m_fsa->dealloc(bm->m_l2_offset);
+            m_fsa->dealloc(binmap_index);
         }
 
-        binmap_t* get_binmap_by_index(u32 const binmap_index, u16*& l1, u16*& l2)
+        binmap_t* get_binmap_by_index(u32 const binmap_index, config_t const& config, u16*& l1, u16*& l2) const
         {
             binmap_t* bm = (binmap_t*)m_fsa->idx2ptr(binmap_index);
-            l1           = (u16*)m_fsa->idx2ptr(bm->m_l1_offset);
+            l1           = (config.m_binmap_l1 > 2) ? (u16*)m_fsa->idx2ptr(bm->m_l1_offset) : (u16*)&bm->m_l1_offset;
             l2           = (u16*)m_fsa->idx2ptr(bm->m_l2_offset);
             return bm;
         }
 
-        u16 checkout_block(u32 const config_index)
+        u32 checkout_block(u32 const config_index)
         {
             config_t const& config     = c_configs[config_index];
             u16 const       num_chunks = config.m_chunks_max;
 
-            u32 const block_index         = m_blocks_list_free.remove_headi(m_blocks_list_data);
+            u32 const block_index         = checkout_block_index();
+            if (block_index == llnode_t::NIL)
+                return llnode_t::NIL;
             block_t*  block               = &m_blocks_array[block_index];
             u32 const ichunks_index_array = m_fsa->alloc(sizeof(u32) * num_chunks);
             u32 const ichunks_pages_array = m_fsa->alloc(sizeof(u32) * num_chunks);
             u32 const ichunks_alloc_tracking_array = m_fsa->alloc(sizeof(u32) * num_chunks);
+            u32 const ibinmap_chunks_cached        = checkout_binmap(config, true);
+            u32 const ibinmap_chunks_free          = checkout_binmap(config, false);
+            if (ichunks_index_array == superfsa_t::NIL || ichunks_pages_array == superfsa_t::NIL || ichunks_alloc_tracking_array == superfsa_t::NIL || ibinmap_chunks_cached == superfsa_t::NIL ||
+                ibinmap_chunks_free == superfsa_t::NIL)
+            {
+                // The bookkeeping cannot be committed, the block goes back to the released blocks
+                m_fsa->dealloc(ichunks_index_array);
+                m_fsa->dealloc(ichunks_pages_array);
+                m_fsa->dealloc(ichunks_alloc_tracking_array);
+                if (ibinmap_chunks_cached != superfsa_t::NIL)
+                    deinitialize_binmap(ibinmap_chunks_cached, config);
+                if (ibinmap_chunks_free != superfsa_t::NIL)
+                    deinitialize_binmap(ibinmap_chunks_free, config);
+                m_blocks_list_free.insert(m_blocks_list_data, block_index);
+                return llnode_t::NIL;
+            }
 
             block->m_prev                  = llnode_t::NIL;
             block->m_next                  = llnode_t::NIL;
             block->m_chunks_physical_pages = (u16*)m_fsa->idx2ptr(ichunks_pages_array);
             block->m_chunks_array          = (u32*)m_fsa->idx2ptr(ichunks_index_array);
             block->m_chunks_alloc_tracking_array = (u32*)m_fsa->idx2ptr(ichunks_alloc_tracking_array);
-            block->m_binmap_chunks_cached  = m_fsa->alloc(sizeof(binmap_t));
-            block->m_binmap_chunks_free    = m_fsa->alloc(sizeof(binmap_t));
-            if (config.m_binmap_l2 > 0)
-            {
-                initialize_binmap(block->m_binmap_chunks_cached, config, true);
-                initialize_binmap(block->m_binmap_chunks_free, config, false);
-            }
+            block->m_binmap_chunks_cached  = ibinmap_chunks_cached;
+            block->m_binmap_chunks_free    = ibinmap_chunks_free;
 
             block->m_config_index = config_index;
+            block->m_chunks_shift = config.m_chunks_shift;
             block->m_chunks_used  = 0;
 
             block->m_count_chunks_cached = 0;
@@ -534,7 +1229,10 @@ namespace xcore
             return (size + (m_page_size - 1)) >> m_page_shift;
         }
 
-        chain_t checkout_chunk(u32 chunk_shift, u32 alloc_size, u32 chunk_index, superbin_t const& bin)
+        // 'dirty_pages' returns the number of pages at the start of the chunk that were already committed and
+        // may hold old data, the pages after them are freshly committed and read as zero. Returns false when the
+        // chunk cannot be committed (hard limit or xvmem), nothing is checked out then.
+        bool checkout_chunk(u32 chunk_shift, u32 alloc_size, u32 chunk_index, superbin_t const& bin, chain_t& chain, u32& dirty_pages)
         {
             ASSERT(chunk_shift >= 16);
             u32 const config_index = chunk_shift - 16;
@@ -542,6 +1240,8 @@ namespace xcore
             if (m_block_per_group_list_active[config_index].is_nil())
             {
                 block_index = checkout_block(config_index);
+                if (block_index == llnode_t::NIL)
+                    return false;
                 m_block_per_group_list_active[config_index].insert(m_blocks_list_data, block_index);
             }
             else
@@ -549,28 +1249,24 @@ namespace xcore
                 block_index = m_block_per_group_list_active[config_index].m_index;
             }
 
-            u32 const required_physical_pages = chunk_physical_pages(bin, alloc_size);
-            m_page_count += required_physical_pages;
-
-            // Here we have a block where we can get a chunk from
+            // Here we have a block where we can get a chunk from, a cached chunk is preferred
             config_t const& config                  = c_configs[config_index];
             block_t*        block                   = &m_blocks_array[block_index];
+            bool const      cached                  = block->m_count_chunks_cached > 0;
             u32             block_chunk_index       = 0xffffffff;
             u32             already_committed_pages = 0;
-            if (block->m_count_chunks_cached > 0)
+            u16 *           l1, *l2;
+            binmap_t*       bm = nullptr;
+            if (cached)
             {
-                u16 *     l1, *l2;
-                binmap_t* bm      = get_binmap_by_index(block->m_binmap_chunks_cached, l1, l2);
-                block_chunk_index = bm->findandset(config.m_chunks_max, l1, l2);
-                block->m_count_chunks_cached -= 1;
+                bm                      = get_binmap_by_index(block->m_binmap_chunks_cached, config, l1, l2);
+                block_chunk_index       = (u32)bm->find(config.m_chunks_max, l1, l2);
                 already_committed_pages = block->m_chunks_physical_pages[block_chunk_index];
             }
             else if (block->m_count_chunks_free > 0)
             {
-                u16 *     l1, *l2;
-                binmap_t* bm      = get_binmap_by_index(block->m_binmap_chunks_free, l1, l2);
-                block_chunk_index = bm->findandset(config.m_chunks_max, l1, l2);
-                block->m_count_chunks_free -= 1;
+                bm                = get_binmap_by_index(block->m_binmap_chunks_free, config, l1, l2);
+                block_chunk_index = (u32)bm->find(config.m_chunks_max, l1, l2);
             }
             else
             {
@@ -578,21 +1274,52 @@ namespace xcore
                 ASSERT(false);
             }
 
-            u32* const chunk_tracking_array = (u32*)m_fsa->alloc(bin.m_alloc_count);
-            u32 const chunk_tracking_index = m_fsa->ptr2idx(chunk_tracking_array);
+            // No allocation has an associated value yet, see 'get_assoc'
+            u32 const chunk_tracking_index = m_fsa->alloc(sizeof(u32) * bin.m_alloc_count);
+            if (chunk_tracking_index == superfsa_t::NIL)
+                return false;
+
+            // The tracking array is committed first, so the limit sees it. A cached chunk may already have (some of)
+            // the pages committed, the missing ones are committed before anything is checked out.
+            u32 const    required_physical_pages = chunk_physical_pages(bin, alloc_size);
+            xbyte* const chunk_address           = (xbyte*)block_chunk_address(block_index, block_chunk_index, config);
+            if (required_physical_pages > already_committed_pages)
+            {
+                u32 const pages = required_physical_pages - already_committed_pages;
+                if (!m_limit->allows((u64)pages << m_page_shift) || !m_vmem->commit(chunk_address + ((u64)already_committed_pages << m_page_shift), m_page_size, pages))
+                {
+                    m_fsa->dealloc(chunk_tracking_index);
+                    return false;
+                }
+            }
+            x_memset(m_fsa->idx2ptr(chunk_tracking_index), 0xffffffff, sizeof(u32) * bin.m_alloc_count);
+
+            bm->set(config.m_chunks_max, l1, l2, block_chunk_index);
+            if (cached)
+            {
+                block->m_count_chunks_cached -= 1;
+                m_page_count_cached -= already_committed_pages;
+            }
+            else
+            {
+                block->m_count_chunks_free -= 1;
+            }
+            m_page_count += required_physical_pages;
 
-            block->m_m_chunks_alloc_tracking_array[block_chunk_index] = chunk_tracking_index;
+            block->m_chunks_alloc_tracking_array[block_chunk_index] = chunk_tracking_index;
             block->m_chunks_array[block_chunk_index]          = chunk_index;
             block->m_chunks_physical_pages[block_chunk_index] = required_physical_pages;
 
-            // Commit the virtual pages for this chunk
             if (required_physical_pages < already_committed_pages)
             {
-                // Overcommitted, uncommit pages ?
+                // Overcommitted, decommit the pages that are not needed
+                m_vmem->decommit(chunk_address + ((u64)required_physical_pages << m_page_shift), m_page_size, already_committed_pages - required_physical_pages);
             }
-            else if (required_physical_pages > already_committed_pages)
+            dirty_pages = (required_physical_pages < already_committed_pages) ? required_physical_pages : already_committed_pages;
+            if (m_poison && bin.m_use_binmap == 1)
             {
-                // Undercommitted, commit necessary pages
+                x_memset(chunk_address, 0xFEFEFEFE, (u64)required_physical_pages << m_page_shift);
+                dirty_pages = required_physical_pages;
             }
 
             // Check if block is now empty
@@ -603,11 +1330,10 @@ namespace xcore
             }
 
             // Return the chunk index
-            chain_t chain;
             chain.m_block_chunk_index = block_chunk_index;
             chain.m_block_index       = block_index;
             chain.m_chunk_index       = chunk_index;
-            return chain;
+            return true;
         }
 
         void release_chunk(chain_t const& chain, u32 alloc_size)
@@ -622,19 +1348,24 @@ namespace xcore
             }
 
             m_page_count -= block->m_chunks_physical_pages[chain.m_block_chunk_index];
+            m_page_count_cached += block->m_chunks_physical_pages[chain.m_block_chunk_index];
 
             // We need to limit the number of cached chunks, once that happens we need to add the
             // block_chunk_index to the m_binmap_chunks_free.
             u16 *     l1, *l2;
-            binmap_t* bm = get_binmap_by_index(block->m_binmap_chunks_cached, l1, l2);
+            binmap_t* bm = get_binmap_by_index(block->m_binmap_chunks_cached, config, l1, l2);
             bm->clr(config.m_chunks_max, l1, l2, chain.m_block_chunk_index);
             block->m_count_chunks_cached += 1;
 
             // Release the tracking array that was allocated for this chunk
-            u32 const chunk_tracking_index = block->m_m_chunks_alloc_tracking_array[chain.m_block_chunk_index];
-            block->m_m_chunks_alloc_tracking_array[chain.m_block_chunk_index] = 0xffffffff;
+            u32 const chunk_tracking_index = block->m_chunks_alloc_tracking_array[chain.m_block_chunk_index];
+            block->m_chunks_alloc_tracking_array[chain.m_block_chunk_index] = 0xffffffff;
             m_fsa->dealloc(chunk_tracking_index);
 
+            // Release the chunk structure back to the fsa
+            m_fsa->dealloc(chain.m_chunk_index);
+            block->m_chunks_array[chain.m_block_chunk_index] = 0xffffffff;
+
             block->m_chunks_used -= 1;
             if (block->m_chunks_used == 0)
             {
@@ -643,22 +1374,26 @@ namespace xcore
                 // Maybe every size should cache at least one block otherwise single alloc/dealloc calls will
                 // checkout and release a block every time?
 
-                // Release back all physical pages of the cached chunks
-                binmap_t* bm = get_binmap_by_index(block->m_binmap_chunks_cached, l1, l2);
+                // Release back all physical pages of the cached chunks, the other chunks of the block have no
+                // committed pages so the cached chunks are decommitted as one range.
+                superbatch_t batch(m_vmem, m_page_size, false, true);
                 while (block->m_count_chunks_cached > 0)
                 {
                     u32 const ci = bm->findandset(config.m_chunks_max, l1, l2);
-                    // NOTE: We need to decommit memory here.
+                    batch.add(block_chunk_address(chain.m_block_index, ci, config), block->m_chunks_physical_pages[ci]);
+                    m_page_count_cached -= block->m_chunks_physical_pages[ci];
                     block->m_count_chunks_cached -= 1;
                 }
+                batch.flush(false);
 
                 u32 const chunks_array_index = m_fsa->ptr2idx(block->m_chunks_array);
                 m_fsa->dealloc(chunks_array_index);
                 u32 const chunks_pages_index = m_fsa->ptr2idx(block->m_chunks_physical_pages);
                 m_fsa->dealloc(chunks_pages_index);
-                m_fsa->dealloc(block->m_binmap_chunks_cached);
-                m_fsa->dealloc(block->m_binmap_chunks_free);
-                m_fsa->dealloc(block->m_m_chunks_alloc_tracking_array);                
+                deinitialize_binmap(block->m_binmap_chunks_cached, config);
+                deinitialize_binmap(block->m_binmap_chunks_free, config);
+                u32 const chunks_tracking_index = m_fsa->ptr2idx(block->m_chunks_alloc_tracking_array);
+                m_fsa->dealloc(chunks_tracking_index);
 
                 block->m_prev                = llnode_t::NIL;
                 block->m_next                = llnode_t::NIL;
@@ -669,25 +1404,99 @@ namespace xcore
 
                 m_blocks_list_free.insert(m_blocks_list_data, chain.m_block_index);
             }
+        }
 
-            // Release the chunk structure back to the fsa
-            m_fsa->dealloc(chain.m_chunk_index);
-            block->m_chunks_array[chain.m_block_chunk_index] = 0xffffffff;
+        // Decommits the pages of all cached chunks, they become free chunks. Returns the number of pages.
+        u32 flush_cached()
+        {
+            superbatch_t batch(m_vmem, m_page_size, false, false);
+            u32 const    pages = m_page_count_cached;
+            for (u32 bi = 0; bi < m_blocks_never_used && m_page_count_cached > 0; ++bi)
+            {
+                block_t* block = &m_blocks_array[bi];
+                if (block->m_chunks_used == 0 || block->m_count_chunks_cached == 0)
+                    continue;
+
+                config_t const& config = c_configs[block->m_config_index];
+                u16 *           cl1, *cl2, *fl1, *fl2;
+                binmap_t*       cached = get_binmap_by_index(block->m_binmap_chunks_cached, config, cl1, cl2);
+                binmap_t*       free   = get_binmap_by_index(block->m_binmap_chunks_free, config, fl1, fl2);
+                while (block->m_count_chunks_cached > 0)
+                {
+                    u32 const ci = cached->findandset(config.m_chunks_max, cl1, cl2);
+                    batch.add(block_chunk_address(bi, ci, config), block->m_chunks_physical_pages[ci]);
+                    m_page_count_cached -= block->m_chunks_physical_pages[ci];
+                    block->m_chunks_physical_pages[ci] = 0;
+                    free->clr(config.m_chunks_max, fl1, fl2, ci);
+                    block->m_count_chunks_cached -= 1;
+                    block->m_count_chunks_free += 1;
+                }
+            }
+            batch.flush(false);
+            return pages - m_page_count_cached;
+        }
+
+        // Decommits (with 'batch') or commits pages inside a chunk that is in use, see superalloc_t::scavenge
+        void decommit_pages(chain_t const& chain, u32 page, u32 count, superbatch_t& batch)
+        {
+            xbyte* const address = (xbyte*)page_index_to_address(chunk_info_to_page_index(chain)) + ((u64)page << m_page_shift);
+            batch.add(address, count);
+            m_page_count -= count;
+        }
+
+        // Returns false when the xvmem fails, the pages are not counted then
+        bool commit_pages(chain_t const& chain, u32 page, u32 count)
+        {
+            xbyte* const address = (xbyte*)page_index_to_address(chunk_info_to_page_index(chain)) + ((u64)page << m_page_shift);
+            if (!m_vmem->commit(address, m_page_size, count))
+                return false;
+            m_page_count += count;
+            if (m_poison)
+                x_memset(address, 0xFEFEFEFE, (u64)count << m_page_shift);
+            return true;
+        }
+
+        // A single allocation chunk grows to 'pages' committed pages, its allocation grows in place. Returns false
+        // when the pages cannot be committed.
+        bool grow_chunk(chain_t const& chain, u32 pages)
+        {
+            block_t* block     = &m_blocks_array[chain.m_block_index];
+            u32 const committed = block->m_chunks_physical_pages[chain.m_block_chunk_index];
+            xbyte* const address = (xbyte*)page_index_to_address(chunk_info_to_page_index(chain)) + ((u64)committed << m_page_shift);
+            if (!m_limit->allows((u64)(pages - committed) << m_page_shift) || !m_vmem->commit(address, m_page_size, pages - committed))
+                return false;
+            m_page_count += pages - committed;
+            block->m_chunks_physical_pages[chain.m_block_chunk_index] = pages;
+            return true;
+        }
+
+        // The committed pages of the chunk were moved to another chunk (xvmem::remap), it is released without them
+        void set_chunk_moved(chain_t const& chain)
+        {
+            block_t* block = &m_blocks_array[chain.m_block_index];
+            m_page_count -= block->m_chunks_physical_pages[chain.m_block_chunk_index];
+            block->m_chunks_physical_pages[chain.m_block_chunk_index] = 0;
+        }
+
+        // All pages of the chunk have been decommitted, it is released without committed pages
+        void set_chunk_decommitted(chain_t const& chain)
+        {
+            block_t* block                                         = &m_blocks_array[chain.m_block_index];
+            block->m_chunks_physical_pages[chain.m_block_chunk_index] = 0;
         }
 
+        // The committed bytes of the chunks, including the cached chunks and the block array
+        u64 committed() const { return (u64)(m_page_count + m_page_count_cached + m_blocks_array_committed) << m_page_shift; }
+
         void set_assoc(void* ptr, u32 assoc, chain_t const& chain, superbin_t const& bin)
         {
             block_t* block = &m_blocks_array[chain.m_block_index];
-            u32 const chunk_tracking_array_index = block->m_m_chunks_alloc_tracking_array[chain.m_chunk_index];
-            u32* const chunk_tracking_arrays = m_fsa.idx2ptr(chunk_tracking_array_index);
-            u32* const chunk_tracking_array = fsa.idx2ptr(chunk_tracking_arrays);
-            
-            chunk_t* chunk = (chunk_t*)fsa.idx2ptr(chain.m_chunk_index);
-            ASSERT(chunk->m_bin_index == bin.m_alloc_bin_index);
+            u32 const chunk_tracking_array_index = block->m_chunks_alloc_tracking_array[chain.m_block_chunk_index];
+            u32* const chunk_tracking_array = (u32*)m_fsa->idx2ptr(chunk_tracking_array_index);
             u32 i = 0;
             if (bin.m_use_binmap == 1)
             {
-                void* const chunkaddress = page_index_to_address(chunk->m_page_index);
+                void* const chunkaddress = page_index_to_address(chunk_info_to_page_index(chain));
                 i = (u32)(todistance(chunkaddress, ptr) / bin.m_alloc_size);
             }
             chunk_tracking_array[i] = assoc;
@@ -696,21 +1505,22 @@ namespace xcore
         u32 get_assoc(void* ptr, chain_t const& chain, superbin_t const& bin) const
         {
             block_t* block = &m_blocks_array[chain.m_block_index];
-            u32 const chunk_tracking_array_index = block->m_m_chunks_alloc_tracking_array[chain.m_chunk_index];
-            u32* const chunk_tracking_arrays = m_fsa.idx2ptr(chunk_tracking_array_index);
-            u32* const chunk_tracking_array = fsa.idx2ptr(chunk_tracking_arrays);
-            
-            chunk_t* chunk = (chunk_t*)fsa.idx2ptr(chain.m_chunk_index);
-            ASSERT(chunk->m_bin_index == bin.m_alloc_bin_index);
+            u32 const chunk_tracking_array_index = block->m_chunks_alloc_tracking_array[chain.m_block_chunk_index];
+            u32* const chunk_tracking_array = (u32*)m_fsa->idx2ptr(chunk_tracking_array_index);
             u32 i = 0;
             if (bin.m_use_binmap == 1)
             {
-                void* const chunkaddress = page_index_to_address(chunk->m_page_index);
+                void* const chunkaddress = page_index_to_address(chunk_info_to_page_index(chain));
                 i = (u32)(todistance(chunkaddress, ptr) / bin.m_alloc_size);
             }
             return chunk_tracking_array[i];
         }
         
+        void* block_chunk_address(u32 block_index, u32 block_chunk_index, config_t const& config) const
+        {
+            return toaddress(m_address_base, ((u64)block_index << m_blocks_shift) + ((u64)block_chunk_index << config.m_chunks_shift));
+        }
+
         // When deallocating, call this to get the page-index which you can than use
         // to get the 'chunk_t*'.
         u32 chunk_info_to_page_index(chain_t const& chain) const
@@ -721,14 +1531,14 @@ namespace xcore
             return (u32)(address >> m_page_shift);
         }
         u32     address_to_page_index(void* ptr) const { return (u32)(todistance(m_address_base, ptr) >> m_page_shift); }
-        void*   page_index_to_address(u32 page_index) { return toaddress(m_address_base, (u64)page_index << m_page_shift); }
+        void*   page_index_to_address(u32 page_index) const { return toaddress(m_address_base, (u64)page_index << m_page_shift); }
         chain_t page_index_to_chunk_info(u32 page_index) const
         {
             u32 const page_index_to_block_index_shift       = (m_blocks_shift - m_page_shift);
             u32 const block_index                           = page_index >> page_index_to_block_index_shift;
             block_t*  block                                 = &m_blocks_array[block_index];
             u32 const block_page_index                      = page_index & ((1 << page_index_to_block_index_shift) - 1);
-            u32 const block_page_index_to_chunk_index_shift = (c_configs[block->m_config_index].m_chunks_shift - m_page_shift);
+            u32 const block_page_index_to_chunk_index_shift = (block->m_chunks_shift - m_page_shift);
             u32 const block_chunk_index                     = block_page_index >> block_page_index_to_chunk_index_shift;
             ASSERT(block_chunk_index < c_configs[block->m_config_index].m_chunks_max);
             u32 const chunk_index = block->m_chunks_array[block_chunk_index];
@@ -745,98 +1555,439 @@ namespace xcore
         superfsa_t* m_fsa;
         llhead_t    m_block_per_group_list_active[32];
         xvmem*      m_vmem;
+        superlimit_t const* m_limit;
         void*       m_address_base;
         u64         m_address_range;
-        u32         m_page_count;
+        u32         m_page_count;        // Committed pages of the chunks that are in use
+        u32         m_page_count_cached; // Committed pages of the cached chunks
         u32         m_page_size;
         u32         m_page_shift;   // e.g. 16 (1<<16 = 64 KB)
         s16         m_blocks_shift; // e.g. 25 (1<<30 =  1 GB)
+        bool        m_poison;
         block_t*    m_blocks_array;
+        u64         m_blocks_array_range;
+        u32         m_blocks_array_committed; // Committed pages of 'm_blocks_array'
+        u32         m_blocks_max;
+        u32         m_blocks_never_used;      // Blocks at and above this index have never been checked out
         lldata_t    m_blocks_list_data;
-        llist_t     m_blocks_list_free;
+        llhead_t    m_blocks_list_free;       // Released blocks, these are used before a never used block
+    };
+
+    inline bool superlimit_t::allows(u64 bytes) const
+    {
+        if (m_hard_limit == 0)
+            return true;
+        return (m_heap->committed() + m_fsa->committed() + m_chunks->committed() + bytes) <= m_hard_limit;
+    }
+
+    // The chunks of a bin that are neither empty nor full, a compact array of chunk indices that is partitioned by
+    // occupancy bucket, the emptiest bucket first. The last entry is always in the fullest bucket and moving a chunk
+    // to a neighbouring bucket is a single swap with the entry at the bucket boundary.
+    // Up to 'c_page_entries' chunks the array is a single fsa item, beyond that it is split in pages of that size
+    // that are found through a directory, so a bin can track millions of chunks.
+    struct superused_t
+    {
+        static const u32 c_buckets       = 4;
+        static const u32 c_capacity_min  = 16;
+        static const u32 c_page_shift    = 14;
+        static const u32 c_page_entries  = 1 << c_page_shift; // The largest array that the fsa can hand out (64 KB)
+        static const u32 c_directory_min = 4;
+
+        inline u32 count() const { return m_bucket_end[c_buckets - 1]; }
+        inline u32 bucket_begin(s32 bucket) const { return (bucket == 0) ? 0 : m_bucket_end[bucket - 1]; }
+
+        u32 m_array;                  // fsa index of the array or of the directory of pages, NIL when it has no capacity
+        u32 m_capacity;
+        u32 m_directory_capacity;     // The number of pages the directory can hold, 0 while 'm_array' is a single array
+        u32 m_bucket_end[c_buckets];  // bucket 'b' occupies [m_bucket_end[b - 1], m_bucket_end[b])
     };
 
     // @superalloc manages an address range, a list of chunks and a range of allocation sizes.
+    // Chunks that are neither empty nor full are kept per bin in a superused_t, bucketed by their occupancy.
+    // An allocation is taken from the fullest chunk so that the emptier chunks get the chance to drain and
+    // be released, this reduces the number of partially used chunks.
     struct superalloc_t
     {
-        superalloc_t(const superalloc_t& s, llhead_t* used_chunk_list_per_size)
+        static const u32 c_occupancy_buckets = superused_t::c_buckets;
+        static const u32 c_owners_max        = 127; // Thread-private chunks, the live threads beyond this use the shared chunks
+        static const u32 NIL                 = 0xffffffff;
+
+        superalloc_t(const superalloc_t& s, superused_t* used_chunks_per_size)
             : m_chunk_shift(s.m_chunk_shift)
             , m_chunks(nullptr)
-            , m_used_chunk_list_per_size(used_chunk_list_per_size)
+            , m_fsa(nullptr)
+            , m_used_chunks_per_size(used_chunks_per_size)
+            , m_owned_chunks(nullptr)
+            , m_num_bins(0)
+            , m_evacuate_chunk(NIL)
         {
         }
 
-        superalloc_t(u32 chunk_shift)
+        constexpr superalloc_t(u32 chunk_shift)
             : m_chunk_shift(chunk_shift)
             , m_chunks(nullptr)
-            , m_used_chunk_list_per_size(nullptr)
+            , m_fsa(nullptr)
+            , m_used_chunks_per_size(nullptr)
+            , m_owned_chunks(nullptr)
+            , m_num_bins(0)
+            , m_evacuate_chunk(NIL)
         {
         }
 
         void  initialize(superchunks_t* chunks, superheap_t& heap, superfsa_t& fsa);
-        void* allocate(superfsa_t& sfsa, u32 size, superbin_t const& bin);
+        void* allocate(superfsa_t& sfsa, u32 size, superbin_t const& bin, bool zero, u32 owner);
         u32   deallocate(superfsa_t& sfsa, void* ptr, superchunks_t::chain_t const& chain, superbin_t const& bin);
+        u32   compact(superfsa_t& sfsa, superbin_t const& bin, u32 occupancy_percentage, xvmem_compactor* compactor);
+        u32   prewarm(superfsa_t& sfsa, superbin_t const& bin, u32 count, bool prefault);
+        u32   unpin(superfsa_t& sfsa, superbin_t const& bin);
+        void  disown(superfsa_t& sfsa, superbin_t const& bin, u32 owner);
+        u32   scavenge(superfsa_t& sfsa, superbin_t const& bin);
 
         void  set_assoc(void* ptr, u32 assoc, superchunks_t::chain_t const& chain, superbin_t const& bin);
         u32   get_assoc(void* ptr, superchunks_t::chain_t const& chain, superbin_t const& bin) const;
 
-        void  initialize_chunk(superfsa_t& fsa, superchunks_t::chain_t const& chain, u32 size, superbin_t const& bin);
+        bool  initialize_chunk(superfsa_t& fsa, superchunks_t::chain_t const& chain, u32 size, superbin_t const& bin, u32 dirty_pages);
         void  deinitialize_chunk(superfsa_t& fsa, superchunks_t::chain_t const& chain, superbin_t const& bin);
-        void* allocate_from_chunk(superfsa_t& fsa, superchunks_t::chain_t const& chain, u32 size, superbin_t const& bin, bool& chunk_is_now_full);
+        void* allocate_from_chunk(superfsa_t& fsa, superchunks_t::chain_t const& chain, u32 size, superbin_t const& bin, bool& chunk_is_now_full, u64& dirty_size);
         u32   deallocate_from_chunk(superfsa_t& fsa, superchunks_t::chain_t const& chain, void* ptr, superbin_t const& bin, bool& chunk_is_now_empty, bool& chunk_was_full);
 
-        struct chunk_t : llnode_t
+        // Binmap chunks with more than 32 slots keep a LIFO stack of recently freed slot indices in front of the binmap,
+        // a slot on the stack keeps its bit set in the binmap, so the binmap only has to be searched when the stack is
+        // empty and the most recently freed (cache warm) slot is reused first.
+        static const u32 c_free_stack_size = 15;
+
+        // A chunk is one cache line (a 64 byte FSA item), the fields that allocation and deallocation touch come first.
+        // With the free stack and level 0 of the binmap (and level 1 up to 512 slots) inline most operations only
+        // touch this line, the associated values are in a parallel array of the block (see superchunks_t).
+        struct chunk_t
         {
-            u32 m_page_index;
             u16 m_elem_used;
             u16 m_bin_index;
+            u32 m_elem_hwm : 24; // Binmap: slots at or above this index were never handed out, otherwise the number of pages that hold old data
+            u32 m_pinned : 1;    // Checked out by 'prewarm', the chunk is kept when it becomes empty
+            u32 m_owner : 7;     // The thread that is filling this chunk [1, c_owners_max], 0 when it is shared
+            u32 m_page_index;
+            struct pages_t
+            {
+                u32 m_physical_pages;
+                u32 m_color; // Offset of the allocation in the chunk, see cache coloring
+            };
             union occupancy_t
             {
                 binmap_t m_binmap;
-                u32      m_physical_pages;
+                pages_t  m_pages;
             };
             occupancy_t m_occupancy;
-            u32        m_alloc_tracking;
+            u16         m_free_count; // The number of slots on the free stack
+            u16         m_free_stack[c_free_stack_size];
+            u32         m_used_pos;  // The position in the used array of the bin, NIL when not in it
+            u32         m_extension; // FSA index of the page counters, NIL when the chunk has none
         };
+        static_assert(sizeof(chunk_t) == 64, "chunk_t is one cache line, a 64 byte FSA item");
+
+        // Binmap chunks of more than one page have an extension, an array of u16 in the FSA that counts per page the
+        // slots that overlap it and are set in the binmap, 'scavenge' decommits the pages where this is 0.
+        //   [0]                              the number of decommitted pages
+        //   [c_page_counters_base, + pages)  the page counters, with c_page_decommitted for a decommitted page
+        static const u32 c_page_counters_base = 1;
+        static const u16 c_page_decommitted   = 0x8000;
+
+        // Returns true when slot 'i' is on the free stack of the chunk, the binmap reports these slots as used
+        static inline bool is_on_free_stack(chunk_t const* chunk, u32 i)
+        {
+            for (u32 s = 0; s < chunk->m_free_count; ++s)
+            {
+                if (chunk->m_free_stack[s] == i)
+                    return true;
+            }
+            return false;
+        }
+
+        // The number of pages of a binmap chunk and the pages that slot 'i' overlaps
+        inline u32 chunk_pages(superbin_t const& bin) const { return m_chunks->chunk_physical_pages(bin, bin.m_alloc_size); }
+
+        // The bytes in the internal FSA of a chunk of 'bin': the chunk, its associated values, binmap and extension, its
+        // entry in the used array and its part of the arrays of the block. The FSA range is sized with this.
+        static u32 bookkeeping_size(superbin_t const& bin, u32 page_shift)
+        {
+            u32 size = superfsa_t::allocsizeof(sizeof(chunk_t)) + superfsa_t::allocsizeof(sizeof(u32) * bin.m_alloc_count) + (4 * sizeof(u32));
+            if (bin.m_use_binmap == 1)
+            {
+                if (bin.m_alloc_count > 32)
+                {
+                    size += superfsa_t::allocsizeof(sizeof(u16) * bin.m_binmap_l2len);
+                    if (bin.m_binmap_l1len > 2)
+                        size += superfsa_t::allocsizeof(sizeof(u16) * bin.m_binmap_l1len);
+                }
+                u32 const pages = (u32)((((u64)bin.m_alloc_count * bin.m_alloc_size) + ((u64)1 << page_shift) - 1) >> page_shift);
+                if (pages > 1)
+                    size += superfsa_t::allocsizeof(sizeof(u16) * (c_page_counters_base + pages));
+            }
+            return size;
+        }
+        inline u32 slot_first_page(superbin_t const& bin, u32 i) const { return (u32)(((u64)i * bin.m_alloc_size) >> m_chunks->m_page_shift); }
+        inline u32 slot_last_page(superbin_t const& bin, u32 i) const { return (u32)((((u64)i + 1) * bin.m_alloc_size - 1) >> m_chunks->m_page_shift); }
+
+        bool count_slot(superchunks_t::chain_t const& chain, superbin_t const& bin, u16* extension, u32 i);
+        void uncount_slot(superbin_t const& bin, u16* extension, u32 i);
+        u32  find_committed_slot(binmap_t const* bm, u16 const* l1, u16 const* l2, superbin_t const& bin, u16 const* pages) const;
+
+        inline binmap_t* get_chunk_binmap(superfsa_t& fsa, chunk_t* chunk, superbin_t const& bin, u16*& l1, u16*& l2) const
+        {
+            binmap_t* bm = (binmap_t*)&chunk->m_occupancy.m_binmap;
+            l1           = nullptr;
+            l2           = nullptr;
+            if (bin.m_alloc_count > 32)
+            {
+                l1 = (bin.m_binmap_l1len > 2) ? (u16*)fsa.idx2ptr(bm->m_l1_offset) : (u16*)&bm->m_l1_offset;
+                l2 = (u16*)fsa.idx2ptr(bm->m_l2_offset);
+            }
+            return bm;
+        }
+
+        // The bucket of a chunk that is neither empty nor full, [0, c_occupancy_buckets)
+        inline s32 occupancy_bucket(u32 elem_used, superbin_t const& bin) const { return (s32)((elem_used * c_occupancy_buckets) / bin.m_alloc_count); }
+
+        inline u32* used_entry(superused_t const& used, u32 pos) const
+        {
+            if (used.m_directory_capacity == 0)
+                return (u32*)m_fsa->idx2ptr(used.m_array) + pos;
+            u32 const* const pages = (u32 const*)m_fsa->idx2ptr(used.m_array);
+            return (u32*)m_fsa->idx2ptr(pages[pos >> superused_t::c_page_shift]) + (pos & (superused_t::c_page_entries - 1));
+        }
+        inline u32 used_last(u32 bin_index) const
+        {
+            superused_t const& used = m_used_chunks_per_size[bin_index];
+            return *used_entry(used, used.count() - 1);
+        }
+
+        bool used_grow(superused_t& used);
+        bool used_insert(u32 bin_index, s32 bucket, u32 chunk_index);
+        void used_remove(u32 bin_index, s32 bucket, u32 chunk_index);
+        void used_move(u32 bin_index, s32 from, s32 to, u32 chunk_index);
+        void used_swap(superused_t const& used, u32 pos_a, u32 pos_b);
+
+        inline u32* owned_chunk(u32 owner, u32 bin_index) const { return &m_owned_chunks[(owner - 1) * m_num_bins + bin_index]; }
+
+        // True when the next allocation of 'bin' checks out a new chunk
+        inline bool needs_chunk(superbin_t const& bin, u32 owner) const
+        {
+            if (owner != 0 && *owned_chunk(owner, bin.m_alloc_bin_index) != NIL)
+                return false;
+            return m_used_chunks_per_size[bin.m_alloc_bin_index].count() == 0;
+        }
 
         u32            m_chunk_shift;
         superchunks_t* m_chunks;
-        lldata_t       m_chunk_list_data;
-        llhead_t*      m_used_chunk_list_per_size;
+        superfsa_t*    m_fsa;
+        superused_t*   m_used_chunks_per_size; // [bin]
+        u32*           m_owned_chunks;         // [owner - 1][bin], the chunk that a thread is filling, nullptr when chunks are shared
+        u32            m_num_bins;
+        u32            m_evacuate_chunk;       // The chunk that is being drained by 'compact', it is not part of any bucket
     };
 
     void superalloc_t::initialize(superchunks_t* chunks, superheap_t& heap, superfsa_t& fsa)
     {
-        m_chunk_list_data.m_data     = fsa.baseptr();
-        m_chunk_list_data.m_itemsize = fsa.allocsizeof(sizeof(chunk_t));
-        m_chunk_list_data.m_pagesize = fsa.pagesize();
-        m_chunks                     = chunks;
+        m_chunks = chunks;
+        m_fsa    = &fsa;
+    }
+
+    void superalloc_t::used_swap(superused_t const& used, u32 pos_a, u32 pos_b)
+    {
+        if (pos_a == pos_b)
+            return;
+        u32* const entry_a                        = used_entry(used, pos_a);
+        u32* const entry_b                        = used_entry(used, pos_b);
+        u32 const  a                              = *entry_a;
+        u32 const  b                              = *entry_b;
+        *entry_a                                  = b;
+        *entry_b                                  = a;
+        ((chunk_t*)m_fsa->idx2ptr(a))->m_used_pos = pos_b;
+        ((chunk_t*)m_fsa->idx2ptr(b))->m_used_pos = pos_a;
+    }
+
+    // Doubles the single array until it is a page, then adds a page at a time and doubles the directory when it is
+    // full. Returns false when the directory is at its maximum, that is 2^28 chunks, or when the fsa cannot commit.
+    bool superalloc_t::used_grow(superused_t& used)
+    {
+        if (used.m_capacity < superused_t::c_page_entries)
+        {
+            u32 const capacity = (used.m_capacity == 0) ? superused_t::c_capacity_min : (used.m_capacity * 2);
+            u32 const array    = m_fsa->alloc(sizeof(u32) * capacity);
+            if (array == superfsa_t::NIL)
+                return false;
+            if (used.m_capacity > 0)
+            {
+                x_memcpy(m_fsa->idx2ptr(array), m_fsa->idx2ptr(used.m_array), sizeof(u32) * used.count());
+                m_fsa->dealloc(used.m_array);
+            }
+            used.m_array    = array;
+            used.m_capacity = capacity;
+            return true;
+        }
+
+        u32 const num_pages = used.m_capacity >> superused_t::c_page_shift;
+        if (num_pages == used.m_directory_capacity || used.m_directory_capacity == 0)
+        {
+            ASSERT(num_pages < superused_t::c_page_entries); // 2^28 partially used chunks in one bin
+            if (num_pages == superused_t::c_page_entries)
+                return false;
+            u32 const capacity  = (used.m_directory_capacity == 0) ? superused_t::c_directory_min : (used.m_directory_capacity * 2);
+            u32 const directory = m_fsa->alloc(sizeof(u32) * capacity);
+            if (directory == superfsa_t::NIL)
+                return false;
+            if (used.m_directory_capacity == 0)
+            {
+                *(u32*)m_fsa->idx2ptr(directory) = used.m_array; // The single array becomes the first page
+            }
+            else
+            {
+                x_memcpy(m_fsa->idx2ptr(directory), m_fsa->idx2ptr(used.m_array), sizeof(u32) * num_pages);
+                m_fsa->dealloc(used.m_array);
+            }
+            used.m_array              = directory;
+            used.m_directory_capacity = capacity;
+        }
+        u32 const page = m_fsa->alloc(sizeof(u32) * superused_t::c_page_entries);
+        if (page == superfsa_t::NIL)
+            return false;
+        u32* const pages = (u32*)m_fsa->idx2ptr(used.m_array);
+        pages[num_pages] = page;
+        used.m_capacity += superused_t::c_page_entries;
+        return true;
+    }
+
+    // Appends the chunk to the fullest bucket and swaps it down to 'bucket', at most one swap per bucket. Returns
+    // false when the array cannot grow, the chunk is then not tracked until its next deallocation.
+    bool superalloc_t::used_insert(u32 bin_index, s32 bucket, u32 chunk_index)
+    {
+        superused_t& used = m_used_chunks_per_size[bin_index];
+        if (used.count() == used.m_capacity && !used_grow(used))
+            return false;
+
+        u32 pos                                             = used.count();
+        *used_entry(used, pos)                              = chunk_index;
+        ((chunk_t*)m_fsa->idx2ptr(chunk_index))->m_used_pos = pos;
+        used.m_bucket_end[c_occupancy_buckets - 1] += 1;
+        for (s32 b = c_occupancy_buckets - 1; b > bucket; --b)
+        {
+            // Swap with the first entry of bucket 'b', which then becomes the last entry of bucket 'b - 1'
+            u32 const first = used.m_bucket_end[b - 1];
+            used_swap(used, pos, first);
+            pos = first;
+            used.m_bucket_end[b - 1] += 1;
+        }
+        return true;
+    }
+
+    void superalloc_t::used_remove(u32 bin_index, s32 bucket, u32 chunk_index)
+    {
+        superused_t& used  = m_used_chunks_per_size[bin_index];
+        chunk_t*     chunk = (chunk_t*)m_fsa->idx2ptr(chunk_index);
+        ASSERT(chunk->m_used_pos < used.count() && *used_entry(used, chunk->m_used_pos) == chunk_index);
+        for (s32 b = bucket; b < (s32)c_occupancy_buckets; ++b)
+        {
+            // Swap with the last entry of bucket 'b' and shrink it, the chunk is then the first entry of bucket 'b + 1'
+            u32 const last = used.m_bucket_end[b] - 1;
+            used_swap(used, chunk->m_used_pos, last);
+            used.m_bucket_end[b] -= 1;
+        }
+        chunk->m_used_pos = NIL;
+    }
+
+    void superalloc_t::used_move(u32 bin_index, s32 from, s32 to, u32 chunk_index)
+    {
+        superused_t& used  = m_used_chunks_per_size[bin_index];
+        chunk_t*     chunk = (chunk_t*)m_fsa->idx2ptr(chunk_index);
+        for (; from < to; ++from)
+        {
+            used_swap(used, chunk->m_used_pos, used.m_bucket_end[from] - 1);
+            used.m_bucket_end[from] -= 1;
+        }
+        for (; from > to; --from)
+        {
+            used_swap(used, chunk->m_used_pos, used.m_bucket_end[from - 1]);
+            used.m_bucket_end[from - 1] += 1;
+        }
     }
 
-    void* superalloc_t::allocate(superfsa_t& sfsa, u32 alloc_size, superbin_t const& bin)
+    // With 'zero' the allocation is returned zeroed, only the memory that may hold old data is cleared. With an
+    // 'owner' the allocation comes from the chunk that this thread is filling, such a chunk is taken out of the
+    // buckets until it is full so that no other thread receives slots from it (no false sharing of cache lines).
+    void* superalloc_t::allocate(superfsa_t& sfsa, u32 alloc_size, superbin_t const& bin, bool zero, u32 owner)
     {
-        u32 const              c = bin.m_alloc_bin_index;
+        u32 const              c     = bin.m_alloc_bin_index;
+        u32* const             owned = (owner != 0) ? owned_chunk(owner, c) : nullptr;
         superchunks_t::chain_t chain;
-        llindex_t              chunk_index = m_used_chunk_list_per_size[c].m_index;
-        if (chunk_index == llnode_t::NIL)
+        u32                    chunk_index;
+        s32                    bucket = -1;
+        if (owned != nullptr && *owned != NIL)
         {
+            chunk_index = *owned;
+            chain       = m_chunks->page_index_to_chunk_info(((chunk_t*)sfsa.idx2ptr(chunk_index))->m_page_index);
+        }
+        else if (m_used_chunks_per_size[c].count() == 0)
+        {
+            u32 dirty_pages;
             chunk_index = sfsa.alloc(sizeof(chunk_t));
-            chain       = m_chunks->checkout_chunk(m_chunk_shift, alloc_size, chunk_index, bin);
-            initialize_chunk(sfsa, chain, alloc_size, bin);
-            m_used_chunk_list_per_size[c].insert(m_chunk_list_data, chunk_index);
+            if (chunk_index == superfsa_t::NIL)
+                return nullptr;
+            if (!m_chunks->checkout_chunk(m_chunk_shift, alloc_size, chunk_index, bin, chain, dirty_pages))
+            {
+                sfsa.dealloc(chunk_index);
+                return nullptr;
+            }
+            if (!initialize_chunk(sfsa, chain, alloc_size, bin, dirty_pages))
+            {
+                m_chunks->release_chunk(chain, alloc_size);
+                return nullptr;
+            }
         }
         else
         {
+            // Take from the fullest partially used chunk
+            chunk_index          = used_last(c);
             chunk_t*  chunk      = (chunk_t*)sfsa.idx2ptr(chunk_index);
             u32 const page_index = chunk->m_page_index;
+            bucket               = occupancy_bucket(chunk->m_elem_used, bin);
             chain                = m_chunks->page_index_to_chunk_info(page_index);
         }
 
+        if (owned != nullptr && *owned == NIL)
+        {
+            if (bucket >= 0)
+                used_remove(c, bucket, chunk_index);
+            bucket                                            = -1;
+            *owned                                            = chunk_index;
+            ((chunk_t*)sfsa.idx2ptr(chunk_index))->m_owner = owner;
+        }
+
         bool        chunk_is_now_full = false;
-        void* const ptr               = allocate_from_chunk(sfsa, chain, alloc_size, bin, chunk_is_now_full);
+        u64         dirty_size        = 0;
+        void* const ptr               = allocate_from_chunk(sfsa, chain, alloc_size, bin, chunk_is_now_full, dirty_size);
+        if (ptr == nullptr)
+            return nullptr;
+        if (zero && dirty_size > 0)
+            x_memset(ptr, 0, dirty_size);
         if (chunk_is_now_full) // Chunk is full, no more allocations possible
         {
-            m_used_chunk_list_per_size[c].remove_item(m_chunk_list_data, chunk_index);
+            if (bucket >= 0)
+                used_remove(c, bucket, chunk_index);
+            if (owned != nullptr)
+            {
+                // A full chunk is shared again, it returns to the buckets on its next deallocation
+                *owned                                            = NIL;
+                ((chunk_t*)sfsa.idx2ptr(chunk_index))->m_owner = 0;
+            }
+        }
+        else if (owned == nullptr)
+        {
+            chunk_t*  chunk      = (chunk_t*)sfsa.idx2ptr(chunk_index);
+            s32 const new_bucket = occupancy_bucket(chunk->m_elem_used, bin);
+            if (bucket < 0)
+                used_insert(c, new_bucket, chunk_index);
+            else if (new_bucket != bucket)
+                used_move(c, bucket, new_bucket, chunk_index);
         }
         return ptr;
     }
@@ -847,24 +1998,215 @@ namespace xcore
         bool      chunk_is_now_empty = false;
         bool      chunk_was_full     = false;
         u32 const alloc_size         = deallocate_from_chunk(fsa, chain, ptr, bin, chunk_is_now_empty, chunk_was_full);
-        if (chunk_is_now_empty)
+        chunk_t*  chunk              = (chunk_t*)fsa.idx2ptr(chain.m_chunk_index);
+        if (chain.m_chunk_index == m_evacuate_chunk)
+        {
+            // This chunk is not part of any bucket, 'compact' will put it back
+            if (chunk_is_now_empty)
+            {
+                m_evacuate_chunk = NIL;
+                deinitialize_chunk(fsa, chain, bin);
+                m_chunks->release_chunk(chain, alloc_size);
+            }
+            return alloc_size;
+        }
+
+        if (chunk->m_owner != 0)
         {
-            if (!chunk_was_full)
+            // The chunk is being filled by a thread, it is not part of any bucket
+            if (chunk_is_now_empty && chunk->m_pinned == 0)
             {
-                chunk_t* chunk = (chunk_t*)fsa.idx2ptr(chain.m_chunk_index);
-                m_used_chunk_list_per_size[c].remove_item(m_chunk_list_data, chain.m_chunk_index);
+                *owned_chunk(chunk->m_owner, c) = NIL;
+                deinitialize_chunk(fsa, chain, bin);
+                m_chunks->release_chunk(chain, alloc_size);
             }
+            return alloc_size;
+        }
+
+        // A full chunk, or one that did not fit in the used array, is not in any bucket
+        s32 const bucket = (chunk->m_used_pos == NIL) ? -1 : occupancy_bucket(chunk->m_elem_used + 1, bin);
+        if (chunk_is_now_empty && chunk->m_pinned == 0)
+        {
+            if (bucket >= 0)
+                used_remove(c, bucket, chain.m_chunk_index);
             deinitialize_chunk(fsa, chain, bin);
             m_chunks->release_chunk(chain, alloc_size);
         }
-        else if (chunk_was_full)
+        else
         {
-            chunk_t* chunk = (chunk_t*)fsa.idx2ptr(chain.m_chunk_index);
-            m_used_chunk_list_per_size[c].insert(m_chunk_list_data, chain.m_chunk_index);
+            s32 const new_bucket = occupancy_bucket(chunk->m_elem_used, bin);
+            if (bucket < 0)
+                used_insert(c, new_bucket, chain.m_chunk_index);
+            else if (new_bucket != bucket)
+                used_move(c, bucket, new_bucket, chain.m_chunk_index);
         }
         return alloc_size;
     }
 
+    u32 superalloc_t::compact(superfsa_t& sfsa, superbin_t const& bin, u32 occupancy_percentage, xvmem_compactor* compactor)
+    {
+        u32 const    c    = bin.m_alloc_bin_index;
+        superused_t& used = m_used_chunks_per_size[c];
+        if (bin.m_use_binmap == 0 || used.count() == 0)
+            return 0;
+
+        // Take a snapshot of the candidates, the emptiest bucket first, their allocations move to the fuller
+        // chunks. Evacuating a chunk reorders the used array so we cannot iterate it directly.
+        u32 const snapshot   = sfsa.alloc(sizeof(u32) * used.count());
+        if (snapshot == superfsa_t::NIL)
+            return 0;
+        u32*      candidate  = (u32*)sfsa.idx2ptr(snapshot);
+        u32       candidates = 0;
+        for (u32 i = 0; i < used.count(); ++i)
+        {
+            u32 const      chunk_index = *used_entry(used, i);
+            chunk_t const* chunk       = (chunk_t const*)sfsa.idx2ptr(chunk_index);
+            if ((chunk->m_elem_used * 100) < (occupancy_percentage * bin.m_alloc_count))
+                candidate[candidates++] = chunk_index;
+        }
+
+        u32 released = 0;
+        for (u32 i = 0; i < candidates; ++i)
+        {
+            u32 const chunk_index = candidate[i];
+            chunk_t*  chunk       = (chunk_t*)sfsa.idx2ptr(chunk_index);
+            if (chunk->m_used_pos == NIL || (chunk->m_elem_used * 100) >= (occupancy_percentage * bin.m_alloc_count))
+                continue;
+
+            // Without any other partially used chunk the allocations would just move to a new chunk
+            s32 const bucket = occupancy_bucket(chunk->m_elem_used, bin);
+            used_remove(c, bucket, chunk_index);
+            if (used.count() == 0)
+            {
+                used_insert(c, bucket, chunk_index);
+                break;
+            }
+            if (chunk->m_pinned == 1 || !compactor->chunk(bin.m_alloc_size, chunk->m_elem_used, bin.m_alloc_count))
+            {
+                used_insert(c, bucket, chunk_index);
+                continue;
+            }
+
+            m_evacuate_chunk = chunk_index;
+            void* const chunk_address = m_chunks->page_index_to_address(chunk->m_page_index);
+            u16 *       l1, *l2;
+            binmap_t*   bm = get_chunk_binmap(sfsa, chunk, bin, l1, l2);
+            for (s32 e = bm->next(bin.m_alloc_count, l2, 0); e >= 0; e = bm->next(bin.m_alloc_count, l2, e + 1))
+            {
+                if (is_on_free_stack(chunk, e))
+                    continue;
+                compactor->relocate(toaddress(chunk_address, (u64)e * bin.m_alloc_size), bin.m_alloc_size);
+                if (m_evacuate_chunk == NIL)
+                    break;
+            }
+
+            if (m_evacuate_chunk == NIL)
+            {
+                released += 1;
+            }
+            else
+            {
+                m_evacuate_chunk = NIL;
+                used_insert(c, occupancy_bucket(chunk->m_elem_used, bin), chunk_index);
+            }
+        }
+        sfsa.dealloc(snapshot);
+        return released;
+    }
+
+    // Checks out and commits the chunks for 'count' allocations up front, they are pinned and put at the front of
+    // the emptiest bucket so that partially used chunks are still preferred. Returns the number of chunks, fewer at
+    // the hard limit.
+    u32 superalloc_t::prewarm(superfsa_t& sfsa, superbin_t const& bin, u32 count, bool prefault)
+    {
+        u32 const c          = bin.m_alloc_bin_index;
+        u32 const num_chunks = (count + bin.m_alloc_count - 1) / bin.m_alloc_count;
+        for (u32 i = 0; i < num_chunks; ++i)
+        {
+            u32                    dirty_pages;
+            superchunks_t::chain_t chain;
+            u32 const              chunk_index = sfsa.alloc(sizeof(chunk_t));
+            if (chunk_index == superfsa_t::NIL)
+                return i;
+            if (!m_chunks->checkout_chunk(m_chunk_shift, bin.m_alloc_size, chunk_index, bin, chain, dirty_pages))
+            {
+                sfsa.dealloc(chunk_index);
+                return i;
+            }
+            if (!initialize_chunk(sfsa, chain, bin.m_alloc_size, bin, dirty_pages))
+            {
+                m_chunks->release_chunk(chain, bin.m_alloc_size);
+                return i;
+            }
+
+            chunk_t* chunk  = (chunk_t*)sfsa.idx2ptr(chunk_index);
+            chunk->m_pinned = 1;
+            if (prefault)
+            {
+                u32 const pages = m_chunks->chunk_physical_pages(bin, bin.m_alloc_size);
+                m_chunks->m_vmem->prefault(m_chunks->page_index_to_address(chunk->m_page_index), m_chunks->m_page_size, pages);
+            }
+            // Move it to the front of the array, partially used chunks at the end of bucket 0 are preferred
+            if (used_insert(c, 0, chunk_index))
+                used_swap(m_used_chunks_per_size[c], chunk->m_used_pos, 0);
+        }
+        return num_chunks;
+    }
+
+    // Unpins the chunks of this bin, the ones that are empty are released. Returns the number of released chunks.
+    u32 superalloc_t::unpin(superfsa_t& sfsa, superbin_t const& bin)
+    {
+        u32 const c            = bin.m_alloc_bin_index;
+        u32 const config_index = m_chunk_shift - 16;
+        u32       released     = 0;
+        for (u32 bi = 0; bi < m_chunks->m_blocks_never_used; ++bi)
+        {
+            superchunks_t::block_t* block = m_chunks->get_block_from_index(bi);
+            if (block->m_chunks_used == 0 || block->m_config_index != config_index)
+                continue;
+
+            u32 const chunks_max = m_chunks->c_configs[config_index].m_chunks_max;
+            for (u32 ci = 0; ci < chunks_max && block->m_chunks_used > 0; ++ci)
+            {
+                llindex_t const chunk_index = block->m_chunks_array[ci];
+                if (chunk_index == 0xffffffff)
+                    continue;
+                chunk_t* chunk = (chunk_t*)sfsa.idx2ptr(chunk_index);
+                if (chunk->m_bin_index != c || chunk->m_pinned == 0)
+                    continue;
+
+                chunk->m_pinned = 0;
+                if (chunk->m_elem_used == 0)
+                {
+                    // The block is released together with its last chunk
+                    superchunks_t::chain_t const chain = m_chunks->page_index_to_chunk_info(chunk->m_page_index);
+                    if (chunk->m_used_pos != NIL)
+                        used_remove(c, 0, chunk_index);
+                    if (chunk->m_owner != 0)
+                        *owned_chunk(chunk->m_owner, c) = NIL;
+                    deinitialize_chunk(sfsa, chain, bin);
+                    m_chunks->release_chunk(chain, bin.m_alloc_size);
+                    released += 1;
+                }
+            }
+        }
+        return released;
+    }
+
+    // Returns the chunk that 'owner' is filling to the buckets, e.g. when the thread exits
+    void superalloc_t::disown(superfsa_t& sfsa, superbin_t const& bin, u32 owner)
+    {
+        u32 const  c     = bin.m_alloc_bin_index;
+        u32* const owned = owned_chunk(owner, c);
+        if (*owned == NIL)
+            return;
+        u32 const chunk_index = *owned;
+        chunk_t*  chunk       = (chunk_t*)sfsa.idx2ptr(chunk_index);
+        *owned                = NIL;
+        chunk->m_owner        = 0;
+        used_insert(c, occupancy_bucket(chunk->m_elem_used, bin), chunk_index); // Only a pinned chunk can be empty
+    }
+
     void  superalloc_t::set_assoc(void* ptr, u32 assoc, superchunks_t::chain_t const& chain, superbin_t const& bin)
     {
         m_chunks->set_assoc(ptr, assoc, chain, bin);
@@ -875,23 +2217,46 @@ namespace xcore
         return m_chunks->get_assoc(ptr, chain, bin);
     }
 
-    void superalloc_t::initialize_chunk(superfsa_t& fsa, superchunks_t::chain_t const& info, u32 alloc_size, superbin_t const& bin)
+    // Returns false when the binmap or the page counters cannot be allocated, the chunk is then released by the caller
+    bool superalloc_t::initialize_chunk(superfsa_t& fsa, superchunks_t::chain_t const& info, u32 alloc_size, superbin_t const& bin, u32 dirty_pages)
     {
         chunk_t* chunk      = (chunk_t*)fsa.idx2ptr(info.m_chunk_index);
         chunk->m_page_index = m_chunks->chunk_info_to_page_index(info);
+        chunk->m_used_pos   = NIL;
+        chunk->m_elem_hwm   = 0;
+        chunk->m_pinned     = 0;
+        chunk->m_owner      = 0;
+        chunk->m_extension  = superfsa_t::NIL;
+        chunk->m_free_count = 0;
         if (bin.m_use_binmap == 1)
         {
+            // The items of the fsa are allocated first, nothing is initialized when one of them fails
+            bool const has_l2  = bin.m_alloc_count > 32;
+            bool const has_l1  = has_l2 && bin.m_binmap_l1len > 2;
+            u32 const  pages   = chunk_pages(bin);
+            u32 const  length  = c_page_counters_base + pages;
+            u32 const  l2index = has_l2 ? fsa.alloc(sizeof(u16) * bin.m_binmap_l2len) : superfsa_t::NIL;
+            u32 const  l1index = has_l1 ? fsa.alloc(sizeof(u16) * bin.m_binmap_l1len) : superfsa_t::NIL;
+            u32 const  pindex  = (pages > 1) ? fsa.alloc(sizeof(u16) * length) : superfsa_t::NIL;
+            if ((has_l2 && l2index == superfsa_t::NIL) || (has_l1 && l1index == superfsa_t::NIL) || (pages > 1 && pindex == superfsa_t::NIL))
+            {
+                fsa.dealloc(l2index);
+                fsa.dealloc(l1index);
+                fsa.dealloc(pindex);
+                return false;
+            }
+
             binmap_t* binmap = (binmap_t*)&chunk->m_occupancy.m_binmap;
-            if (bin.m_alloc_count > 32)
+            if (has_l2)
             {
-				u16* l2;
-				binmap->m_l2_offset = fsa.alloc(sizeof(u16) * bin.m_binmap_l2len);
-				l2 = (u16*)fsa.idx2ptr(binmap->m_l2_offset);
+				binmap->m_l2_offset = l2index;
+				u16* l2 = (u16*)fsa.idx2ptr(binmap->m_l2_offset);
 
+				// A level 1 of at most 2 words is stored in 'm_l1_offset' itself
 				u16* l1;
-				if (bin.m_binmap_l1len > 2)
+				if (has_l1)
 				{
-					binmap->m_l1_offset = fsa.alloc(sizeof(u16) * bin.m_binmap_l1len);
+					binmap->m_l1_offset = l1index;
 					l1 = (u16*)fsa.idx2ptr(binmap->m_l1_offset);
 				}
 				else 
@@ -907,14 +2272,27 @@ namespace xcore
                 binmap->m_l2_offset = superfsa_t::NIL;
                 binmap->init(bin.m_alloc_count, nullptr, 0, nullptr, 0);
             }
+
+            if (pages > 1)
+            {
+                chunk->m_extension = pindex;
+                x_memset(fsa.idx2ptr(chunk->m_extension), 0, sizeof(u16) * length);
+            }
+
+            // Every slot that overlaps a reused page may hold old data
+            u64 const dirty_slots = (((u64)dirty_pages << m_chunks->m_page_shift) + bin.m_alloc_size - 1) / bin.m_alloc_size;
+            chunk->m_elem_hwm     = (dirty_slots < bin.m_alloc_count) ? (u32)dirty_slots : bin.m_alloc_count;
         }
         else
         {
-            chunk->m_occupancy.m_physical_pages = 0;
+            chunk->m_occupancy.m_pages.m_physical_pages = 0;
+            chunk->m_occupancy.m_pages.m_color          = 0;
+            chunk->m_elem_hwm                   = dirty_pages;
         }
 
         chunk->m_bin_index = bin.m_alloc_bin_index;
         chunk->m_elem_used = 0;
+        return true;
     }
 
     void superalloc_t::deinitialize_chunk(superfsa_t& fsa, superchunks_t::chain_t const& info, superbin_t const& bin)
@@ -923,17 +2301,47 @@ namespace xcore
         if (bin.m_use_binmap == 1)
         {
             binmap_t* bm = (binmap_t*)&chunk->m_occupancy.m_binmap;
-            if (bm->m_l1_offset != superfsa_t::NIL)
+            if (bin.m_alloc_count > 32)
             {
-                fsa.dealloc(bm->m_l1_offset);
+                if (bin.m_binmap_l1len > 2)
+                    fsa.dealloc(bm->m_l1_offset);
                 fsa.dealloc(bm->m_l2_offset);
             }
+            if (chunk->m_extension != superfsa_t::NIL)
+            {
+                // A chunk with decommitted pages is decommitted completely, it is cached without committed pages
+                u16 const* extension = (u16 const*)fsa.idx2ptr(chunk->m_extension);
+                if (extension[0] > 0)
+                {
+                    // The runs are separated by decommitted pages, they are decommitted as one range
+                    superbatch_t batch(m_chunks->m_vmem, m_chunks->m_page_size, false, true);
+                    u16 const*   pages = extension + c_page_counters_base;
+                    u32 const    count = chunk_pages(bin);
+                    for (u32 p = 0; p < count;)
+                    {
+                        u32 n = 0;
+                        while ((p + n) < count && (pages[p + n] & c_page_decommitted) == 0)
+                            n += 1;
+                        if (n > 0)
+                            m_chunks->decommit_pages(info, p, n, batch);
+                        p += n + 1;
+                    }
+                    batch.flush(false);
+                    m_chunks->set_chunk_decommitted(info);
+                }
+                fsa.dealloc(chunk->m_extension);
+            }
             chunk->m_occupancy.m_binmap.m_l1_offset = superfsa_t::NIL;
             chunk->m_occupancy.m_binmap.m_l2_offset = superfsa_t::NIL;
+            chunk->m_extension                     = superfsa_t::NIL;
         }
     }
 
-    void* superalloc_t::allocate_from_chunk(superfsa_t& fsa, superchunks_t::chain_t const& chain, u32 size, superbin_t const& bin, bool& chunk_is_now_full)
+    // 'dirty_size' returns the number of bytes at the start of the allocation that may hold old data, the rest was
+    // never handed out since it was committed. A binmap always hands out the lowest free slot, so a slot at or above
+    // the high-water mark has never been used. A slot from the free stack was handed out before, it is always dirty.
+    // Returns nullptr when the decommitted pages of the slot cannot be committed again.
+    void* superalloc_t::allocate_from_chunk(superfsa_t& fsa, superchunks_t::chain_t const& chain, u32 size, superbin_t const& bin, bool& chunk_is_now_full, u64& dirty_size)
     {
         chunk_t* chunk = (chunk_t*)fsa.idx2ptr(chain.m_chunk_index);
         ASSERT(chunk->m_bin_index == bin.m_alloc_bin_index);
@@ -941,21 +2349,48 @@ namespace xcore
         void* ptr = m_chunks->page_index_to_address(chunk->m_page_index);
         if (bin.m_use_binmap == 1)
         {
-            binmap_t* bm = (binmap_t*)&chunk->m_occupancy.m_binmap;
-            u16*      l1 = nullptr;
-            u16*      l2 = nullptr;
-            if (bin.m_alloc_count > 32)
+            u32  i;
+            if (chunk->m_free_count > 0)
             {
-                l1 = (u16*)fsa.idx2ptr(bm->m_l1_offset);
-                l2 = (u16*)fsa.idx2ptr(bm->m_l2_offset);
+                chunk->m_free_count -= 1;
+                i = chunk->m_free_stack[chunk->m_free_count];
+            }
+            else
+            {
+                u16 *     l1, *l2;
+                binmap_t* bm        = get_chunk_binmap(fsa, chunk, bin, l1, l2);
+                u16*      extension = (chunk->m_extension != superfsa_t::NIL) ? (u16*)fsa.idx2ptr(chunk->m_extension) : nullptr;
+                if (extension != nullptr && extension[0] > 0)
+                {
+                    // Prefer a slot on the pages that are still committed
+                    i = find_committed_slot(bm, l1, l2, bin, extension + c_page_counters_base);
+                    bm->set(bin.m_alloc_count, l1, l2, i);
+                }
+                else
+                {
+                    i = bm->findandset(bin.m_alloc_count, l1, l2);
+                }
+                if (extension != nullptr && !count_slot(chain, bin, extension, i))
+                {
+                    bm->clr(bin.m_alloc_count, l1, l2, i);
+                    return nullptr;
+                }
             }
-            u32 const i = bm->findandset(bin.m_alloc_count, l1, l2);
             ASSERT(i < bin.m_alloc_count);
-            ptr = toaddress(ptr, (u64)i * bin.m_alloc_size);
+            ptr        = toaddress(ptr, (u64)i * bin.m_alloc_size);
+            dirty_size = (i < chunk->m_elem_hwm) ? bin.m_alloc_size : 0;
+            if (i >= chunk->m_elem_hwm)
+                chunk->m_elem_hwm = i + 1;
         }
         else
         {
-            chunk->m_occupancy.m_physical_pages = (size + (m_chunks->m_page_size - 1)) >> m_chunks->m_page_shift;
+            u32 const pages                             = (size + (m_chunks->m_page_size - 1)) >> m_chunks->m_page_shift;
+            chunk->m_occupancy.m_pages.m_physical_pages = pages;
+            dirty_size                                  = (u64)chunk->m_elem_hwm << m_chunks->m_page_shift;
+            if (dirty_size > size)
+                dirty_size = size;
+            if (pages > chunk->m_elem_hwm)
+                chunk->m_elem_hwm = pages;
         }
 
         chunk->m_elem_used += 1;
@@ -975,15 +2410,24 @@ namespace xcore
             void* const chunkaddress = m_chunks->page_index_to_address(chunk->m_page_index);
             u32 const   i            = (u32)(todistance(chunkaddress, ptr) / bin.m_alloc_size);
             ASSERT(i < bin.m_alloc_count);
-            binmap_t* binmap = (binmap_t*)&chunk->m_occupancy.m_binmap;
-            u16*      l1     = (u16*)fsa.idx2ptr(binmap->m_l1_offset);
-            u16*      l2     = (u16*)fsa.idx2ptr(binmap->m_l2_offset);
-            binmap->clr(bin.m_alloc_count, l1, l2, i);
+            if (bin.m_alloc_count > 32 && chunk->m_free_count < c_free_stack_size)
+            {
+                chunk->m_free_stack[chunk->m_free_count] = (u16)i;
+                chunk->m_free_count += 1;
+            }
+            else
+            {
+                u16 *     l1, *l2;
+                binmap_t* binmap = get_chunk_binmap(fsa, chunk, bin, l1, l2);
+                binmap->clr(bin.m_alloc_count, l1, l2, i);
+                if (chunk->m_extension != superfsa_t::NIL)
+                    uncount_slot(bin, (u16*)fsa.idx2ptr(chunk->m_extension), i);
+            }
             size = bin.m_alloc_size;
         }
         else
         {
-            size = chunk->m_occupancy.m_physical_pages * m_chunks->m_page_size;
+            size = chunk->m_occupancy.m_pages.m_physical_pages * m_chunks->m_page_size - chunk->m_occupancy.m_pages.m_color;
         }
 
         chunk_was_full = (bin.m_alloc_count == chunk->m_elem_used);
@@ -993,6 +2437,120 @@ namespace xcore
         return size;
     }
 
+    // Slot 'i' was set in the binmap, the decommitted pages that it overlaps are committed again. Returns false when
+    // they cannot be committed, nothing is counted then.
+    bool superalloc_t::count_slot(superchunks_t::chain_t const& chain, superbin_t const& bin, u16* extension, u32 i)
+    {
+        u16* const pages       = extension + c_page_counters_base;
+        u32 const  first       = slot_first_page(bin, i);
+        u32 const  last        = slot_last_page(bin, i);
+        u32        decommitted = 0;
+        for (u32 p = first; p <= last; ++p)
+            decommitted += ((pages[p] & c_page_decommitted) != 0) ? 1 : 0;
+        if (decommitted > 0 && !m_chunks->m_limit->allows((u64)decommitted << m_chunks->m_page_shift))
+            return false;
+
+        for (u32 p = first; p <= last; ++p)
+        {
+            if ((pages[p] & c_page_decommitted) != 0)
+            {
+                if (!m_chunks->commit_pages(chain, p, 1))
+                {
+                    // The xvmem failed, the pages before this one stay committed but the slot is not counted on them
+                    while (p > first)
+                        pages[--p] -= 1;
+                    return false;
+                }
+                pages[p] = 0;
+                extension[0] -= 1;
+            }
+            pages[p] += 1;
+        }
+        return true;
+    }
+
+    void superalloc_t::uncount_slot(superbin_t const& bin, u16* extension, u32 i)
+    {
+        u16* const pages = extension + c_page_counters_base;
+        u32 const  last  = slot_last_page(bin, i);
+        for (u32 p = slot_first_page(bin, i); p <= last; ++p)
+        {
+            ASSERT(pages[p] > 0 && (pages[p] & c_page_decommitted) == 0);
+            pages[p] -= 1;
+        }
+    }
+
+    // The lowest free slot that only overlaps committed pages, the lowest free slot when there is none
+    u32 superalloc_t::find_committed_slot(binmap_t const* bm, u16 const* l1, u16 const* l2, superbin_t const& bin, u16 const* pages) const
+    {
+        u32 const lowest = (u32)bm->find(bin.m_alloc_count, l1, l2);
+        u32 const count  = chunk_pages(bin);
+        for (u32 p = 0; p < count; ++p)
+        {
+            if ((pages[p] & c_page_decommitted) != 0)
+                continue;
+
+            // Skip the pages where every slot is in use
+            u32 const first = (u32)(((u64)p << m_chunks->m_page_shift) / bin.m_alloc_size);
+            u32       last  = (u32)((((u64)p + 1) << m_chunks->m_page_shift) - 1) / bin.m_alloc_size;
+            if (last >= bin.m_alloc_count)
+                last = bin.m_alloc_count - 1;
+            if (pages[p] > (last - first))
+                continue;
+
+            for (s32 s = bm->upper(bin.m_alloc_count, l1, l2, first); s >= 0 && (u32)s <= last; s = bm->upper(bin.m_alloc_count, l1, l2, s + 1))
+            {
+                u32 const sl = slot_last_page(bin, s);
+                u32       q  = slot_first_page(bin, s);
+                while (q <= sl && (pages[q] & c_page_decommitted) == 0)
+                    q += 1;
+                if (q > sl)
+                    return (u32)s;
+            }
+        }
+        return lowest;
+    }
+
+    // Decommits the pages without any slot in use of the partially used chunks of 'bin', the chunks that are pinned or
+    // filled by a thread are skipped. The pages are committed again when a slot on them is handed out. Returns the
+    // number of pages that were decommitted.
+    u32 superalloc_t::scavenge(superfsa_t& sfsa, superbin_t const& bin)
+    {
+        u32 const          count = chunk_pages(bin);
+        superused_t const& used  = m_used_chunks_per_size[bin.m_alloc_bin_index];
+        if (bin.m_use_binmap == 0 || count <= 1)
+            return 0;
+
+        superbatch_t batch(m_chunks->m_vmem, m_chunks->m_page_size, false, false);
+        u32          decommitted = 0;
+        for (u32 u = 0; u < used.count(); ++u)
+        {
+            chunk_t* chunk = (chunk_t*)sfsa.idx2ptr(*used_entry(used, u));
+            if (chunk->m_pinned == 1)
+                continue;
+
+            u16* const                   extension = (u16*)sfsa.idx2ptr(chunk->m_extension);
+            u16* const                   pages     = extension + c_page_counters_base;
+            superchunks_t::chain_t const chain     = m_chunks->page_index_to_chunk_info(chunk->m_page_index);
+            for (u32 p = 0; p < count;)
+            {
+                u32 n = 0;
+                while ((p + n) < count && pages[p + n] == 0)
+                {
+                    pages[p + n] = c_page_decommitted;
+                    n += 1;
+                }
+                if (n > 0)
+                    m_chunks->decommit_pages(chain, p, n, batch);
+                extension[0] += n;
+                decommitted += n;
+                p += n + 1;
+            }
+        }
+        batch.flush(false);
+        return decommitted;
+    }
+
     /// ---------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
     /// ---------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
     /// The following is a strict data-drive initialization of the bins and allocators, please know what you are doing when modifying any of this.
@@ -1037,6 +2595,7 @@ namespace xcore
     {
         superallocator_config_t()
             : m_num_bins(0)
+            , m_bin_shift(0)
             , m_asbins(nullptr)
             , m_num_allocators(0)
             , m_allocators(nullptr)
@@ -1051,6 +2610,7 @@ namespace xcore
 
         superallocator_config_t(const superallocator_config_t& other)
             : m_num_bins(other.m_num_bins)
+            , m_bin_shift(other.m_bin_shift)
             , m_asbins(other.m_asbins)
             , m_num_allocators(other.m_num_allocators)
             , m_allocators(other.m_allocators)
@@ -1063,9 +2623,10 @@ namespace xcore
         {
         }
 
-        superallocator_config_t(s32 const num_bins, superbin_t const* asbins, const s32 num_allocators, superalloc_t const* allocators, u64 const address_range, u64 const block_range, u32 const internal_heap_address_range, u32 const internal_heap_pre_size,
-                                u32 const internal_fsa_address_range, u32 const internal_fsa_pre_size)
+        superallocator_config_t(s32 const num_bins, u32 const bin_shift, superbin_t const* asbins, const s32 num_allocators, superalloc_t const* allocators, u64 const address_range, u64 const block_range, u32 const internal_heap_address_range, u32 const internal_heap_pre_size,
+                                u64 const internal_fsa_address_range, u32 const internal_fsa_pre_size)
             : m_num_bins(num_bins)
+            , m_bin_shift(bin_shift)
             , m_asbins(asbins)
             , m_num_allocators(num_allocators)
             , m_allocators(allocators)
@@ -1078,47 +2639,53 @@ namespace xcore
         {
         }
 
-        s32                 m_num_bins;
-        superbin_t const*   m_asbins;
-        s32                 m_num_allocators;
+        // The bin (size class) of 'size', the runtime version of superbin_size2bin
+        inline s32 size2bin(u32 size) const { return (s32)superbin_size2bin_fast(size, m_bin_shift); }
+
+        // The address range of the internal FSA when the whole address range is filled with the chunks of the bin that
+        // needs the most bookkeeping per byte, e.g. ~0.5 byte per byte for 8 byte allocations in 64 KB chunks
+        u64 internal_fsa_range(u32 page_shift) const
+        {
+            u64 range = c_internal_fsa_range_min;
+            for (s32 s = 0; s < m_num_bins; ++s)
+            {
+                superbin_t const& bin = m_asbins[s];
+                if (bin.m_alloc_bin_index != (u32)s)
+                    continue;
+                u64 const chunks = m_address_range >> m_allocators[bin.m_alloc_index].m_chunk_shift;
+                u64 const bytes  = chunks * superalloc_t::bookkeeping_size(bin, page_shift);
+                if (bytes > range)
+                    range = bytes;
+            }
+            range = xalignUp(range, (u64)xMB);
+            return (range < superpages_t::c_address_range_max) ? range : superpages_t::c_address_range_max;
+        }
+
+        static const u64 c_internal_fsa_range_min = 16 * xMB;
+
+        s32                 m_num_bins;
+        u32                 m_bin_shift;
+        superbin_t const*   m_asbins;
+        s32                 m_num_allocators;
         superalloc_t const* m_allocators;
         u64                 m_address_range;
         u64                 m_block_range;
         u32                 m_internal_heap_address_range;
         u32                 m_internal_heap_pre_size;
-        u32                 m_internal_fsa_address_range;
+        u64                 m_internal_fsa_address_range; // 0 derives it from the address range, see internal_fsa_range
         u32                 m_internal_fsa_pre_size;
     };
 
     namespace superallocator_config_desktop_app_25p_t
     {
-        // superbin_t(allocation size MB, KB, B, bin redir index, allocator index, use binmap?, maximum allocation count, binmap level 1 length (u16), binmap level 2 length (u16))
-        static const s32        c_num_bins           = 112;
-        static const superbin_t c_asbins[c_num_bins] = {
-            superbin_t(0, 0, 8, 8, 0, 1, 8192, 32, 512),   superbin_t(0, 0, 8, 8, 0, 1, 8192, 32, 512),   superbin_t(0, 0, 8, 8, 0, 1, 8192, 32, 512),   superbin_t(0, 0, 8, 8, 0, 1, 8192, 32, 512),   superbin_t(0, 0, 8, 8, 0, 1, 8192, 32, 512),
-            superbin_t(0, 0, 8, 8, 0, 1, 8192, 32, 512),   superbin_t(0, 0, 8, 8, 0, 1, 8192, 32, 512),   superbin_t(0, 0, 8, 8, 0, 1, 8192, 32, 512),   superbin_t(0, 0, 8, 8, 0, 1, 8192, 32, 512),   superbin_t(0, 0, 10, 10, 0, 1, 6553, 32, 512),
-            superbin_t(0, 0, 12, 10, 0, 1, 5461, 32, 512), superbin_t(0, 0, 14, 12, 0, 1, 4681, 32, 512), superbin_t(0, 0, 16, 12, 0, 1, 4096, 16, 256), superbin_t(0, 0, 20, 13, 0, 1, 3276, 16, 256), superbin_t(0, 0, 24, 14, 0, 1, 2730, 16, 256),
-            superbin_t(0, 0, 28, 15, 0, 1, 2340, 16, 256), superbin_t(0, 0, 32, 16, 0, 1, 2048, 8, 128),  superbin_t(0, 0, 40, 17, 0, 1, 1638, 8, 128),  superbin_t(0, 0, 48, 18, 0, 1, 1365, 8, 128),  superbin_t(0, 0, 56, 19, 0, 1, 1170, 8, 128),
-            superbin_t(0, 0, 64, 20, 0, 1, 1024, 4, 64),   superbin_t(0, 0, 80, 21, 0, 1, 819, 4, 64),    superbin_t(0, 0, 96, 22, 0, 1, 682, 4, 64),    superbin_t(0, 0, 112, 23, 0, 1, 585, 4, 64),   superbin_t(0, 0, 128, 24, 0, 1, 512, 2, 32),
-            superbin_t(0, 0, 160, 25, 0, 1, 409, 2, 32),   superbin_t(0, 0, 192, 26, 0, 1, 341, 2, 32),   superbin_t(0, 0, 224, 27, 0, 1, 292, 2, 32),   superbin_t(0, 0, 256, 28, 0, 1, 256, 2, 16),   superbin_t(0, 0, 320, 29, 0, 1, 204, 2, 16),
-            superbin_t(0, 0, 384, 30, 0, 1, 170, 2, 16),   superbin_t(0, 0, 448, 31, 0, 1, 146, 2, 16),   superbin_t(0, 0, 512, 32, 0, 1, 128, 2, 8),    superbin_t(0, 0, 640, 33, 0, 1, 102, 2, 8),    superbin_t(0, 0, 768, 34, 0, 1, 85, 2, 8),
-            superbin_t(0, 0, 896, 35, 0, 1, 73, 2, 8),     superbin_t(0, 1, 0, 36, 0, 1, 64, 2, 4),       superbin_t(0, 1, 256, 37, 0, 1, 51, 2, 4),     superbin_t(0, 1, 512, 38, 1, 1, 85, 2, 8),     superbin_t(0, 1, 768, 39, 1, 1, 73, 2, 8),
-            superbin_t(0, 2, 0, 40, 0, 1, 32, 0, 0),       superbin_t(0, 2, 512, 41, 1, 1, 51, 2, 4),     superbin_t(0, 3, 0, 42, 2, 1, 85, 2, 8),       superbin_t(0, 3, 512, 43, 2, 1, 73, 2, 8),     superbin_t(0, 4, 0, 44, 0, 1, 16, 0, 0),
-            superbin_t(0, 5, 0, 45, 2, 1, 51, 2, 4),       superbin_t(0, 6, 0, 46, 2, 1, 32, 2, 4),       superbin_t(0, 7, 0, 47, 3, 1, 73, 2, 8),       superbin_t(0, 8, 0, 48, 0, 1, 8, 0, 0),        superbin_t(0, 10, 0, 49, 3, 1, 51, 2, 4),
-            superbin_t(0, 12, 0, 50, 2, 1, 16, 0, 0),      superbin_t(0, 14, 0, 51, 3, 1, 32, 2, 4),      superbin_t(0, 16, 0, 52, 0, 1, 4, 0, 0),       superbin_t(0, 20, 0, 53, 3, 1, 16, 0, 0),      superbin_t(0, 24, 0, 54, 2, 1, 8, 0, 0),
-            superbin_t(0, 28, 0, 55, 3, 1, 16, 0, 0),      superbin_t(0, 32, 0, 56, 0, 1, 2, 0, 0),       superbin_t(0, 40, 0, 57, 3, 1, 8, 0, 0),       superbin_t(0, 48, 0, 58, 2, 1, 4, 0, 0),       superbin_t(0, 56, 0, 59, 3, 1, 8, 0, 0),
-            superbin_t(0, 64, 0, 60, 0, 0, 1, 0, 0),       superbin_t(0, 80, 0, 61, 3, 1, 4, 0, 0),       superbin_t(0, 96, 0, 62, 2, 1, 2, 0, 0),       superbin_t(0, 112, 0, 63, 3, 1, 4, 0, 0),      superbin_t(0, 128, 0, 64, 1, 0, 1, 0, 0),
-            superbin_t(0, 160, 0, 65, 3, 1, 2, 0, 0),      superbin_t(0, 192, 0, 66, 2, 0, 1, 0, 0),      superbin_t(0, 224, 0, 67, 3, 1, 2, 0, 0),      superbin_t(0, 256, 0, 68, 2, 0, 1, 0, 0),      superbin_t(0, 320, 0, 69, 3, 0, 1, 0, 0),
-            superbin_t(0, 384, 0, 70, 3, 0, 1, 0, 0),      superbin_t(0, 448, 0, 71, 3, 0, 1, 0, 0),      superbin_t(0, 512, 0, 72, 3, 0, 1, 0, 0),      superbin_t(0, 640, 0, 73, 4, 0, 1, 0, 0),      superbin_t(0, 768, 0, 74, 4, 0, 1, 0, 0),
-            superbin_t(0, 896, 0, 75, 4, 0, 1, 0, 0),      superbin_t(1, 0, 0, 76, 4, 0, 1, 0, 0),        superbin_t(1, 256, 0, 77, 5, 0, 1, 0, 0),      superbin_t(1, 512, 0, 78, 5, 0, 1, 0, 0),      superbin_t(1, 768, 0, 79, 5, 0, 1, 0, 0),
-            superbin_t(2, 0, 0, 80, 5, 0, 1, 0, 0),        superbin_t(2, 512, 0, 81, 6, 0, 1, 0, 0),      superbin_t(3, 0, 0, 82, 6, 0, 1, 0, 0),        superbin_t(3, 512, 0, 83, 6, 0, 1, 0, 0),      superbin_t(4, 0, 0, 84, 6, 0, 1, 0, 0),
-            superbin_t(5, 0, 0, 85, 7, 0, 1, 0, 0),        superbin_t(6, 0, 0, 86, 7, 0, 1, 0, 0),        superbin_t(7, 0, 0, 87, 7, 0, 1, 0, 0),        superbin_t(8, 0, 0, 88, 7, 0, 1, 0, 0),        superbin_t(10, 0, 0, 89, 8, 0, 1, 0, 0),
-            superbin_t(12, 0, 0, 90, 8, 0, 1, 0, 0),       superbin_t(14, 0, 0, 91, 8, 0, 1, 0, 0),       superbin_t(16, 0, 0, 92, 8, 0, 1, 0, 0),       superbin_t(20, 0, 0, 93, 9, 0, 1, 0, 0),       superbin_t(24, 0, 0, 94, 9, 0, 1, 0, 0),
-            superbin_t(28, 0, 0, 95, 9, 0, 1, 0, 0),       superbin_t(32, 0, 0, 96, 9, 0, 1, 0, 0),       superbin_t(40, 0, 0, 97, 10, 0, 1, 0, 0),      superbin_t(48, 0, 0, 98, 10, 0, 1, 0, 0),      superbin_t(56, 0, 0, 99, 10, 0, 1, 0, 0),
-            superbin_t(64, 0, 0, 100, 10, 0, 1, 0, 0),     superbin_t(80, 0, 0, 101, 11, 0, 1, 0, 0),     superbin_t(96, 0, 0, 102, 11, 0, 1, 0, 0),     superbin_t(112, 0, 0, 103, 11, 0, 1, 0, 0),    superbin_t(128, 0, 0, 104, 11, 0, 1, 0, 0),
-            superbin_t(160, 0, 0, 105, 12, 0, 1, 0, 0),    superbin_t(192, 0, 0, 106, 12, 0, 1, 0, 0),    superbin_t(224, 0, 0, 107, 12, 0, 1, 0, 0),    superbin_t(256, 0, 0, 108, 12, 0, 1, 0, 0),    superbin_t(320, 0, 0, 109, 13, 0, 1, 0, 0),
-            superbin_t(384, 0, 0, 110, 13, 0, 1, 0, 0),    superbin_t(448, 0, 0, 111, 13, 0, 1, 0, 0),
+        // superbin_params_t(bin shift, min size, size alignment, max size, page shift, chunk shift min, chunk shift max, chunk waste %)
+        struct bins_t
+        {
+            static constexpr superbin_params_t params() { return superbin_params_t(2, 8, 4, 448 * xMB, 16, 16, 29, 1); }
         };
+        static const s32                                                                     c_num_bins = superbin_num_bins(bins_t::params());
+        typedef superbin_table_t<bins_t, superbin_make_seq_t<(u32)c_num_bins>::type> table_t;
+        static superbin_t const* const                                                       c_asbins = table_t::c_bins;
 
         static const s32    c_num_allocators               = 14;
         static superalloc_t c_allocators[c_num_allocators] = {
@@ -1131,23 +2698,13 @@ namespace xcore
 
         static const u32 c_internal_heap_address_range = 16 * xMB;
         static const u32 c_internal_heap_pre_size      = 2 * xMB;
-        static const u32 c_internal_fsa_address_range  = 16 * xMB;
+        static const u64 c_internal_fsa_address_range  = 0;
         static const u32 c_internal_fsa_pre_size       = 2 * xMB;
 
         static superallocator_config_t get_config()
         {
-            return superallocator_config_t(c_num_bins, c_asbins, c_num_allocators, c_allocators, c_address_range, c_block_range, c_internal_heap_address_range, c_internal_heap_pre_size, c_internal_fsa_address_range, c_internal_fsa_pre_size);
-        }
-
-        static inline s32 size2bin(u32 size)
-        {
-            s32 w = xcountLeadingZeros(size);
-            u32 f = (u32)0x80000000 >> w;
-            u32 r = 0xFFFFFFFF << (29 - w);
-            u32 t = ((f - 1) >> 2);
-            size  = (size + t) & ~t;
-            int i = (int)((size & r) >> (29 - w)) + ((29 - w) * 4);
-            return i;
+            return superallocator_config_t(c_num_bins, bins_t::params().m_bin_shift, c_asbins, c_num_allocators, c_allocators, c_address_range, c_block_range, c_internal_heap_address_range, c_internal_heap_pre_size, c_internal_fsa_address_range,
+                                           c_internal_fsa_pre_size);
         }
 
     }; // namespace superallocator_config_desktop_app_25p_t
@@ -1155,53 +2712,14 @@ namespace xcore
     namespace superallocator_config_desktop_app_10p_t
     {
         // 10% allocation waste
-        static const s32        c_num_bins           = 216;
-        static const superbin_t c_asbins[c_num_bins] = {
-            superbin_t(0, 0, 8, 8, 0, 1, 8192, 32, 512),   superbin_t(0, 0, 8, 8, 0, 1, 8192, 32, 512),   superbin_t(0, 0, 8, 8, 0, 1, 8192, 32, 512),   superbin_t(0, 0, 8, 8, 0, 1, 8192, 32, 512),   superbin_t(0, 0, 8, 8, 0, 1, 8192, 32, 512),
-            superbin_t(0, 0, 8, 8, 0, 1, 8192, 32, 512),   superbin_t(0, 0, 8, 8, 0, 1, 8192, 32, 512),   superbin_t(0, 0, 8, 8, 0, 1, 8192, 32, 512),   superbin_t(0, 0, 8, 8, 0, 1, 8192, 32, 512),   superbin_t(0, 0, 9, 12, 0, 1, 7281, 32, 512),
-            superbin_t(0, 0, 10, 12, 0, 1, 6553, 32, 512), superbin_t(0, 0, 11, 12, 0, 1, 5957, 32, 512), superbin_t(0, 0, 12, 12, 0, 1, 5461, 32, 512), superbin_t(0, 0, 13, 16, 0, 1, 5041, 32, 512), superbin_t(0, 0, 14, 16, 0, 1, 4681, 32, 512),
-            superbin_t(0, 0, 15, 16, 0, 1, 4369, 32, 512), superbin_t(0, 0, 16, 16, 0, 1, 4096, 16, 256), superbin_t(0, 0, 18, 18, 0, 1, 3640, 16, 256), superbin_t(0, 0, 20, 18, 0, 1, 3276, 16, 256), superbin_t(0, 0, 22, 20, 0, 1, 2978, 16, 256),
-            superbin_t(0, 0, 24, 20, 0, 1, 2730, 16, 256), superbin_t(0, 0, 26, 22, 0, 1, 2520, 16, 256), superbin_t(0, 0, 28, 22, 0, 1, 2340, 16, 256), superbin_t(0, 0, 30, 24, 0, 1, 2184, 16, 256), superbin_t(0, 0, 32, 24, 0, 1, 2048, 8, 128),
-            superbin_t(0, 0, 36, 25, 0, 1, 1820, 8, 128),  superbin_t(0, 0, 40, 26, 0, 1, 1638, 8, 128),  superbin_t(0, 0, 44, 27, 0, 1, 1489, 8, 128),  superbin_t(0, 0, 48, 28, 0, 1, 1365, 8, 128),  superbin_t(0, 0, 52, 29, 0, 1, 1260, 8, 128),
-            superbin_t(0, 0, 56, 30, 0, 1, 1170, 8, 128),  superbin_t(0, 0, 60, 31, 0, 1, 1092, 8, 128),  superbin_t(0, 0, 64, 32, 0, 1, 1024, 4, 64),   superbin_t(0, 0, 72, 33, 0, 1, 910, 4, 64),    superbin_t(0, 0, 80, 34, 0, 1, 819, 4, 64),
-            superbin_t(0, 0, 88, 35, 0, 1, 744, 4, 64),    superbin_t(0, 0, 96, 36, 0, 1, 682, 4, 64),    superbin_t(0, 0, 104, 37, 0, 1, 630, 4, 64),   superbin_t(0, 0, 112, 38, 0, 1, 585, 4, 64),   superbin_t(0, 0, 120, 39, 0, 1, 546, 4, 64),
-            superbin_t(0, 0, 128, 40, 0, 1, 512, 2, 32),   superbin_t(0, 0, 144, 41, 0, 1, 455, 2, 32),   superbin_t(0, 0, 160, 42, 0, 1, 409, 2, 32),   superbin_t(0, 0, 176, 43, 0, 1, 372, 2, 32),   superbin_t(0, 0, 192, 44, 0, 1, 341, 2, 32),
-            superbin_t(0, 0, 208, 45, 0, 1, 315, 2, 32),   superbin_t(0, 0, 224, 46, 0, 1, 292, 2, 32),   superbin_t(0, 0, 240, 47, 0, 1, 273, 2, 32),   superbin_t(0, 0, 256, 48, 0, 1, 256, 2, 16),   superbin_t(0, 0, 288, 49, 0, 1, 227, 2, 16),
-            superbin_t(0, 0, 320, 50, 0, 1, 204, 2, 16),   superbin_t(0, 0, 352, 51, 0, 1, 186, 2, 16),   superbin_t(0, 0, 384, 52, 0, 1, 170, 2, 16),   superbin_t(0, 0, 416, 53, 0, 1, 157, 2, 16),   superbin_t(0, 0, 448, 54, 0, 1, 146, 2, 16),
-            superbin_t(0, 0, 480, 55, 0, 1, 136, 2, 16),   superbin_t(0, 0, 512, 56, 0, 1, 128, 2, 8),    superbin_t(0, 0, 576, 57, 0, 1, 113, 2, 8),    superbin_t(0, 0, 640, 58, 0, 1, 102, 2, 8),    superbin_t(0, 0, 704, 59, 0, 1, 93, 2, 8),
-            superbin_t(0, 0, 768, 60, 0, 1, 85, 2, 8),     superbin_t(0, 0, 832, 61, 0, 1, 78, 2, 8),     superbin_t(0, 0, 896, 62, 0, 1, 73, 2, 8),     superbin_t(0, 0, 960, 63, 0, 1, 68, 2, 8),     superbin_t(0, 1, 0, 64, 0, 1, 64, 2, 4),
-            superbin_t(0, 1, 128, 65, 1, 1, 113, 2, 8),    superbin_t(0, 1, 256, 66, 0, 1, 51, 2, 4),     superbin_t(0, 1, 384, 67, 1, 1, 93, 2, 8),     superbin_t(0, 1, 512, 68, 1, 1, 85, 2, 8),     superbin_t(0, 1, 640, 69, 0, 1, 39, 2, 4),
-            superbin_t(0, 1, 768, 70, 1, 1, 73, 2, 8),     superbin_t(0, 1, 896, 71, 0, 1, 34, 2, 4),     superbin_t(0, 2, 0, 72, 0, 1, 32, 0, 0),       superbin_t(0, 2, 256, 73, 2, 1, 113, 2, 8),    superbin_t(0, 2, 512, 74, 1, 1, 51, 2, 4),
-            superbin_t(0, 2, 768, 75, 2, 1, 93, 2, 8),     superbin_t(0, 3, 0, 76, 2, 1, 85, 2, 8),       superbin_t(0, 3, 256, 77, 1, 1, 39, 2, 4),     superbin_t(0, 3, 512, 78, 2, 1, 73, 2, 8),     superbin_t(0, 3, 768, 79, 0, 1, 17, 0, 0),
-            superbin_t(0, 4, 0, 80, 0, 1, 16, 0, 0),       superbin_t(0, 4, 512, 81, 3, 1, 113, 2, 8),    superbin_t(0, 5, 0, 82, 2, 1, 51, 2, 4),       superbin_t(0, 5, 512, 83, 3, 1, 93, 2, 8),     superbin_t(0, 6, 0, 84, 2, 1, 32, 2, 4),
-            superbin_t(0, 6, 512, 85, 2, 1, 39, 2, 4),     superbin_t(0, 7, 0, 86, 3, 1, 73, 2, 8),       superbin_t(0, 7, 512, 87, 1, 1, 17, 0, 0),     superbin_t(0, 8, 0, 88, 0, 1, 8, 0, 0),        superbin_t(0, 9, 0, 89, 4, 1, 113, 2, 8),
-            superbin_t(0, 10, 0, 90, 3, 1, 51, 2, 4),      superbin_t(0, 11, 0, 91, 3, 1, 29, 2, 4),      superbin_t(0, 12, 0, 92, 2, 1, 16, 0, 0),      superbin_t(0, 13, 0, 93, 3, 1, 39, 2, 4),      superbin_t(0, 14, 0, 94, 3, 1, 32, 2, 4),
-            superbin_t(0, 15, 0, 95, 2, 1, 17, 0, 0),      superbin_t(0, 16, 0, 96, 0, 1, 4, 0, 0),       superbin_t(0, 18, 0, 97, 4, 1, 53, 2, 4),      superbin_t(0, 20, 0, 98, 3, 1, 16, 0, 0),      superbin_t(0, 22, 0, 99, 4, 1, 32, 2, 4),
-            superbin_t(0, 24, 0, 100, 2, 1, 8, 0, 0),      superbin_t(0, 26, 0, 101, 4, 1, 39, 2, 4),     superbin_t(0, 28, 0, 102, 3, 1, 16, 0, 0),     superbin_t(0, 30, 0, 103, 3, 1, 17, 0, 0),     superbin_t(0, 32, 0, 104, 0, 1, 2, 0, 0),
-            superbin_t(0, 36, 0, 105, 4, 1, 23, 0, 0),     superbin_t(0, 40, 0, 106, 3, 1, 8, 0, 0),      superbin_t(0, 44, 0, 107, 4, 1, 16, 0, 0),     superbin_t(0, 48, 0, 108, 2, 1, 4, 0, 0),      superbin_t(0, 52, 0, 109, 4, 1, 16, 0, 0),
-            superbin_t(0, 56, 0, 110, 3, 1, 8, 0, 0),      superbin_t(0, 60, 0, 111, 4, 1, 17, 0, 0),     superbin_t(0, 64, 0, 112, 0, 0, 1, 0, 0),      superbin_t(0, 72, 0, 113, 4, 1, 8, 0, 0),      superbin_t(0, 80, 0, 114, 3, 1, 4, 0, 0),
-            superbin_t(0, 88, 0, 115, 4, 1, 8, 0, 0),      superbin_t(0, 96, 0, 116, 2, 1, 2, 0, 0),      superbin_t(0, 104, 0, 117, 4, 1, 8, 0, 0),     superbin_t(0, 112, 0, 118, 3, 1, 4, 0, 0),     superbin_t(0, 120, 0, 119, 4, 1, 8, 0, 0),
-            superbin_t(0, 128, 0, 120, 1, 0, 1, 0, 0),     superbin_t(0, 144, 0, 121, 4, 1, 4, 0, 0),     superbin_t(0, 160, 0, 122, 3, 1, 2, 0, 0),     superbin_t(0, 176, 0, 123, 4, 1, 4, 0, 0),     superbin_t(0, 192, 0, 124, 2, 0, 1, 0, 0),
-            superbin_t(0, 208, 0, 125, 4, 1, 4, 0, 0),     superbin_t(0, 224, 0, 126, 3, 1, 2, 0, 0),     superbin_t(0, 240, 0, 127, 4, 1, 4, 0, 0),     superbin_t(0, 256, 0, 128, 2, 0, 1, 0, 0),     superbin_t(0, 288, 0, 129, 4, 1, 2, 0, 0),
-            superbin_t(0, 320, 0, 130, 3, 0, 1, 0, 0),     superbin_t(0, 352, 0, 131, 4, 1, 2, 0, 0),     superbin_t(0, 384, 0, 132, 3, 0, 1, 0, 0),     superbin_t(0, 416, 0, 133, 4, 1, 2, 0, 0),     superbin_t(0, 448, 0, 134, 3, 0, 1, 0, 0),
-            superbin_t(0, 480, 0, 135, 4, 1, 2, 0, 0),     superbin_t(0, 512, 0, 136, 3, 0, 1, 0, 0),     superbin_t(0, 576, 0, 137, 4, 0, 1, 0, 0),     superbin_t(0, 640, 0, 138, 4, 0, 1, 0, 0),     superbin_t(0, 704, 0, 139, 4, 0, 1, 0, 0),
-            superbin_t(0, 768, 0, 140, 4, 0, 1, 0, 0),     superbin_t(0, 832, 0, 141, 4, 0, 1, 0, 0),     superbin_t(0, 896, 0, 142, 4, 0, 1, 0, 0),     superbin_t(0, 960, 0, 143, 4, 0, 1, 0, 0),     superbin_t(1, 0, 0, 144, 4, 0, 1, 0, 0),
-            superbin_t(1, 128, 0, 145, 5, 0, 1, 0, 0),     superbin_t(1, 256, 0, 146, 5, 0, 1, 0, 0),     superbin_t(1, 384, 0, 147, 5, 0, 1, 0, 0),     superbin_t(1, 512, 0, 148, 5, 0, 1, 0, 0),     superbin_t(1, 640, 0, 149, 5, 0, 1, 0, 0),
-            superbin_t(1, 768, 0, 150, 5, 0, 1, 0, 0),     superbin_t(1, 896, 0, 151, 5, 0, 1, 0, 0),     superbin_t(2, 0, 0, 152, 5, 0, 1, 0, 0),       superbin_t(2, 256, 0, 153, 6, 0, 1, 0, 0),     superbin_t(2, 512, 0, 154, 6, 0, 1, 0, 0),
-            superbin_t(2, 768, 0, 155, 6, 0, 1, 0, 0),     superbin_t(3, 0, 0, 156, 6, 0, 1, 0, 0),       superbin_t(3, 256, 0, 157, 6, 0, 1, 0, 0),     superbin_t(3, 512, 0, 158, 6, 0, 1, 0, 0),     superbin_t(3, 768, 0, 159, 6, 0, 1, 0, 0),
-            superbin_t(4, 0, 0, 160, 6, 0, 1, 0, 0),       superbin_t(4, 512, 0, 161, 7, 0, 1, 0, 0),     superbin_t(5, 0, 0, 162, 7, 0, 1, 0, 0),       superbin_t(5, 512, 0, 163, 7, 0, 1, 0, 0),     superbin_t(6, 0, 0, 164, 7, 0, 1, 0, 0),
-            superbin_t(6, 512, 0, 165, 7, 0, 1, 0, 0),     superbin_t(7, 0, 0, 166, 7, 0, 1, 0, 0),       superbin_t(7, 512, 0, 167, 7, 0, 1, 0, 0),     superbin_t(8, 0, 0, 168, 7, 0, 1, 0, 0),       superbin_t(9, 0, 0, 169, 8, 0, 1, 0, 0),
-            superbin_t(10, 0, 0, 170, 8, 0, 1, 0, 0),      superbin_t(11, 0, 0, 171, 8, 0, 1, 0, 0),      superbin_t(12, 0, 0, 172, 8, 0, 1, 0, 0),      superbin_t(13, 0, 0, 173, 8, 0, 1, 0, 0),      superbin_t(14, 0, 0, 174, 8, 0, 1, 0, 0),
-            superbin_t(15, 0, 0, 175, 8, 0, 1, 0, 0),      superbin_t(16, 0, 0, 176, 8, 0, 1, 0, 0),      superbin_t(18, 0, 0, 177, 9, 0, 1, 0, 0),      superbin_t(20, 0, 0, 178, 9, 0, 1, 0, 0),      superbin_t(22, 0, 0, 179, 9, 0, 1, 0, 0),
-            superbin_t(24, 0, 0, 180, 9, 0, 1, 0, 0),      superbin_t(26, 0, 0, 181, 9, 0, 1, 0, 0),      superbin_t(28, 0, 0, 182, 9, 0, 1, 0, 0),      superbin_t(30, 0, 0, 183, 9, 0, 1, 0, 0),      superbin_t(32, 0, 0, 184, 9, 0, 1, 0, 0),
-            superbin_t(36, 0, 0, 185, 10, 0, 1, 0, 0),     superbin_t(40, 0, 0, 186, 10, 0, 1, 0, 0),     superbin_t(44, 0, 0, 187, 10, 0, 1, 0, 0),     superbin_t(48, 0, 0, 188, 10, 0, 1, 0, 0),     superbin_t(52, 0, 0, 189, 10, 0, 1, 0, 0),
-            superbin_t(56, 0, 0, 190, 10, 0, 1, 0, 0),     superbin_t(60, 0, 0, 191, 10, 0, 1, 0, 0),     superbin_t(64, 0, 0, 192, 10, 0, 1, 0, 0),     superbin_t(72, 0, 0, 193, 11, 0, 1, 0, 0),     superbin_t(80, 0, 0, 194, 11, 0, 1, 0, 0),
-            superbin_t(88, 0, 0, 195, 11, 0, 1, 0, 0),     superbin_t(96, 0, 0, 196, 11, 0, 1, 0, 0),     superbin_t(104, 0, 0, 197, 11, 0, 1, 0, 0),    superbin_t(112, 0, 0, 198, 11, 0, 1, 0, 0),    superbin_t(120, 0, 0, 199, 11, 0, 1, 0, 0),
-            superbin_t(128, 0, 0, 200, 11, 0, 1, 0, 0),    superbin_t(144, 0, 0, 201, 12, 0, 1, 0, 0),    superbin_t(160, 0, 0, 202, 12, 0, 1, 0, 0),    superbin_t(176, 0, 0, 203, 12, 0, 1, 0, 0),    superbin_t(192, 0, 0, 204, 12, 0, 1, 0, 0),
-            superbin_t(208, 0, 0, 205, 12, 0, 1, 0, 0),    superbin_t(224, 0, 0, 206, 12, 0, 1, 0, 0),    superbin_t(240, 0, 0, 207, 12, 0, 1, 0, 0),    superbin_t(256, 0, 0, 208, 12, 0, 1, 0, 0),    superbin_t(288, 0, 0, 209, 13, 0, 1, 0, 0),
-            superbin_t(320, 0, 0, 210, 13, 0, 1, 0, 0),    superbin_t(352, 0, 0, 211, 13, 0, 1, 0, 0),    superbin_t(384, 0, 0, 212, 13, 0, 1, 0, 0),    superbin_t(416, 0, 0, 213, 13, 0, 1, 0, 0),    superbin_t(448, 0, 0, 214, 13, 0, 1, 0, 0),
-            superbin_t(480, 0, 0, 215, 13, 0, 1, 0, 0),
+        struct bins_t
+        {
+            static constexpr superbin_params_t params() { return superbin_params_t(3, 8, 4, 480 * xMB, 16, 16, 29, 1); }
         };
+        static const s32                                                                     c_num_bins = superbin_num_bins(bins_t::params());
+        typedef superbin_table_t<bins_t, superbin_make_seq_t<(u32)c_num_bins>::type> table_t;
+        static superbin_t const* const                                                       c_asbins = table_t::c_bins;
+
         static const s32    c_num_allocators               = 14;
         static superalloc_t c_allocators[c_num_allocators] = {
             superalloc_t(16), superalloc_t(17), superalloc_t(18), superalloc_t(19), superalloc_t(20), superalloc_t(21), superalloc_t(22),
@@ -1213,23 +2731,13 @@ namespace xcore
 
         static const u32 c_internal_heap_address_range = 16 * xMB;
         static const u32 c_internal_heap_pre_size      = 2 * xMB;
-        static const u32 c_internal_fsa_address_range  = 16 * xMB;
+        static const u64 c_internal_fsa_address_range  = 0;
         static const u32 c_internal_fsa_pre_size       = 2 * xMB;
 
         static superallocator_config_t get_config()
         {
-            return superallocator_config_t(c_num_bins, c_asbins, c_num_allocators, c_allocators, c_address_range, c_block_range, c_internal_heap_address_range, c_internal_heap_pre_size, c_internal_fsa_address_range, c_internal_fsa_pre_size);
-        }
-
-        static inline s32 size2bin(u32 size)
-        {
-            s32 w = xcountLeadingZeros(size);
-            u32 f = (u32)0x80000000 >> w;
-            u32 r = 0xFFFFFFFF << (28 - w);
-            u32 t = ((f - 1) >> 3);
-            size  = (size + t) & ~t;
-            int i = (int)((size & r) >> (28 - w)) + ((28 - w) * 8);
-            return i;
+            return superallocator_config_t(c_num_bins, bins_t::params().m_bin_shift, c_asbins, c_num_allocators, c_allocators, c_address_range, c_block_range, c_internal_heap_address_range, c_internal_heap_pre_size, c_internal_fsa_address_range,
+                                           c_internal_fsa_pre_size);
         }
 
     }; // namespace superallocator_config_desktop_app_10p_t
@@ -1237,6 +2745,69 @@ namespace xcore
     namespace superallocator_config = superallocator_config_desktop_app_10p_t;
     // namespace superallocator_config = superallocator_config_desktop_app_25p_t;
 
+    // The owners of the thread-private chunks. A thread takes a free owner the first time it needs one and gives it back
+    // when it exits (a pthread key destructor), so no two live threads have the same owner. A thread that finds all
+    // c_owners_max owners taken uses the shared chunks. Every thread gets a new generation, an allocator shares the
+    // chunks that an earlier thread with the same owner left behind before the new thread fills its own.
+    struct superowner_t
+    {
+        u32 m_owner;      // [1, superalloc_t::c_owners_max], 0 when the thread uses the shared chunks
+        u32 m_generation; // 0 until the thread asked for an owner
+    };
+
+    static std::atomic<u64> s_owners_taken[2]; // Bit 'owner - 1' is set while a thread has the owner
+    static std::atomic<u32> s_owners_generation(0);
+
+    static u32 superalloc_take_owner()
+    {
+        for (u32 w = 0; w < 2; ++w)
+        {
+            u64 const beyond = (w == 0) ? 0 : ~(((u64)1 << (superalloc_t::c_owners_max - 64)) - 1);
+            u64       taken  = s_owners_taken[w].load();
+            while ((taken | beyond) != ~(u64)0)
+            {
+                s32 const bit = xfindFirstBit(~(taken | beyond));
+                if (s_owners_taken[w].compare_exchange_weak(taken, taken | ((u64)1 << bit)))
+                    return 1 + (w * 64) + (u32)bit;
+            }
+        }
+        return 0;
+    }
+
+    static void superalloc_give_owner(void* owner)
+    {
+        u32 const index = (u32)(uptr)owner - 1;
+        s_owners_taken[index / 64].fetch_and(~((u64)1 << (index & (64 - 1))));
+    }
+
+#if defined TARGET_LINUX || defined TARGET_MAC
+    static pthread_key_t superalloc_owner_key()
+    {
+        pthread_key_t key;
+        return (pthread_key_create(&key, superalloc_give_owner) == 0) ? key : (pthread_key_t)-1;
+    }
+#endif
+
+    // The owner of the thread-private chunks of the calling thread
+    static superowner_t const& superalloc_thread_owner()
+    {
+        static thread_local superowner_t t_owner = {0, 0};
+        if (t_owner.m_generation == 0)
+        {
+            t_owner.m_owner = superalloc_take_owner();
+            while (t_owner.m_generation == 0)
+                t_owner.m_generation = s_owners_generation.fetch_add(1) + 1;
+#if defined TARGET_LINUX || defined TARGET_MAC
+            static pthread_key_t const s_key = superalloc_owner_key();
+            if (t_owner.m_owner != 0 && s_key != (pthread_key_t)-1)
+                pthread_setspecific(s_key, (void*)(uptr)t_owner.m_owner);
+#endif
+        }
+        return t_owner;
+    }
+
+    struct supercpu_t;
+
     class superallocator_t
     {
     public:
@@ -1246,16 +2817,63 @@ namespace xcore
             , m_vmem(nullptr)
             , m_internal_heap()
             , m_internal_fsa()
+            , m_size_stats(nullptr)
+            , m_size_stats_count(0)
+            , m_owned_chunks(nullptr)
+            , m_owner_generations(nullptr)
+            , m_cache_coloring(false)
+            , m_color_next(0)
+            , m_commit_soft_limit(0)
+            , m_limit()
+            , m_pressure(nullptr)
+            , m_pressure_signaled(false)
+            , m_cpu(nullptr)
+            , m_cpu_stopped(0)
         {
         }
 
-        void  initialize(xvmem* vmem, superallocator_config_t const& config);
+        void  initialize(xvmem* vmem, superallocator_config_t const& config, u32 debug_mode);
         void  deinitialize();
+        void  rebind(xvmem* vmem);
         void* allocate(u32 size, u32 alignment);
+        void* allocate_zeroed(u32 size, u32 alignment);
         u32   deallocate(void* ptr);
+        void* allocate_from_bin(u32 binindex, u32 size, bool zero);
+        void* allocate_colored(u32 binindex, u32 size, u32 alignment, bool zero);
+        void* allocate_ring(u32& size);
+        void* reallocate(void* ptr, u32 size, u32 alignment);
+        void* reallocate_chunk(void* ptr, u32 size, u32 alignment);
+        void  deallocate_ring(void* ring);
+        void* debug_allocate(u32 size, u32 alignment);
+        void  debug_deallocate(void* ptr);
         void  set_assoc(void* ptr, u32 assoc);
         u32   get_assoc(void* ptr) const;
         u32   get_size(void* ptr) const;
+        u32   bin_of(void* ptr) const;
+        u32   compact(u32 occupancy_percentage, xvmem_compactor* compactor);
+        u32   prewarm(u32 size, u32 count, bool prefault);
+        u32   unpin(u32 size);
+        bool  walk(xvmem_walker* walker, bool validate);
+        void  capture_sizes();
+        u32   size_histogram(u32* sizes, u64* counts, u32 max_count) const;
+        void  thread_private_chunks();
+        void  release_thread();
+        void  disown(u32 owner);
+        u64   committed() const;
+        u64   flush();
+        u64   scavenge();
+        bool  commit_limits(u64 required);
+        void  cpu_stop();
+        void  cpu_start();
+
+        inline void record_size(u32 size)
+        {
+            if (m_size_stats != nullptr)
+            {
+                u32 const i = superbin_size2bin_fast(size, c_size_stats_shift);
+                m_size_stats[(i < m_size_stats_count) ? i : (m_size_stats_count - 1)] += 1;
+            }
+        }
 
         superallocator_config_t m_config;
         superchunks_t           m_chunks;
@@ -1263,26 +2881,74 @@ namespace xcore
         xvmem*                  m_vmem;
         superheap_t             m_internal_heap;
         superfsa_t              m_internal_fsa;
+        u32                     m_debug_mode;
+        u64*                    m_size_stats; // Number of requests per size, nullptr when not capturing
+        u32                     m_size_stats_count;
+        u32*                    m_owned_chunks;      // [owner - 1][bin], nullptr when the chunks are shared by all threads
+        u32*                    m_owner_generations; // [owner - 1], the generation of the thread that fills the chunks of the owner
+        bool                    m_cache_coloring; // Single allocation chunks place their allocation at a varying offset
+        u32                     m_color_next;
+        u64                     m_commit_soft_limit; // 0 is no limit
+        superlimit_t            m_limit; // The hard limit
+        xvmem_pressure*         m_pressure;
+        bool                    m_pressure_signaled; // The soft limit was crossed, cleared when we are below it again
+        supercpu_t*             m_cpu;               // The per-CPU caches in front of it, nullptr when there are none
+        u32                     m_cpu_stopped;       // The nesting of 'cpu_stop'
+
+        static const u32 c_debug_canary     = 0xFDFDFDFD;
+        static const u32 c_debug_freed      = 0xFEFEFEFE;
+        static const u32 c_size_stats_shift = 5;  // Requested sizes are recorded with a resolution of ~3%
+        static const u32 c_color_line       = 64; // Cache coloring step, the colors cycle through the cache lines of a page
     };
 
-    void superallocator_t::initialize(xvmem* vmem, superallocator_config_t const& config)
+    // A slot in a per-CPU cache is free but counts as allocated in its chunk. The caches are stopped and their slots are
+    // returned for the scope of a call that looks at the allocations or decommits memory, see supercpu_t::stop.
+    struct supercpu_pause_t
     {
-        m_config = config;
-        m_vmem   = vmem;
-        m_internal_heap.initialize(m_vmem, m_config.m_internal_heap_address_range, m_config.m_internal_heap_pre_size);
-        m_internal_fsa.initialize(m_internal_heap, m_vmem, m_config.m_internal_fsa_address_range, m_config.m_internal_fsa_pre_size);
-        m_chunks.initialize(vmem, config.m_address_range, &m_internal_heap, &m_internal_fsa);
+        supercpu_pause_t(superallocator_t& allocator, bool pause)
+            : m_allocator(pause ? &allocator : nullptr)
+        {
+            if (m_allocator != nullptr)
+                m_allocator->cpu_stop();
+        }
+        ~supercpu_pause_t()
+        {
+            if (m_allocator != nullptr)
+                m_allocator->cpu_start();
+        }
 
-        llhead_t* used_chunk_list_per_size = (llhead_t*)m_internal_heap.allocate(sizeof(llhead_t) * m_config.m_num_bins);
+        superallocator_t* m_allocator;
+    };
+
+    void superallocator_t::initialize(xvmem* vmem, superallocator_config_t const& config, u32 debug_mode)
+    {
+        m_config     = config;
+        m_vmem       = vmem;
+        m_debug_mode = debug_mode;
+        m_internal_heap.initialize(m_vmem, m_config.m_internal_heap_address_range, m_config.m_internal_heap_pre_size);
+        if (m_config.m_internal_fsa_address_range == 0)
+            m_config.m_internal_fsa_address_range = m_config.internal_fsa_range(xcountTrailingZeros(m_internal_heap.m_page_size));
+        m_internal_fsa.initialize(m_vmem, m_config.m_internal_fsa_address_range, m_config.m_internal_fsa_pre_size, m_debug_mode >= xvmem_config::DEBUG_POISON, &m_limit);
+        m_chunks.initialize(vmem, config.m_address_range, config.m_block_range, &m_internal_heap, &m_internal_fsa, m_debug_mode >= xvmem_config::DEBUG_POISON, &m_limit);
+        m_limit.m_heap   = &m_internal_heap;
+        m_limit.m_fsa    = &m_internal_fsa;
+        m_limit.m_chunks = &m_chunks;
+
+        superused_t* used_chunks_per_size = (superused_t*)m_internal_heap.allocate(sizeof(superused_t) * m_config.m_num_bins);
         for (s32 i = 0; i < m_config.m_num_bins; ++i)
         {
-            used_chunk_list_per_size[i].reset();
+            superused_t& used = used_chunks_per_size[i];
+            used.m_array              = superalloc_t::NIL;
+            used.m_capacity           = 0;
+            used.m_directory_capacity = 0;
+            for (u32 b = 0; b < superused_t::c_buckets; ++b)
+                used.m_bucket_end[b] = 0;
         }
 
         m_allocators = (superalloc_t*)m_internal_heap.allocate(sizeof(superalloc_t) * config.m_num_allocators);
         for (s32 i = 0; i < m_config.m_num_allocators; ++i)
         {
-            m_allocators[i] = superalloc_t(config.m_allocators[i], used_chunk_list_per_size);
+            m_allocators[i] = superalloc_t(config.m_allocators[i], used_chunks_per_size);
         }
 
         for (s32 i = 0; i < m_config.m_num_allocators; ++i)
@@ -1290,15 +2956,16 @@ namespace xcore
             m_allocators[i].initialize(&m_chunks, m_internal_heap, m_internal_fsa);
         }
 
-        u32 const bin_index2 = superallocator_config::size2bin(0xF0);
+        // A chunk and a block are a cache line each
+        ASSERT(sizeof(superalloc_t::chunk_t) == 64 && sizeof(superchunks_t::block_t) == 64);
 
         // sanity check on the superbin_t config
-#ifdef SUPERALLOC_DEBUG
+#ifdef TARGET_DEBUG
         for (s32 s = 0; s < m_config.m_num_bins; s++)
         {
             u32 const rs            = m_config.m_asbins[s].m_alloc_bin_index;
             u32 const size          = m_config.m_asbins[rs].m_alloc_size;
-            u32 const bin_index     = superallocator_config::size2bin(size);
+            u32 const bin_index     = m_config.size2bin(size);
             u32 const bin_reindex   = m_config.m_asbins[bin_index].m_alloc_bin_index;
             u32 const bin_allocsize = m_config.m_asbins[bin_reindex].m_alloc_size;
             ASSERT(size <= bin_allocsize);
@@ -1308,29 +2975,341 @@ namespace xcore
 
     void superallocator_t::deinitialize()
     {
-        m_internal_fsa.deinitialize(m_internal_heap);
-        m_internal_heap.deinitialize();
         m_chunks.deinitialize(m_internal_heap);
+        m_internal_fsa.deinitialize();
+        m_internal_heap.deinitialize();
         m_vmem = nullptr;
     }
 
+    // Points the bookkeeping at 'vmem', an allocator in shared memory is used through the xvmem of the calling process
+    void superallocator_t::rebind(xvmem* vmem)
+    {
+        m_vmem                 = vmem;
+        m_chunks.m_vmem        = vmem;
+        m_internal_heap.m_vmem = vmem;
+        m_internal_fsa.rebind(vmem);
+    }
+
     void* superallocator_t::allocate(u32 size, u32 alignment)
     {
-        size                 = xalignUp(size, alignment);
-        u32 const binindex   = m_config.m_asbins[superallocator_config::size2bin(size)].m_alloc_bin_index;
+        size = xalignUp(size, alignment);
+        record_size(size);
+        if (m_debug_mode != xvmem_config::DEBUG_OFF)
+            return debug_allocate(size, alignment);
+        u32 const binindex = m_config.m_asbins[m_config.size2bin(size)].m_alloc_bin_index;
+        if (m_cache_coloring && m_config.m_asbins[binindex].m_use_binmap == 0)
+            return allocate_colored(binindex, size, alignment, false);
+        return allocate_from_bin(binindex, size, false);
+    }
+
+    void* superallocator_t::allocate_zeroed(u32 size, u32 alignment)
+    {
+        size = xalignUp(size, alignment);
+        record_size(size);
+        if (m_debug_mode != xvmem_config::DEBUG_OFF)
+        {
+            void* ptr = debug_allocate(size, alignment);
+            if (ptr != nullptr)
+                x_memset(ptr, 0, size);
+            return ptr;
+        }
+        u32 const binindex = m_config.m_asbins[m_config.size2bin(size)].m_alloc_bin_index;
+        if (m_cache_coloring && m_config.m_asbins[binindex].m_use_binmap == 0)
+            return allocate_colored(binindex, size, alignment, true);
+        return allocate_from_bin(binindex, size, true);
+    }
+
+    void* superallocator_t::allocate_from_bin(u32 binindex, u32 size, bool zero)
+    {
         s32 const allocindex = m_config.m_asbins[binindex].m_alloc_index;
         ASSERT(size <= m_config.m_asbins[binindex].m_alloc_size);
         ASSERT(m_config.m_asbins[binindex].m_alloc_bin_index == binindex);
-        void* ptr = m_allocators[allocindex].allocate(m_internal_fsa, size, m_config.m_asbins[binindex]);
-        ASSERT(ptr >= m_chunks.m_address_base && ptr < ((xbyte*)m_chunks.m_address_base + m_chunks.m_address_range));
+        u32 owner = 0;
+        if (m_owned_chunks != nullptr && m_config.m_asbins[binindex].m_use_binmap == 1)
+        {
+            superowner_t const& thread = superalloc_thread_owner();
+            owner                      = thread.m_owner;
+            if (owner != 0 && m_owner_generations[owner - 1] != thread.m_generation)
+            {
+                // The chunks of the thread that had this owner before are shared, this thread fills its own
+                disown(owner);
+                m_owner_generations[owner - 1] = thread.m_generation;
+            }
+        }
+        if ((m_commit_soft_limit | m_limit.m_hard_limit) != 0 && m_allocators[allocindex].needs_chunk(m_config.m_asbins[binindex], owner))
+        {
+            u64 const required = (u64)m_chunks.chunk_physical_pages(m_config.m_asbins[binindex], size) << m_chunks.m_page_shift;
+            if (!commit_limits(required))
+                return nullptr;
+        }
+        void* ptr = m_allocators[allocindex].allocate(m_internal_fsa, size, m_config.m_asbins[binindex], zero, owner);
+        ASSERT(ptr == nullptr || (ptr >= m_chunks.m_address_base && ptr < ((xbyte*)m_chunks.m_address_base + m_chunks.m_address_range)));
+        return ptr;
+    }
+
+    // The committed bytes, of the chunks as well as of the internal heap and fsa
+    u64 superallocator_t::committed() const { return m_chunks.committed() + m_internal_fsa.committed() + m_internal_heap.committed(); }
+
+    // Decommits the cached chunks, the free pages of the used chunks and the page cache of the internal fsa, returns the number of bytes
+    u64 superallocator_t::flush()
+    {
+        supercpu_pause_t const pause(*this, true);
+        u64 const              chunk_pages = m_chunks.flush_cached();
+        u64 const              fsa_pages   = m_internal_fsa.flush();
+        return (chunk_pages << m_chunks.m_page_shift) + fsa_pages * m_internal_fsa.pagesize() + scavenge();
+    }
+
+    // Decommits the pages inside the partially used chunks that have no allocation on them, returns the number of bytes
+    u64 superallocator_t::scavenge()
+    {
+        supercpu_pause_t const pause(*this, true);
+        u64                    pages = 0;
+        for (s32 b = 0; b < m_config.m_num_bins; ++b)
+        {
+            superbin_t const& bin = m_config.m_asbins[b];
+            if (bin.m_alloc_bin_index != (u32)b)
+                continue;
+            pages += m_allocators[bin.m_alloc_index].scavenge(m_internal_fsa, bin);
+        }
+        return pages << m_chunks.m_page_shift;
+    }
+
+    // Called before a chunk of 'required' bytes is checked out. At the soft limit the caches are flushed and the pressure
+    // callback is invoked once, at the hard limit this is done for every request and it fails when that did not help.
+    // The commits themselves are checked against the hard limit by 'm_limit', this is where memory is made available.
+    bool superallocator_t::commit_limits(u64 required)
+    {
+        u64 committed = this->committed();
+        if (m_limit.m_hard_limit != 0 && (committed + required) > m_limit.m_hard_limit)
+        {
+            flush();
+            if (m_pressure != nullptr)
+                m_pressure->pressure(committed, m_limit.m_hard_limit);
+            committed = this->committed();
+            if ((committed + required) > m_limit.m_hard_limit)
+                return false;
+        }
+        if (m_commit_soft_limit != 0)
+        {
+            if ((committed + required) <= m_commit_soft_limit)
+            {
+                m_pressure_signaled = false;
+            }
+            else if (!m_pressure_signaled)
+            {
+                m_pressure_signaled = true;
+                flush();
+                if (m_pressure != nullptr)
+                    m_pressure->pressure(committed, m_commit_soft_limit);
+            }
+        }
+        return true;
+    }
+
+    // Cache coloring, a single allocation chunk is aligned to its (power-of-2) chunk size so large buffers would all
+    // start in the same cache sets. The allocation is placed at an offset that cycles through the cache lines of a
+    // page, costing at most one extra committed page. Allocations with an alignment above a cache line are not moved.
+    void* superallocator_t::allocate_colored(u32 binindex, u32 size, u32 alignment, bool zero)
+    {
+        u32 const max_size = m_config.m_asbins[m_config.m_num_bins - 1].m_alloc_size;
+        u32 const color    = m_color_next;
+        m_color_next       = (m_color_next + c_color_line) & (m_chunks.m_page_size - 1);
+        if (alignment > c_color_line || color == 0 || size > (max_size - color))
+            return allocate_from_bin(binindex, size, zero);
+
+        u32 const              colored    = m_config.m_asbins[m_config.size2bin(size + color)].m_alloc_bin_index;
+        xbyte* const           ptr        = (xbyte*)allocate_from_bin(colored, size + color, zero);
+        if (ptr == nullptr)
+            return nullptr;
+        u32 const              page_index = m_chunks.address_to_page_index(ptr);
+        superchunks_t::chain_t chain      = m_chunks.page_index_to_chunk_info(page_index);
+        superalloc_t::chunk_t* chunk      = (superalloc_t::chunk_t*)m_internal_fsa.idx2ptr(chain.m_chunk_index);
+        chunk->m_occupancy.m_pages.m_color = color;
+        return ptr + color;
+    }
+
+    void* superallocator_t::reallocate(void* ptr, u32 size, u32 alignment)
+    {
+        if (ptr == nullptr)
+            return allocate(size, alignment);
+        u32 const old_size = get_size(ptr);
+        if (m_debug_mode == xvmem_config::DEBUG_OFF)
+        {
+            if (size <= old_size)
+                return ptr;
+            void* const moved = reallocate_chunk(ptr, size, alignment);
+            if (moved != nullptr)
+                return moved;
+        }
+        // In a debug mode the canary follows the requested size, so the allocation is always moved
+        void* const new_ptr = allocate(size, alignment);
+        if (new_ptr != nullptr)
+        {
+            x_memcpy(new_ptr, ptr, (old_size < size) ? old_size : size);
+            deallocate(ptr);
+        }
+        return new_ptr;
+    }
+
+    // A single allocation is grown without copying it. When its chunk is large enough more pages are committed in place,
+    // otherwise a chunk of the larger size is checked out and the xvmem moves the committed pages there (remap), copying
+    // only when it cannot do that. Returns nullptr when the allocation or the new size has no chunk of its own.
+    void* superallocator_t::reallocate_chunk(void* ptr, u32 size, u32 alignment)
+    {
+        size                             = xalignUp(size, alignment);
+        u32 const              max_size  = m_config.m_asbins[m_config.m_num_bins - 1].m_alloc_size;
+        u32 const              page_index = m_chunks.address_to_page_index(ptr);
+        superchunks_t::chain_t chain      = m_chunks.page_index_to_chunk_info(page_index);
+        superalloc_t::chunk_t* chunk      = (superalloc_t::chunk_t*)m_internal_fsa.idx2ptr(chain.m_chunk_index);
+        superbin_t const&      old_bin    = m_config.m_asbins[chunk->m_bin_index];
+        if (size > max_size || old_bin.m_use_binmap == 1 || chunk->m_pinned == 1 || chunk->m_occupancy.m_pages.m_color != 0)
+            return nullptr;
+        u32 const         binindex = m_config.m_asbins[m_config.size2bin(size)].m_alloc_bin_index;
+        superbin_t const& bin      = m_config.m_asbins[binindex];
+        if (bin.m_use_binmap == 1)
+            return nullptr;
+
+        u32 const old_pages = chunk->m_occupancy.m_pages.m_physical_pages;
+        u32 const pages     = m_chunks.chunk_physical_pages(bin, size);
+        if (bin.m_alloc_index == old_bin.m_alloc_index)
+        {
+            // The chunk has room, the allocation moves to the bin of the new size
+            if ((m_commit_soft_limit | m_limit.m_hard_limit) != 0 && !commit_limits((u64)(pages - old_pages) << m_chunks.m_page_shift))
+                return nullptr;
+            if (!m_chunks.grow_chunk(chain, pages))
+                return nullptr;
+            chunk->m_bin_index                          = binindex;
+            chunk->m_occupancy.m_pages.m_physical_pages = pages;
+            if (pages > chunk->m_elem_hwm)
+                chunk->m_elem_hwm = pages;
+            return ptr;
+        }
+
+        void* const new_ptr = allocate_from_bin(binindex, size, false);
+        if (new_ptr == nullptr)
+            return nullptr;
+        if (m_vmem->remap(ptr, new_ptr, m_chunks.m_page_size, old_pages))
+            m_chunks.set_chunk_moved(chain);
+        else
+            x_memcpy(new_ptr, ptr, (u64)old_pages << m_chunks.m_page_shift);
+        deallocate(ptr);
+        return new_ptr;
+    }
+
+    // A ring buffer is a single allocation chunk of twice its size (so it starts at the chunk), the pages are committed
+    // and then mapped twice by the xvmem. The allocator counts them twice.
+    void* superallocator_t::allocate_ring(u32& size)
+    {
+        u32 const max_size = m_config.m_asbins[m_config.m_num_bins - 1].m_alloc_size;
+        size               = (size < m_chunks.m_page_size) ? m_chunks.m_page_size : size;
+        if (m_debug_mode != xvmem_config::DEBUG_OFF || size > (max_size / 2))
+            return nullptr;
+        size = xceilpo2(size);
+        if (size > (max_size / 2))
+            return nullptr;
+        u32 const binindex = m_config.m_asbins[m_config.size2bin(size * 2)].m_alloc_bin_index;
+        if (m_config.m_asbins[binindex].m_use_binmap == 1)
+            return nullptr;
+
+        void* const ring = allocate_from_bin(binindex, size * 2, false);
+        if (ring == nullptr)
+            return nullptr;
+        if (!m_vmem->commit_mirrored(ring, m_chunks.m_page_size, size >> m_chunks.m_page_shift))
+        {
+            deallocate_ring(ring);
+            return nullptr;
+        }
+        return ring;
+    }
+
+    // The pages are committed again as ordinary pages, the chunk is released with the pages that it has committed. When
+    // the xvmem fails the pages are decommitted and the chunk is released without them.
+    void superallocator_t::deallocate_ring(void* ring)
+    {
+        if (ring == nullptr)
+            return;
+        u32 const pages = get_size(ring) >> m_chunks.m_page_shift;
+        if (!m_vmem->commit(ring, m_chunks.m_page_size, pages))
+        {
+            m_vmem->decommit(ring, m_chunks.m_page_size, pages);
+            m_chunks.set_chunk_moved(m_chunks.page_index_to_chunk_info(m_chunks.address_to_page_index(ring)));
+        }
+        deallocate(ring);
+    }
+
+    // Debug modes (see xvmem_config), the layout of the allocations only changes when a debug mode is active:
+    // - canary: every allocation is one u32 larger, the last u32 of the slot holds the requested size and the bytes from
+    //           the requested size up to that u32 hold the canary, so an overrun into the size class padding is caught
+    // - poison: a new allocation is filled with 0xCD, a freed allocation with 0xFE, binmap chunks are poisoned
+    //           when checked out and a binmap slot is verified to be untouched when it is handed out
+    // - guard:  a single allocation chunk is taken from the bin of 'size + page size' but only the pages for
+    //           'size' are committed, the allocation is placed at the end of those pages, flush against the
+    //           decommitted page that follows
+    void* superallocator_t::debug_allocate(u32 size, u32 alignment)
+    {
+        u32 binindex = m_config.m_asbins[m_config.size2bin(size)].m_alloc_bin_index;
+        if (m_debug_mode >= xvmem_config::DEBUG_GUARD && m_config.m_asbins[binindex].m_use_binmap == 0)
+        {
+            u32 const guarded = m_config.m_asbins[m_config.size2bin(size + m_chunks.m_page_size)].m_alloc_bin_index;
+            xbyte*    ptr     = (xbyte*)allocate_from_bin(guarded, size, false);
+            if (ptr == nullptr)
+                return nullptr;
+            u32 const end     = xalignUp(size, m_chunks.m_page_size);
+            return (void*)((uptr)(ptr + end - size) & ~(uptr)(alignment - 1));
+        }
+
+        u32 const requested = size;
+        size += sizeof(u32);
+        binindex        = m_config.m_asbins[m_config.size2bin(size)].m_alloc_bin_index;
+        xbyte*    ptr   = (xbyte*)allocate_from_bin(binindex, size, false);
+        if (ptr == nullptr)
+            return nullptr;
+        u32 const slot  = get_size(ptr);
+        u32*      words = (u32*)ptr;
+        if (m_debug_mode >= xvmem_config::DEBUG_POISON)
+        {
+            // Check for writes after free, every free binmap slot is poisoned. The pages of a single allocation
+            // chunk may have been decommitted and committed again, so those cannot be checked.
+            if (m_config.m_asbins[binindex].m_use_binmap == 1)
+            {
+                for (u32 i = 0; i < (slot / sizeof(u32)); ++i)
+                    ASSERT(words[i] == c_debug_freed);
+            }
+            x_memset(ptr, 0xCDCDCDCD, slot);
+        }
+        u32 const tracking = slot - sizeof(u32);
+        for (u32 i = requested; i < tracking; ++i)
+            ptr[i] = (xbyte)c_debug_canary;
+        words[tracking / sizeof(u32)] = requested;
         return ptr;
     }
 
+    void superallocator_t::debug_deallocate(void* ptr)
+    {
+        u32 const              page_index = m_chunks.address_to_page_index(ptr);
+        superchunks_t::chain_t chain      = m_chunks.page_index_to_chunk_info(page_index);
+        superalloc_t::chunk_t* chunk      = (superalloc_t::chunk_t*)m_internal_fsa.idx2ptr(chain.m_chunk_index);
+        if (m_debug_mode >= xvmem_config::DEBUG_GUARD && m_config.m_asbins[chunk->m_bin_index].m_use_binmap == 0)
+            return;
+
+        u32 const    slot      = get_size(ptr);
+        u32 const    tracking  = slot - sizeof(u32);
+        xbyte const* bytes     = (xbyte const*)ptr;
+        u32 const    requested = ((u32 const*)ptr)[tracking / sizeof(u32)];
+        ASSERT(requested <= tracking); // Buffer overrun
+        for (u32 i = requested; i < tracking; ++i)
+            ASSERT(bytes[i] == (xbyte)c_debug_canary); // Buffer overrun
+        if (m_debug_mode >= xvmem_config::DEBUG_POISON)
+            x_memset(ptr, c_debug_freed, slot);
+    }
+
     u32 superallocator_t::deallocate(void* ptr)
     {
         if (ptr == nullptr)
             return 0;
         ASSERT(ptr >= m_chunks.m_address_base && ptr < ((xbyte*)m_chunks.m_address_base + m_chunks.m_address_range));
+        if (m_debug_mode != xvmem_config::DEBUG_OFF)
+            debug_deallocate(ptr);
         u32 const              page_index = m_chunks.address_to_page_index(ptr);
         superchunks_t::chain_t chain      = m_chunks.page_index_to_chunk_info(page_index);
         superalloc_t::chunk_t* chunk      = (superalloc_t::chunk_t*)m_internal_fsa.idx2ptr(chain.m_chunk_index);
@@ -1343,7 +3322,7 @@ namespace xcore
 
     void  superallocator_t::set_assoc(void* ptr, u32 assoc)
     {
-        if (ptr == nullptr)
+        if (ptr != nullptr)
         {
             ASSERT(ptr >= m_chunks.m_address_base && ptr < ((xbyte*)m_chunks.m_address_base + m_chunks.m_address_range));
             u32 const              page_index = m_chunks.address_to_page_index(ptr);
@@ -1383,7 +3362,1013 @@ namespace xcore
         else
         {
             superchunks_t::block_t* block = m_chunks.get_block_from_index(chain.m_block_index);
-            return block->m_chunks_physical_pages[chain.m_block_chunk_index] * m_chunks.m_page_size;
+            return block->m_chunks_physical_pages[chain.m_block_chunk_index] * m_chunks.m_page_size - chunk->m_occupancy.m_pages.m_color;
+        }
+    }
+
+    u32 superallocator_t::bin_of(void* ptr) const
+    {
+        u32 const              page_index = m_chunks.address_to_page_index(ptr);
+        superchunks_t::chain_t chain      = m_chunks.page_index_to_chunk_info(page_index);
+        superalloc_t::chunk_t* chunk      = (superalloc_t::chunk_t*)m_internal_fsa.idx2ptr(chain.m_chunk_index);
+        return chunk->m_bin_index;
+    }
+
+    // The per-CPU caches stay stopped while the allocations are relocated, a deallocated slot has to go back to its chunk
+    u32 superallocator_t::compact(u32 occupancy_percentage, xvmem_compactor* compactor)
+    {
+        supercpu_pause_t const pause(*this, true);
+        u32                    released = 0;
+        for (s32 b = 0; b < m_config.m_num_bins; ++b)
+        {
+            superbin_t const& bin = m_config.m_asbins[b];
+            if (bin.m_alloc_bin_index != (u32)b)
+                continue;
+            released += m_allocators[bin.m_alloc_index].compact(m_internal_fsa, bin, occupancy_percentage, compactor);
+        }
+        return released;
+    }
+
+    u32 superallocator_t::prewarm(u32 size, u32 count, bool prefault)
+    {
+        u32 const         binindex = m_config.m_asbins[m_config.size2bin(size)].m_alloc_bin_index;
+        superbin_t const& bin      = m_config.m_asbins[binindex];
+        u32 const         chunks   = m_allocators[bin.m_alloc_index].prewarm(m_internal_fsa, bin, count, prefault);
+
+        // The bookkeeping of new chunks comes from the internal fsa, fill up its cache of committed pages
+        m_internal_fsa.prewarm(prefault);
+        return chunks;
+    }
+
+    u32 superallocator_t::unpin(u32 size)
+    {
+        u32 const         binindex = m_config.m_asbins[m_config.size2bin(size)].m_alloc_bin_index;
+        superbin_t const& bin      = m_config.m_asbins[binindex];
+        return m_allocators[bin.m_alloc_index].unpin(m_internal_fsa, bin);
+    }
+
+    void superallocator_t::capture_sizes()
+    {
+        u32 const max_size = m_config.m_asbins[m_config.m_num_bins - 1].m_alloc_size;
+        m_size_stats_count = superbin_size2bin_fast(max_size, c_size_stats_shift) + 1;
+        m_size_stats       = (u64*)m_internal_heap.allocate(sizeof(u64) * m_size_stats_count);
+        for (u32 i = 0; i < m_size_stats_count; ++i)
+            m_size_stats[i] = 0;
+    }
+
+    // Thread-private chunks, every thread fills its own chunk per bin, see superalloc_t::allocate
+    void superallocator_t::thread_private_chunks()
+    {
+        u32 const count = superalloc_t::c_owners_max * m_config.m_num_bins;
+        m_owned_chunks  = (u32*)m_internal_heap.allocate(sizeof(u32) * count);
+        for (u32 i = 0; i < count; ++i)
+            m_owned_chunks[i] = superalloc_t::NIL;
+        m_owner_generations = (u32*)m_internal_heap.allocate(sizeof(u32) * superalloc_t::c_owners_max);
+        for (u32 i = 0; i < superalloc_t::c_owners_max; ++i)
+            m_owner_generations[i] = 0;
+        for (s32 i = 0; i < m_config.m_num_allocators; ++i)
+        {
+            m_allocators[i].m_owned_chunks = m_owned_chunks;
+            m_allocators[i].m_num_bins     = m_config.m_num_bins;
+        }
+    }
+
+    // Shares the chunks that the calling thread is filling with the other threads again
+    void superallocator_t::release_thread()
+    {
+        if (m_owned_chunks == nullptr)
+            return;
+        u32 const owner = superalloc_thread_owner().m_owner;
+        if (owner != 0)
+            disown(owner);
+    }
+
+    // Shares the chunks that 'owner' is filling with the other threads again
+    void superallocator_t::disown(u32 owner)
+    {
+        for (s32 b = 0; b < m_config.m_num_bins; ++b)
+        {
+            superbin_t const& bin = m_config.m_asbins[b];
+            if (bin.m_alloc_bin_index != (u32)b || bin.m_use_binmap == 0)
+                continue;
+            m_allocators[bin.m_alloc_index].disown(m_internal_fsa, bin, owner);
+        }
+    }
+
+    // The recorded sizes are rounded up to the size classes of a table with a bin shift of 'c_size_stats_shift'
+    u32 superallocator_t::size_histogram(u32* sizes, u64* counts, u32 max_count) const
+    {
+        u32 n = 0;
+        for (u32 i = 0; i < m_size_stats_count && n < max_count; ++i)
+        {
+            if (m_size_stats[i] == 0)
+                continue;
+            sizes[n]  = superbin_bin2size(i, c_size_stats_shift);
+            counts[n] = m_size_stats[i];
+            n += 1;
+        }
+        return n;
+    }
+
+    // Visits all live allocations in address order, blocks and chunks that are not used are skipped through
+    // the block's free-chunk binmap and every chunk stops scanning its binmap after 'm_elem_used' allocations.
+    // With 'validate' all bookkeeping data is checked before it is used, the walk then never asserts, never
+    // allocates and stops (returning false) at the first inconsistency, e.g. when called from a signal handler.
+    bool superallocator_t::walk(xvmem_walker* walker, bool validate)
+    {
+        supercpu_pause_t const pause(*this, !validate); // A paused allocator does not lock, its caches are left as they are
+        for (u32 bi = 0; bi < m_chunks.m_blocks_never_used; ++bi)
+        {
+            superchunks_t::block_t const* block = m_chunks.get_block_from_index(bi);
+            if (block->m_chunks_used == 0)
+                continue;
+            if (validate && (block->m_config_index >= superchunks_t::c_num_configs || m_chunks.c_configs[block->m_config_index].m_chunks_max < block->m_chunks_used))
+                return false;
+
+            superchunks_t::config_t const& config = m_chunks.c_configs[block->m_config_index];
+            if (validate && !m_internal_fsa.is_valid(block->m_binmap_chunks_free))
+                return false;
+
+            // Chunks that were never checked out from the free binmap are skipped
+            u16 *           fl1, *fl2;
+            binmap_t const* bmfree = m_chunks.get_binmap_by_index(block->m_binmap_chunks_free, config, fl1, fl2);
+            u32             found  = 0;
+            for (s32 ci = bmfree->next(config.m_chunks_max, fl2, 0); ci >= 0 && found < block->m_chunks_used; ci = bmfree->next(config.m_chunks_max, fl2, ci + 1))
+            {
+                u32 const chunk_index = block->m_chunks_array[ci];
+                if (chunk_index == 0xffffffff) // A cached chunk
+                    continue;
+                found += 1;
+
+                u32 const tracking_index = block->m_chunks_alloc_tracking_array[ci];
+                if (validate && (!m_internal_fsa.is_valid(chunk_index) || !m_internal_fsa.is_valid(tracking_index)))
+                    return false;
+
+                superalloc_t::chunk_t* chunk        = (superalloc_t::chunk_t*)m_internal_fsa.idx2ptr(chunk_index);
+                void* const            chunkaddress = m_chunks.block_chunk_address(bi, ci, config);
+                if (validate && (chunk->m_bin_index >= (u32)m_config.m_num_bins || m_chunks.page_index_to_address(chunk->m_page_index) != chunkaddress))
+                    return false;
+
+                superbin_t const& bin      = m_config.m_asbins[chunk->m_bin_index];
+                u32 const*        tracking = (u32 const*)m_internal_fsa.idx2ptr(tracking_index);
+                if (validate && chunk->m_elem_used > bin.m_alloc_count)
+                    return false;
+
+                if (bin.m_use_binmap == 0)
+                {
+                    u32 const size  = block->m_chunks_physical_pages[ci] * m_chunks.m_page_size;
+                    u32 const color = chunk->m_occupancy.m_pages.m_color;
+                    if (validate && color >= size)
+                        return false;
+                    if (!walker->allocation(toaddress(chunkaddress, color), size - color, tracking[0]))
+                        return true;
+                    continue;
+                }
+
+                if (validate && bin.m_alloc_count > 32 && !m_internal_fsa.is_valid(chunk->m_occupancy.m_binmap.m_l2_offset))
+                    return false;
+                if (validate && chunk->m_extension != superfsa_t::NIL && !m_internal_fsa.is_valid(chunk->m_extension))
+                    return false;
+                if (validate && chunk->m_free_count > superalloc_t::c_free_stack_size)
+                    return false;
+
+                u16 *     l1, *l2;
+                binmap_t* bm = m_allocators[bin.m_alloc_index].get_chunk_binmap(m_internal_fsa, chunk, bin, l1, l2);
+                u32       n  = 0;
+                for (s32 i = bm->next(bin.m_alloc_count, l2, 0); i >= 0 && n < chunk->m_elem_used; i = bm->next(bin.m_alloc_count, l2, i + 1))
+                {
+                    if (superalloc_t::is_on_free_stack(chunk, i))
+                        continue;
+                    n += 1;
+                    if (!walker->allocation(toaddress(chunkaddress, (u64)i * bin.m_alloc_size), bin.m_alloc_size, tracking[i]))
+                        return true;
+                }
+            }
+        }
+        return true;
+    }
+
+    // The parameters of the built-in bin table with a different bin shift, 0 is the built-in bin shift
+    static superbin_params_t superbin_params(u32 bin_shift)
+    {
+        superbin_params_t const builtin = superallocator_config::bins_t::params();
+        u32 const               shift   = (bin_shift == 0) ? builtin.m_bin_shift : bin_shift;
+        ASSERT(shift >= 2 && shift <= 4);
+        return superbin_params_t(shift, builtin.m_min_size, builtin.m_size_alignment, (((u32)2 << shift) - 1) << (28 - shift), builtin.m_page_shift, builtin.m_chunk_shift_min, builtin.m_chunk_shift_max, builtin.m_chunk_waste);
+    }
+
+    // A mutex in shared memory that serializes the processes using a shared allocator. It is robust on Linux, when
+    // a process dies while holding it the next one takes it over and is told so by 'lock'. It is recursive, the
+    // callbacks of the allocator (compactor, pressure) call into it again, 'm_depth' counts the nested calls.
+    struct superlock_t
+    {
+#if defined TARGET_LINUX || defined TARGET_MAC
+        // A process shared mutex is robust, a process may die while it holds it
+        void initialize(bool process_shared)
+        {
+            m_depth = 0;
+            pthread_mutexattr_t attr;
+            pthread_mutexattr_init(&attr);
+            pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_RECURSIVE);
+            if (process_shared)
+            {
+                pthread_mutexattr_setpshared(&attr, PTHREAD_PROCESS_SHARED);
+#if defined TARGET_LINUX
+                pthread_mutexattr_setrobust(&attr, PTHREAD_MUTEX_ROBUST);
+#endif
+            }
+            pthread_mutex_init(&m_mutex, &attr);
+            pthread_mutexattr_destroy(&attr);
+        }
+
+        // Returns false when the previous owner died while holding it, the mutex is made consistent and is held
+        bool lock()
+        {
+#if defined TARGET_LINUX
+            if (pthread_mutex_lock(&m_mutex) == EOWNERDEAD)
+            {
+                pthread_mutex_consistent(&m_mutex);
+                m_depth = 1; // The calls of the owner that died are gone
+                return false;
+            }
+#else
+            pthread_mutex_lock(&m_mutex);
+#endif
+            m_depth += 1;
+            return true;
+        }
+
+        void unlock()
+        {
+            m_depth -= 1;
+            pthread_mutex_unlock(&m_mutex);
+        }
+
+        pthread_mutex_t m_mutex;
+#else
+        void initialize(bool process_shared) { m_depth = 0; }
+        bool lock()
+        {
+            m_depth += 1;
+            return true;
         }
+        void unlock() { m_depth -= 1; }
+#endif
+        u32 m_depth; // 1 for the outer call, more when a callback calls into the allocator
+    };
+
+    // The root block of an allocator in shared memory (xvmem_shared), the first process creates it and the others attach
+    // to it. All bookkeeping is addressed by fsa indices or by pointers into the shared memory, which is mapped at the
+    // same address in every process, only the xvmem pointers differ per process and are rebound under the lock.
+    // A persistent heap is attached to again after a restart, when the layout and version match.
+    struct supershared_t
+    {
+        static const u32 c_version    = 5;       // Bump when the layout or the meaning of the bookkeeping changes
+        static const u32 c_wait_spins = 1 << 24; // Attaching gives up when the creator has not stored its pid by then
+
+        enum
+        {
+            STATE_NONE         = 0,
+            STATE_INITIALIZING = 1,
+            STATE_READY        = 2,
+        };
+
+        std::atomic<u32> m_state;
+        std::atomic<u32> m_creator; // The pid of the process that is initializing it, 0 until it has stored it
+        u32              m_layout;  // sizeof(supershared_t), attaching from a different build fails
+        u32              m_version; // c_version
+        u32              m_busy;    // A call is in progress, the bookkeeping may be inconsistent
+        u32              m_poisoned; // A process died in the middle of a call, every call fails from then on
+        void*            m_root;    // For the application, e.g. the root of its data structures
+        superlock_t      m_lock;
+        superallocator_t m_allocator;
+        u64              m_bins[(sizeof(superbin_t) * c_superbin_max_bins + sizeof(u64) - 1) / sizeof(u64)]; // superbin_t[]
+
+        // Waits for another process to finish the initialization, false when that process died before it was done
+        bool wait_until_ready() const
+        {
+            for (u32 spins = 0; m_state.load() != STATE_READY; ++spins)
+            {
+                if ((spins & 63) != 63)
+                {
+#if defined __x86_64__ || defined __i386__
+                    __builtin_ia32_pause();
+#endif
+                    continue;
+                }
+#if defined TARGET_LINUX || defined TARGET_MAC
+                sched_yield();
+                pid_t const creator = (pid_t)m_creator.load();
+                if (creator == 0 ? spins >= c_wait_spins : (kill(creator, 0) != 0 && errno == ESRCH))
+                    return false;
+#endif
+            }
+            return true;
+        }
+    };
+
+    // Per-CPU slot caches of the small bins, see xvmem_config::m_per_cpu_caches. A thread pushes and pops the slots of the
+    // CPU that it runs on in a restartable sequence (rseq, x86-64): the kernel sends the thread to the abort handler when
+    // it is preempted, migrated or signaled before the final store that commits the change, the sequence then starts
+    // again on the CPU it runs on now. So the caches need no atomics and no lock, their memory scales with the number of
+    // CPUs and not with the number of threads.
+    // The caches of all CPUs are drained by one thread while it holds the lock: 'stop' clears 'm_active_cpus', which a
+    // sequence reads before it touches a cache, and has the kernel restart every sequence that is in flight (membarrier,
+    // Linux 5.10). A sequence that runs again sees no CPU and takes the slow path, which waits for the lock.
+    struct supercpu_t
+    {
+        static const u32 c_slots    = 31;   // A cache is 256 bytes
+        static const u32 c_max_size = 1024; // The bins up to this size are cached
+
+        struct cache_t
+        {
+            u64   m_count;
+            void* m_slots[c_slots];
+        };
+
+        supercpu_t()
+            : m_caches(nullptr)
+            , m_num_cpus(0)
+            , m_active_cpus(0)
+            , m_num_bins(0)
+        {
+        }
+
+        cache_t* m_caches; // [cpu][bin]
+        u32      m_num_cpus;
+        u32      m_active_cpus; // 'm_num_cpus' while the caches are in use, 0 while they are stopped
+        u32      m_num_bins;    // The bins below this index are cached
+
+        // Stops the caches and returns their slots to 'allocator', the caller holds the lock
+        void stop(superallocator_t& allocator)
+        {
+            m_active_cpus = 0;
+            restart_sequences();
+            for (u32 i = 0; i < (m_num_cpus * m_num_bins); ++i)
+            {
+                cache_t& cache = m_caches[i];
+                for (u64 s = 0; s < cache.m_count; ++s)
+                    allocator.deallocate(cache.m_slots[s]);
+                cache.m_count = 0;
+            }
+        }
+
+        void start() { m_active_cpus = m_num_cpus; }
+
+#if defined XVMEM_RSEQ
+        // The process registers for the restart of its sequences, without it the caches cannot be drained
+        static inline bool supported() { return __rseq_size != 0 && syscall(__NR_membarrier, MEMBARRIER_CMD_REGISTER_PRIVATE_EXPEDITED_RSEQ, 0, 0) == 0; }
+
+        static inline void restart_sequences() { syscall(__NR_membarrier, MEMBARRIER_CMD_PRIVATE_EXPEDITED_RSEQ, 0, 0); }
+
+        // Returns nullptr when the cache of 'bin' of this CPU is empty
+        inline void* pop(u32 bin) const
+        {
+            struct rseq* const rs     = (struct rseq*)((xbyte*)__builtin_thread_pointer() + __rseq_offset);
+            u64 const          stride = (u64)m_num_bins * sizeof(cache_t);
+            void*              ptr;
+            __asm__ __volatile__(".pushsection __rseq_cs, \"aw\"\n\t"
+                                 ".balign 32\n\t"
+                                 "3:\n\t"
+                                 ".long 0x0, 0x0\n\t"
+                                 ".quad 1f, (2f - 1f), 4f\n\t"
+                                 ".popsection\n\t"
+                                 "0:\n\t"
+                                 "leaq 3b(%%rip), %%rax\n\t"
+                                 "movq %%rax, %c[cs](%[rs])\n\t"
+                                 "1:\n\t"
+                                 "movl %c[cpu](%[rs]), %%eax\n\t"
+                                 "cmpl %[cpus], %%eax\n\t"
+                                 "jae 5f\n\t"
+                                 "imulq %[stride], %%rax\n\t"
+                                 "addq %[caches], %%rax\n\t"
+                                 "movq (%%rax), %%rcx\n\t"
+                                 "testq %%rcx, %%rcx\n\t"
+                                 "jz 5f\n\t"
+                                 "movq (%%rax, %%rcx, 8), %[ptr]\n\t"
+                                 "decq %%rcx\n\t"
+                                 "movq %%rcx, (%%rax)\n\t"
+                                 "2:\n\t"
+                                 "jmp 6f\n\t"
+                                 ".pushsection __rseq_failure, \"ax\"\n\t"
+                                 ".long 0x53053053\n\t" // RSEQ_SIG, in front of the abort handler
+                                 "4:\n\t"
+                                 "jmp 0b\n\t"
+                                 ".popsection\n\t"
+                                 "5:\n\t"
+                                 "xorl %k[ptr], %k[ptr]\n\t"
+                                 "6:\n\t"
+                                 : [ptr] "=&r"(ptr)
+                                 : [rs] "r"(rs), [caches] "r"(m_caches + bin), [stride] "r"(stride), [cpus] "m"(m_active_cpus), [cs] "i"(offsetof(struct rseq, rseq_cs)), [cpu] "i"(offsetof(struct rseq, cpu_id))
+                                 : "rax", "rcx", "memory", "cc");
+            return ptr;
+        }
+
+        // Returns false when the cache of 'bin' of this CPU is full
+        inline bool push(u32 bin, void* ptr) const
+        {
+            struct rseq* const rs     = (struct rseq*)((xbyte*)__builtin_thread_pointer() + __rseq_offset);
+            u64 const          stride = (u64)m_num_bins * sizeof(cache_t);
+            u32                pushed;
+            __asm__ __volatile__(".pushsection __rseq_cs, \"aw\"\n\t"
+                                 ".balign 32\n\t"
+                                 "3:\n\t"
+                                 ".long 0x0, 0x0\n\t"
+                                 ".quad 1f, (2f - 1f), 4f\n\t"
+                                 ".popsection\n\t"
+                                 "0:\n\t"
+                                 "leaq 3b(%%rip), %%rax\n\t"
+                                 "movq %%rax, %c[cs](%[rs])\n\t"
+                                 "1:\n\t"
+                                 "movl %c[cpu](%[rs]), %%eax\n\t"
+                                 "cmpl %[cpus], %%eax\n\t"
+                                 "jae 5f\n\t"
+                                 "imulq %[stride], %%rax\n\t"
+                                 "addq %[caches], %%rax\n\t"
+                                 "movq (%%rax), %%rcx\n\t"
+                                 "cmpq %[slots], %%rcx\n\t"
+                                 "jae 5f\n\t"
+                                 "movq %[ptr], 8(%%rax, %%rcx, 8)\n\t"
+                                 "incq %%rcx\n\t"
+                                 "movq %%rcx, (%%rax)\n\t"
+                                 "2:\n\t"
+                                 "movl $1, %k[pushed]\n\t"
+                                 "jmp 6f\n\t"
+                                 ".pushsection __rseq_failure, \"ax\"\n\t"
+                                 ".long 0x53053053\n\t"
+                                 "4:\n\t"
+                                 "jmp 0b\n\t"
+                                 ".popsection\n\t"
+                                 "5:\n\t"
+                                 "xorl %k[pushed], %k[pushed]\n\t"
+                                 "6:\n\t"
+                                 : [pushed] "=&r"(pushed)
+                                 : [rs] "r"(rs), [caches] "r"(m_caches + bin), [stride] "r"(stride), [cpus] "m"(m_active_cpus), [ptr] "r"(ptr), [slots] "i"((u64)c_slots),
+                                   [cs] "i"(offsetof(struct rseq, rseq_cs)), [cpu] "i"(offsetof(struct rseq, cpu_id))
+                                 : "rax", "rcx", "memory", "cc");
+            return pushed != 0;
+        }
+#else
+        static inline bool supported() { return false; }
+        static inline void restart_sequences() {}
+        inline void*       pop(u32 bin) const { return nullptr; }
+        inline bool        push(u32 bin, void* ptr) const { return false; }
+#endif
+    };
+
+    void superallocator_t::cpu_stop()
+    {
+        if (m_cpu != nullptr && m_cpu_stopped++ == 0)
+            m_cpu->stop(*this);
+    }
+
+    void superallocator_t::cpu_start()
+    {
+        if (m_cpu != nullptr && --m_cpu_stopped == 0)
+            m_cpu->start();
+    }
+
+    class xvmem_allocator : public alloc_t
+    {
+    public:
+        xvmem_allocator()
+            : m_superallocator(&m_local)
+            , m_shared(nullptr)
+            , m_lock(nullptr)
+            , m_main_heap(nullptr)
+            , m_bins(nullptr)
+            , m_vmem(nullptr)
+        {
+        }
+
+        void initialize(alloc_t* main_heap, xvmem* vmem, xvmem_config const* const cfg)
+        {
+            xvmem_config const  defaults;
+            xvmem_config const& settings = (cfg != nullptr) ? *cfg : defaults;
+
+            m_main_heap                    = main_heap;
+            m_vmem                         = vmem;
+            superallocator_config_t config = superallocator_config::get_config();
+            if (settings.m_bin_shift != 0)
+            {
+                m_bins = (superbin_t*)main_heap->allocate(sizeof(superbin_t) * superbin_num_bins(superbin_params(settings.m_bin_shift)), sizeof(void*));
+                generate_bins(settings, config, m_bins);
+            }
+            configure(m_local, vmem, config, settings);
+            if (settings.m_thread_private_chunks)
+                m_local.thread_private_chunks();
+            m_local.m_pressure = settings.m_pressure;
+            if (settings.m_per_cpu_caches)
+                per_cpu_caches(settings);
+        }
+
+        // The allocator is thread-safe, the small bins have per-CPU caches when the platform supports rseq
+        void per_cpu_caches(xvmem_config const& settings)
+        {
+            m_local_lock.initialize(false);
+            m_lock = &m_local_lock;
+            if (!supercpu_t::supported() || settings.m_debug_mode != xvmem_config::DEBUG_OFF || settings.m_capture_sizes)
+                return;
+#if defined TARGET_LINUX
+            superallocator_config_t const& config = m_local.m_config;
+            m_cpu.m_num_cpus                      = (u32)sysconf(_SC_NPROCESSORS_CONF);
+            m_cpu.m_num_bins                      = config.m_asbins[config.size2bin(supercpu_t::c_max_size)].m_alloc_bin_index + 1;
+            u64 const size                        = sizeof(supercpu_t::cache_t) * m_cpu.m_num_bins * m_cpu.m_num_cpus;
+            m_cpu.m_caches                        = (supercpu_t::cache_t*)m_main_heap->allocate((u32)size, 64);
+            x_memset(m_cpu.m_caches, 0, size);
+            m_cpu.m_active_cpus                   = m_cpu.m_num_cpus;
+            m_local.m_cpu                         = &m_cpu;
+#endif
+        }
+
+        // The cache of 'bin' of this CPU is empty, fills up half of it and returns one more slot. While the caches are
+        // stopped (a callback of the allocator allocates) only the one slot is allocated.
+        void* cpu_refill(u32 bin)
+        {
+            enter();
+            u32 const size = m_local.m_config.m_asbins[bin].m_alloc_size;
+            void*     ptr  = m_local.allocate_from_bin(bin, size, false);
+            for (u32 i = 0; ptr != nullptr && m_cpu.m_active_cpus != 0 && i < (supercpu_t::c_slots / 2); ++i)
+            {
+                void* const slot = m_local.allocate_from_bin(bin, size, false);
+                if (slot == nullptr)
+                    break;
+                if (!m_cpu.push(bin, slot))
+                {
+                    m_local.deallocate(slot);
+                    break;
+                }
+            }
+            leave();
+            return ptr;
+        }
+
+        // The cache of 'bin' of this CPU is full, half of it is released before 'ptr' is pushed
+        void cpu_drain(u32 bin, void* ptr)
+        {
+            enter();
+            for (u32 i = 0; i < (supercpu_t::c_slots / 2); ++i)
+            {
+                void* const slot = m_cpu.pop(bin);
+                if (slot == nullptr)
+                    break;
+                m_local.deallocate(slot);
+            }
+            if (!m_cpu.push(bin, ptr))
+                m_local.deallocate(ptr);
+            leave();
+        }
+
+        // Creates the allocator in the root block of 'vmem' or attaches to the one that another process created there,
+        // the settings of the creator are used. Thread-private chunks and the pressure callback are not supported.
+        bool initialize_shared(alloc_t* main_heap, xvmem_shared* vmem, xvmem_config const* const cfg)
+        {
+            xvmem_config const  defaults;
+            xvmem_config const& settings = (cfg != nullptr) ? *cfg : defaults;
+
+            m_main_heap = main_heap;
+            m_vmem      = vmem;
+            m_shared    = (supershared_t*)vmem->root(sizeof(supershared_t));
+            if (m_shared == nullptr)
+                return false;
+            m_lock = &m_shared->m_lock;
+
+            u32 state = supershared_t::STATE_NONE;
+            if (m_shared->m_state.compare_exchange_strong(state, supershared_t::STATE_INITIALIZING))
+            {
+#if defined TARGET_LINUX || defined TARGET_MAC
+                m_shared->m_creator.store((u32)getpid());
+#endif
+                // The bin table has to be in the shared memory as well
+                superbin_t* const       bins   = (superbin_t*)m_shared->m_bins;
+                superallocator_config_t config = superallocator_config::get_config();
+                if (settings.m_bin_shift != 0)
+                {
+                    generate_bins(settings, config, bins);
+                }
+                else
+                {
+                    for (s32 b = 0; b < config.m_num_bins; ++b)
+                        bins[b] = config.m_asbins[b];
+                    config.m_asbins = bins;
+                }
+
+                superallocator_t* allocator = new (&m_shared->m_allocator) superallocator_t();
+                configure(*allocator, vmem, config, settings);
+                allocator->m_config.m_allocators = nullptr; // Static data of this process, only used by 'initialize'
+                m_shared->m_lock.initialize(true);
+                m_shared->m_layout  = sizeof(supershared_t);
+                m_shared->m_version = supershared_t::c_version;
+                m_shared->m_state.store(supershared_t::STATE_READY);
+            }
+            else if (vmem->reopened() && state != supershared_t::STATE_READY)
+            {
+                return false; // The process that created it died while doing so
+            }
+            if (!m_shared->wait_until_ready())
+                return false;
+            if (m_shared->m_layout != sizeof(supershared_t) || m_shared->m_version != supershared_t::c_version)
+                return false;
+
+            if (vmem->reopened())
+            {
+                // A warm restart, the process that left the heap behind should not have died in the middle of a call
+                if (m_shared->m_busy != 0 || m_shared->m_poisoned != 0)
+                    return false;
+                m_shared->m_lock.initialize(true);
+            }
+            m_superallocator = &m_shared->m_allocator;
+            return true;
+        }
+
+        // A shared allocator is used by one process at a time, through the xvmem of that process. Returns false when
+        // the shared allocator is poisoned, the lock is not held then. A process that died while it was busy has left
+        // the bookkeeping in an unknown state, handing out memory from it could corrupt the data of every process.
+        inline bool enter()
+        {
+            bool const owner_died = (m_lock != nullptr) && !m_lock->lock();
+            if (m_shared != nullptr)
+            {
+                if (owner_died && m_shared->m_busy != 0)
+                    m_shared->m_poisoned = 1;
+                if (m_shared->m_poisoned != 0)
+                {
+                    m_lock->unlock();
+                    return false;
+                }
+                if (m_lock->m_depth == 1)
+                {
+                    m_shared->m_busy = 1;
+                    m_superallocator->rebind(m_vmem);
+                }
+            }
+            return true;
+        }
+
+        // A nested call (from a callback) is part of the outer call, the allocator stays busy until that returns
+        inline void leave()
+        {
+            if (m_shared != nullptr && m_lock->m_depth == 1)
+                m_shared->m_busy = 0;
+            if (m_lock != nullptr)
+                m_lock->unlock();
+        }
+
+        // The bin of a small allocation that is served from the per-CPU caches, otherwise 'm_cpu.m_num_bins'
+        inline u32 cpu_bin(u32 size, u32 alignment) const
+        {
+            size = xalignUp(size, alignment);
+            if (size > supercpu_t::c_max_size)
+                return m_cpu.m_num_bins;
+            return m_local.m_config.m_asbins[m_local.m_config.size2bin(size)].m_alloc_bin_index;
+        }
+
+        static void generate_bins(xvmem_config const& settings, superallocator_config_t& config, superbin_t* bins)
+        {
+            // A generated bin table, with the same chunk sizes and allocators as the built-in one
+            superbin_params_t const params = superbin_params(settings.m_bin_shift);
+            config.m_num_bins              = superbin_generate(params, bins, settings.m_size_histogram, settings.m_bin_sizes, settings.m_num_bin_sizes);
+            config.m_bin_shift             = params.m_bin_shift;
+            config.m_asbins                = bins;
+        }
+
+        static void configure(superallocator_t& allocator, xvmem* vmem, superallocator_config_t& config, xvmem_config const& settings)
+        {
+            config.m_internal_heap_pre_size = settings.m_internal_heap_pre_size;
+            config.m_internal_fsa_pre_size  = settings.m_internal_fsa_pre_size;
+            if (settings.m_address_range != 0)
+                config.m_address_range = xalignUp(settings.m_address_range, config.m_block_range);
+            allocator.initialize(vmem, config, settings.m_debug_mode);
+            if (settings.m_capture_sizes)
+                allocator.capture_sizes();
+            allocator.m_cache_coloring = settings.m_cache_coloring && settings.m_debug_mode == xvmem_config::DEBUG_OFF;
+
+            allocator.m_commit_soft_limit  = settings.m_commit_soft_limit;
+            allocator.m_limit.m_hard_limit = settings.m_commit_hard_limit;
+            u64 high, max;
+            if (settings.m_cgroup_limits && gVmCgroupMemoryLimits(high, max))
+            {
+                if (high != 0 && (allocator.m_commit_soft_limit == 0 || high < allocator.m_commit_soft_limit))
+                    allocator.m_commit_soft_limit = high;
+                if (max != 0 && (allocator.m_limit.m_hard_limit == 0 || max < allocator.m_limit.m_hard_limit))
+                    allocator.m_limit.m_hard_limit = max;
+            }
+        }
+
+        superallocator_t  m_local;
+        superallocator_t* m_superallocator; // 'm_local' or the allocator in shared memory
+        supershared_t*    m_shared;         // The root block in shared memory, nullptr for a process local allocator
+        superlock_t*      m_lock;           // The lock in shared memory or 'm_local_lock', nullptr when the caller serializes
+        superlock_t       m_local_lock;
+        supercpu_t        m_cpu;            // Per-CPU caches, no caches when 'm_cpu.m_caches' is nullptr
+
+    protected:
+        virtual void* v_allocate(u32 size, u32 alignment)
+        {
+            if (m_cpu.m_caches != nullptr)
+            {
+                u32 const bin = cpu_bin(size, alignment);
+                if (bin < m_cpu.m_num_bins)
+                {
+                    void* const ptr = m_cpu.pop(bin);
+                    return (ptr != nullptr) ? ptr : cpu_refill(bin);
+                }
+            }
+            if (!enter())
+                return nullptr;
+            void* ptr = m_superallocator->allocate(size, alignment);
+            leave();
+            return ptr;
+        }
+        virtual u32 v_deallocate(void* ptr)
+        {
+            if (m_cpu.m_caches != nullptr && ptr != nullptr)
+            {
+                // The bookkeeping of the chunk of a live allocation does not change, it can be read without the lock
+                u32 const bin = m_local.bin_of(ptr);
+                if (bin < m_cpu.m_num_bins)
+                {
+                    if (!m_cpu.push(bin, ptr))
+                        cpu_drain(bin, ptr);
+                    return m_local.m_config.m_asbins[bin].m_alloc_size;
+                }
+            }
+            if (!enter())
+                return 0;
+            u32 const size = m_superallocator->deallocate(ptr);
+            leave();
+            return size;
+        }
+        virtual void v_release()
+        {
+            // A shared allocator stays alive in the shared memory for the other processes
+            alloc_t* main_heap = m_main_heap;
+            if (m_cpu.m_caches != nullptr)
+                main_heap->deallocate(m_cpu.m_caches);
+            if (m_shared == nullptr)
+                m_local.deinitialize();
+            if (m_bins != nullptr)
+                main_heap->deallocate(m_bins);
+            main_heap->deallocate(this);
+        }
+
+        alloc_t*    m_main_heap;
+        superbin_t* m_bins; // A generated bin table, nullptr for the built-in one
+        xvmem*      m_vmem;
+    };
+
+    // Serializes a call into a (shared) allocator for its scope, the call is not made when the allocator is poisoned
+    class xvmem_scope
+    {
+    public:
+        xvmem_scope(alloc_t* vmalloc)
+            : m_allocator(static_cast<xvmem_allocator*>(vmalloc))
+            , m_entered(m_allocator->enter())
+        {
+        }
+        ~xvmem_scope()
+        {
+            if (m_entered)
+                m_allocator->leave();
+        }
+
+        bool              failed() const { return !m_entered; }
+        superallocator_t* operator->() const { return m_allocator->m_superallocator; }
+
+    private:
+        xvmem_allocator* m_allocator;
+        bool             m_entered;
+    };
+
+    alloc_t* gCreateVmAllocator(alloc_t* main_heap, xvmem* vmem, xvmem_config const* const cfg)
+    {
+        void*            mem       = main_heap->allocate(sizeof(xvmem_allocator), sizeof(void*));
+        xvmem_allocator* allocator = new (mem) xvmem_allocator();
+        allocator->initialize(main_heap, vmem, cfg);
+        return allocator;
+    }
+
+    alloc_t* gCreateSharedVmAllocator(alloc_t* main_heap, xvmem_shared* vmem, xvmem_config const* const cfg)
+    {
+        void*            mem       = main_heap->allocate(sizeof(xvmem_allocator), sizeof(void*));
+        xvmem_allocator* allocator = new (mem) xvmem_allocator();
+        if (!allocator->initialize_shared(main_heap, vmem, cfg))
+        {
+            main_heap->deallocate(mem);
+            return nullptr;
+        }
+        return allocator;
+    }
+
+    void* gVmAllocatorAllocateZeroed(alloc_t* vmalloc, u32 size, u32 alignment)
+    {
+        xvmem_scope allocator(vmalloc);
+        if (allocator.failed())
+            return nullptr;
+        return allocator->allocate_zeroed(size, alignment);
+    }
+
+    void* gVmAllocatorReallocate(alloc_t* vmalloc, void* ptr, u32 size, u32 alignment)
+    {
+        xvmem_scope allocator(vmalloc);
+        if (allocator.failed())
+            return nullptr;
+        return allocator->reallocate(ptr, size, alignment);
+    }
+
+    void* gVmAllocatorAllocateRing(alloc_t* vmalloc, u32& size)
+    {
+        xvmem_scope allocator(vmalloc);
+        if (allocator.failed())
+            return nullptr;
+        return allocator->allocate_ring(size);
+    }
+
+    void gVmAllocatorDeallocateRing(alloc_t* vmalloc, void* ring)
+    {
+        xvmem_scope allocator(vmalloc);
+        if (allocator.failed())
+            return;
+        allocator->deallocate_ring(ring);
+    }
+
+    bool gVmAllocatorOwns(alloc_t* vmalloc, void* ptr)
+    {
+        superchunks_t const& chunks = static_cast<xvmem_allocator*>(vmalloc)->m_superallocator->m_chunks;
+        return ptr >= chunks.m_address_base && ptr < ((xbyte*)chunks.m_address_base + chunks.m_address_range);
+    }
+
+    u32 gVmAllocatorGetSize(alloc_t* vmalloc, void* ptr)
+    {
+        xvmem_scope allocator(vmalloc);
+        if (allocator.failed())
+            return 0;
+        return allocator->get_size(ptr);
+    }
+
+    u32 gVmAllocatorCompact(alloc_t* vmalloc, u32 occupancy_percentage, xvmem_compactor* compactor)
+    {
+        xvmem_scope allocator(vmalloc);
+        if (allocator.failed())
+            return 0;
+        return allocator->compact(occupancy_percentage, compactor);
+    }
+
+    u32 gVmAllocatorPrewarm(alloc_t* vmalloc, u32 size, u32 count, bool prefault)
+    {
+        xvmem_scope allocator(vmalloc);
+        if (allocator.failed())
+            return 0;
+        return allocator->prewarm(size, count, prefault);
+    }
+
+    u32 gVmAllocatorUnpin(alloc_t* vmalloc, u32 size)
+    {
+        xvmem_scope allocator(vmalloc);
+        if (allocator.failed())
+            return 0;
+        return allocator->unpin(size);
+    }
+
+    u64 gVmAllocatorCommitted(alloc_t* vmalloc)
+    {
+        xvmem_scope allocator(vmalloc);
+        if (allocator.failed())
+            return 0;
+        return allocator->committed();
+    }
+
+    u64 gVmAllocatorFlush(alloc_t* vmalloc)
+    {
+        xvmem_scope allocator(vmalloc);
+        if (allocator.failed())
+            return 0;
+        return allocator->flush();
+    }
+
+    u64 gVmAllocatorScavenge(alloc_t* vmalloc)
+    {
+        xvmem_scope allocator(vmalloc);
+        if (allocator.failed())
+            return 0;
+        return allocator->scavenge();
+    }
+
+    void** gVmAllocatorSharedRoot(alloc_t* vmalloc)
+    {
+        supershared_t* shared = static_cast<xvmem_allocator*>(vmalloc)->m_shared;
+        return (shared != nullptr) ? &shared->m_root : nullptr;
+    }
+
+    void gVmAllocatorReleaseThread(alloc_t* vmalloc)
+    {
+        xvmem_scope allocator(vmalloc);
+        if (allocator.failed())
+            return;
+        allocator->release_thread();
+    }
+
+    u32 gVmAllocatorSizeHistogram(alloc_t* vmalloc, u32* sizes, u64* counts, u32 max_count)
+    {
+        xvmem_scope allocator(vmalloc);
+        if (allocator.failed())
+            return 0;
+        return allocator->size_histogram(sizes, counts, max_count);
+    }
+
+    u32 gVmFitSizeClasses(alloc_t* heap, xvmem_size_histogram const* histogram, u32 bin_shift, u32 max_bins, u32* bin_sizes, u32 max_sizes)
+    {
+        return superbin_fit(superbin_params(bin_shift), *histogram, max_bins, bin_sizes, max_sizes, heap);
+    }
+
+    u64 gVmSizeClassWaste(alloc_t* heap, xvmem_size_histogram const* histogram, u32 bin_shift, u32 const* bin_sizes, u32 num_bin_sizes)
+    {
+        superbin_params_t const params = superbin_params(bin_shift);
+        superbin_t*             bins   = (superbin_t*)heap->allocate(sizeof(superbin_t) * superbin_num_bins(params), sizeof(void*));
+        superbin_generate(params, bins, nullptr, bin_sizes, num_bin_sizes);
+        u64 const waste = superbin_waste(params, bins, *histogram);
+        heap->deallocate(bins);
+        return waste;
+    }
+
+    static bool superbin_keyword(char const* word, u32 len, char const* keyword)
+    {
+        u32 i = 0;
+        while (i < len && keyword[i] != 0 && word[i] == keyword[i])
+            i += 1;
+        return i == len && keyword[i] == 0;
+    }
+
+    // The text format of a set of size classes:
+    //   # comment
+    //   bin_shift 4
+    //   bins 16 24 32 48 72 ...
+    u32 gVmParseSizeClasses(char const* text, u32 length, u32& bin_shift, u32* bin_sizes, u32 max_sizes)
+    {
+        u32  n     = 0;
+        u32  i     = 0;
+        s32  field = -1; // -1 = keyword, 0 = bin_shift, 1 = bins
+        bin_shift  = 0;
+        while (i < length)
+        {
+            char const c = text[i];
+            if (c == '#')
+            {
+                while (i < length && text[i] != '\n')
+                    i += 1;
+                continue;
+            }
+            if (c == ' ' || c == '\t' || c == '\r' || c == '\n')
+            {
+                if (c == '\n')
+                    field = -1;
+                i += 1;
+                continue;
+            }
+
+            u32 const begin = i;
+            while (i < length && text[i] != ' ' && text[i] != '\t' && text[i] != '\r' && text[i] != '\n' && text[i] != '#')
+                i += 1;
+            u32 const len = i - begin;
+            if (field < 0)
+            {
+                if (superbin_keyword(text + begin, len, "bin_shift"))
+                    field = 0;
+                else if (superbin_keyword(text + begin, len, "bins"))
+                    field = 1;
+                else
+                    return 0;
+                continue;
+            }
+
+            u32 value = 0;
+            for (u32 d = begin; d < i; ++d)
+            {
+                if (text[d] < '0' || text[d] > '9')
+                    return 0;
+                value = (value * 10) + (u32)(text[d] - '0');
+            }
+            if (field == 0)
+                bin_shift = value;
+            else if (n < max_sizes)
+                bin_sizes[n++] = value;
+            else
+                return 0;
+        }
+        return (bin_shift >= 2 && bin_shift <= 4) ? n : 0;
+    }
+
+    void gVmAllocatorWalk(alloc_t* vmalloc, xvmem_walker* walker)
+    {
+        xvmem_scope allocator(vmalloc);
+        if (allocator.failed())
+            return;
+        allocator->walk(walker, false);
+    }
+
+    bool gVmAllocatorWalkPaused(alloc_t* vmalloc, xvmem_walker* walker)
+    {
+        xvmem_allocator* allocator = static_cast<xvmem_allocator*>(vmalloc);
+        return allocator->m_superallocator->walk(walker, true);
     }
 } // namespace xcore
@@ -4,9 +4,17 @@
 
 #include "xvmem/x_virtual_memory.h"
 
-#if defined TARGET_MAC
+#if defined TARGET_MAC || defined TARGET_LINUX
 #include <sys/mman.h>
 #endif
+#if defined TARGET_LINUX
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/file.h>
+#include <sys/stat.h>
+#include <atomic>
+#include <new>
+#endif
 #if defined TARGET_PC
 #include "Windows.h"
 #endif
@@ -16,6 +24,12 @@ namespace xcore
     class xvmem_os : public xvmem
     {
     public:
+        // constexpr, so that 'sVMem' is usable before any static constructor has run
+        constexpr xvmem_os()
+            : m_pagesize(0)
+        {
+        }
+
         virtual bool initialize(u32 pagesize);
 
         virtual bool reserve(u64 address_range, u32& page_size, u32 attributes, void*& baseptr);
@@ -23,6 +37,11 @@ namespace xcore
 
         virtual bool commit(void* page_address, u32 page_size, u32 page_count);
         virtual bool decommit(void* page_address, u32 page_size, u32 page_count);
+        virtual bool prefault(void* page_address, u32 page_size, u32 page_count);
+#if defined TARGET_LINUX
+        virtual bool commit_mirrored(void* page_address, u32 page_size, u32 page_count);
+        virtual bool remap(void* from, void* to, u32 page_size, u32 page_count);
+#endif
 
     private:
         u32 m_pagesize;
@@ -34,15 +53,65 @@ namespace xcore
         return true;
     }
 
-#if defined TARGET_MAC
+    // Sorts the ranges on address and merges the ones that are adjacent, returns the number of merged runs
+    static u32 merge_ranges(xvmem_range* ranges, u32 count, u32 page_size)
+    {
+        for (u32 i = 1; i < count; ++i)
+        {
+            xvmem_range const r = ranges[i];
+            u32               j = i;
+            for (; j > 0 && ranges[j - 1].m_address > r.m_address; --j)
+                ranges[j] = ranges[j - 1];
+            ranges[j] = r;
+        }
+        u32 runs = 0;
+        for (u32 i = 0; i < count; ++i)
+        {
+            if (runs > 0 && ((xbyte*)ranges[runs - 1].m_address + (u64)ranges[runs - 1].m_page_count * page_size) == ranges[i].m_address)
+                ranges[runs - 1].m_page_count += ranges[i].m_page_count;
+            else
+                ranges[runs++] = ranges[i];
+        }
+        return runs;
+    }
+
+    bool xvmem::commit_ranges(xvmem_range* ranges, u32 count, u32 page_size)
+    {
+        bool      ok   = true;
+        u32 const runs = merge_ranges(ranges, count, page_size);
+        for (u32 i = 0; i < runs; ++i)
+            ok = commit(ranges[i].m_address, page_size, ranges[i].m_page_count) && ok;
+        return ok;
+    }
+
+    bool xvmem::decommit_ranges(xvmem_range* ranges, u32 count, u32 page_size)
+    {
+        bool      ok   = true;
+        u32 const runs = merge_ranges(ranges, count, page_size);
+        for (u32 i = 0; i < runs; ++i)
+            ok = decommit(ranges[i].m_address, page_size, ranges[i].m_page_count) && ok;
+        return ok;
+    }
+
+    // Touches every 4 KB of the range, reading and writing back the same byte keeps the content intact
+    static void touch_pages(void* page_address, u64 size)
+    {
+        volatile xbyte* ptr = (volatile xbyte*)page_address;
+        for (u64 offset = 0; offset < size; offset += 4096)
+            ptr[offset] = ptr[offset];
+    }
+
+#if defined TARGET_MAC || defined TARGET_LINUX
 
-#define SYS_PAGE_SIZE 4096
+// The page size that we hand out is a multiple of the OS page size, superalloc needs 64 KB pages
+#define SYS_PAGE_SIZE (64 * 1024)
 
     bool xvmem_os::reserve(u64 address_range, u32& page_size, u32 reserve_flags, void*& baseptr)
     {
-        baseptr = mmap(NULL, address_range, PROT_NONE, MAP_PRIVATE | MAP_ANON | reserve_flags, -1, 0);
+        baseptr = mmap(NULL, address_range, PROT_NONE, MAP_PRIVATE | MAP_ANON | MAP_NORESERVE | (reserve_flags & ~ATTR_MANAGED), -1, 0);
         if (baseptr == MAP_FAILED)
             baseptr = NULL;
+        page_size = m_pagesize;
 
         msync(baseptr, address_range, (MS_SYNC | MS_INVALIDATE));
         return baseptr != nullptr;
@@ -72,6 +141,48 @@ namespace xcore
         return true;
     }
 
+    bool xvmem_os::prefault(void* page_address, u32 page_size, u32 page_count)
+    {
+        u64 const size = (u64)page_size * page_count;
+#if defined MADV_POPULATE_WRITE
+        // Linux 5.14 and later, falls back to touching the pages on older kernels
+        if (madvise(page_address, size, MADV_POPULATE_WRITE) == 0)
+            return true;
+#endif
+        touch_pages(page_address, size);
+        return true;
+    }
+
+#if defined TARGET_LINUX
+    // A memfd that is mapped twice, the mappings keep it alive after it is closed and it is freed when they are replaced
+    bool xvmem_os::commit_mirrored(void* page_address, u32 page_size, u32 page_count)
+    {
+        u64 const size = (u64)page_size * page_count;
+        s32 const fd   = memfd_create("xvmem_ring", MFD_CLOEXEC);
+        if (fd < 0)
+            return false;
+        bool ok = ftruncate(fd, size) == 0;
+        ok      = ok && mmap(page_address, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED, fd, 0) != MAP_FAILED;
+        ok      = ok && mmap((xbyte*)page_address + size, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED, fd, 0) != MAP_FAILED;
+        close(fd);
+        return ok;
+    }
+
+    // The page table entries are moved, MREMAP_DONTUNMAP (Linux 5.7) keeps 'from' mapped so the reserved range has no
+    // hole that another mmap could take, it is decommitted afterwards. Fails when the pages are not in one mapping.
+    bool xvmem_os::remap(void* from, void* to, u32 page_size, u32 page_count)
+    {
+#if defined MREMAP_DONTUNMAP
+        u64 const size = (u64)page_size * page_count;
+        if (mremap(from, size, size, MREMAP_MAYMOVE | MREMAP_FIXED | MREMAP_DONTUNMAP, to) == MAP_FAILED)
+            return false;
+        return decommit(from, page_size, page_count);
+#else
+        return false;
+#endif
+    }
+#endif
+
     static xvmem_os sVMem;
 
     bool gInitVirtualMemory()
@@ -80,11 +191,265 @@ namespace xcore
         return sVMem.initialize(page_size);
     }
 
+#if defined TARGET_LINUX
+
+    // Reads a small text file without allocating, the allocator may be used as malloc
+    static s32 read_text_file(char const* path, char* text, s32 size)
+    {
+        s32 const fd = open(path, O_RDONLY | O_CLOEXEC);
+        if (fd < 0)
+            return -1;
+        s32 length = 0;
+        while (length < (size - 1))
+        {
+            ssize_t const n = read(fd, text + length, size - 1 - length);
+            if (n <= 0)
+                break;
+            length += (s32)n;
+        }
+        close(fd);
+        text[length] = '\0';
+        return length;
+    }
+
+    // Appends 'str' (up to a newline) to 'path', returns the new length
+    static s32 append_path(char* path, s32 length, s32 size, char const* str)
+    {
+        while (*str != '\0' && *str != '\n' && length < (size - 1))
+            path[length++] = *str++;
+        path[length] = '\0';
+        return length;
+    }
+
+    // Reads a cgroup memory limit file, 'max' (no limit) reads as 0
+    static bool read_cgroup_limit(char* path, s32 length, s32 size, char const* name, u64& limit)
+    {
+        char text[32];
+        append_path(path, length, size, name);
+        if (read_text_file(path, text, sizeof(text)) <= 0)
+            return false;
+        limit = 0;
+        for (char const* c = text; *c >= '0' && *c <= '9'; ++c)
+            limit = (limit * 10) + (u64)(*c - '0');
+        return true;
+    }
+
+    bool gVmCgroupMemoryLimits(u64& high, u64& max)
+    {
+        high = 0;
+        max  = 0;
+
+        // The cgroup v2 hierarchy is the line '0::<path>'
+        char text[1024];
+        if (read_text_file("/proc/self/cgroup", text, sizeof(text)) <= 0)
+            return false;
+        char const* line = text;
+        while (line[0] != '0' || line[1] != ':' || line[2] != ':')
+        {
+            while (*line != '\0' && *line != '\n')
+                ++line;
+            if (*line == '\0')
+                return false;
+            ++line;
+        }
+
+        char path[1024];
+        s32  length = append_path(path, 0, sizeof(path), "/sys/fs/cgroup");
+        length      = append_path(path, length, sizeof(path), line + 3);
+        if (path[length - 1] != '/')
+            length = append_path(path, length, sizeof(path), "/");
+        return read_cgroup_limit(path, length, sizeof(path), "memory.high", high) && read_cgroup_limit(path, length, sizeof(path), "memory.max", max);
+    }
+
+    // The header in the first page of the shared memory, followed by the root block
+    struct xvmem_shared_header
+    {
+        static const u64 c_magic   = 0x4d454d5653484152ull; // 'MEMVSHAR'
+        static const u32 c_version = 1;
+
+        u64              m_magic;
+        u32              m_version;
+        u32              m_page_size;
+        u64              m_address;  // The address of the mapping, the same in every process
+        u64              m_size;
+        std::atomic<u64> m_reserved; // The offset of the first range that is not reserved
+    };
+
+    class xvmem_shared_os : public xvmem_shared
+    {
+    public:
+        xvmem_shared_os(s32 fd, xvmem_shared_header* header, bool reopened)
+            : m_fd(fd)
+            , m_header(header)
+            , m_reopened(reopened)
+        {
+        }
+
+        virtual bool initialize(u32 pagesize) { return true; }
+
+        virtual bool reserve(u64 address_range, u32& page_size, u32 attributes, void*& baseptr);
+        virtual bool release(void* baseptr, u64 address_range);
+
+        virtual bool commit(void* page_address, u32 page_size, u32 page_count);
+        virtual bool decommit(void* page_address, u32 page_size, u32 page_count);
+        virtual bool prefault(void* page_address, u32 page_size, u32 page_count) { return sVMem.prefault(page_address, page_size, page_count); }
+
+        virtual s32   fd() const { return m_fd; }
+        virtual void* root(u32 size) { return (sizeof(xvmem_shared_header) + size <= SYS_PAGE_SIZE) ? (void*)(m_header + 1) : nullptr; }
+        virtual bool  reopened() const { return m_reopened; }
+
+        u64 offset_of(void* address) const { return (u64)address - m_header->m_address; }
+
+        s32                  m_fd;
+        xvmem_shared_header* m_header;
+        bool                 m_reopened;
+    };
+
+    // Ranges are taken from the end of the reserved part and are never handed out again
+    bool xvmem_shared_os::reserve(u64 address_range, u32& page_size, u32 attributes, void*& baseptr)
+    {
+        address_range     = (address_range + (SYS_PAGE_SIZE - 1)) & ~(u64)(SYS_PAGE_SIZE - 1);
+        u64 const offset  = m_header->m_reserved.fetch_add(address_range);
+        page_size         = SYS_PAGE_SIZE;
+        baseptr           = nullptr;
+        if ((offset + address_range) > m_header->m_size)
+            return false;
+        baseptr = (void*)(m_header->m_address + offset);
+        return true;
+    }
+
+    bool xvmem_shared_os::release(void* baseptr, u64 address_range) { return fallocate(m_fd, FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE, offset_of(baseptr), address_range) == 0; }
+
+    bool xvmem_shared_os::commit(void* page_address, u32 page_size, u32 page_count) { return fallocate(m_fd, 0, offset_of(page_address), (u64)page_size * page_count) == 0; }
+
+    bool xvmem_shared_os::decommit(void* page_address, u32 page_size, u32 page_count)
+    {
+        return fallocate(m_fd, FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE, offset_of(page_address), (u64)page_size * page_count) == 0;
+    }
+
+    // Maps 'fd' at 'wanted' and fails when that address range is taken, without 'wanted' the OS picks the address
+    static void* shared_map(s32 fd, void* wanted, u64 size)
+    {
+#if defined MAP_FIXED_NOREPLACE
+        s32 const fixed = (wanted != nullptr) ? MAP_FIXED_NOREPLACE : 0;
+#else
+        s32 const fixed = 0; // A hint, the address is verified below
+#endif
+        void* address = mmap(wanted, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_NORESERVE | fixed, fd, 0);
+        if (address == MAP_FAILED)
+            return nullptr;
+        if (wanted != nullptr && address != wanted)
+        {
+            munmap(address, size);
+            return nullptr;
+        }
+        return address;
+    }
+
+    // Sizes the (empty) shared memory object 'fd', maps it and writes the header
+    static xvmem_shared* shared_create(alloc_t* heap, s32 fd, u64 size, void* wanted)
+    {
+        size = (size + (SYS_PAGE_SIZE - 1)) & ~(u64)(SYS_PAGE_SIZE - 1);
+        if (ftruncate(fd, size) != 0 || fallocate(fd, 0, 0, SYS_PAGE_SIZE) != 0)
+            return nullptr;
+        void* address = shared_map(fd, wanted, size);
+        if (address == nullptr)
+            return nullptr;
+
+        xvmem_shared_header* header = new (address) xvmem_shared_header();
+        header->m_version           = xvmem_shared_header::c_version;
+        header->m_page_size         = SYS_PAGE_SIZE;
+        header->m_address           = (u64)address;
+        header->m_size              = size;
+        header->m_reserved          = SYS_PAGE_SIZE;
+        header->m_magic             = xvmem_shared_header::c_magic;
+        return new (heap->allocate(sizeof(xvmem_shared_os), sizeof(void*))) xvmem_shared_os(fd, header, false);
+    }
+
+    // Maps the shared memory object 'fd' at the address in its header, fails when the header is not valid
+    static xvmem_shared* shared_open(alloc_t* heap, s32 fd, bool reopened)
+    {
+        xvmem_shared_header const* header = (xvmem_shared_header const*)mmap(NULL, SYS_PAGE_SIZE, PROT_READ, MAP_SHARED, fd, 0);
+        if (header == MAP_FAILED)
+            return nullptr;
+        bool const valid  = header->m_magic == xvmem_shared_header::c_magic && header->m_version == xvmem_shared_header::c_version && header->m_page_size == SYS_PAGE_SIZE;
+        void*      wanted = (void*)header->m_address;
+        u64 const  size   = header->m_size;
+        munmap((void*)header, SYS_PAGE_SIZE);
+
+        void* address = valid ? shared_map(fd, wanted, size) : nullptr;
+        if (address == nullptr)
+            return nullptr;
+        return new (heap->allocate(sizeof(xvmem_shared_os), sizeof(void*))) xvmem_shared_os(fd, (xvmem_shared_header*)address, reopened);
+    }
+
+    xvmem_shared* gCreateSharedVirtualMemory(alloc_t* heap, u64 size)
+    {
+        s32 const fd = memfd_create("xvmem", MFD_CLOEXEC);
+        if (fd < 0)
+            return nullptr;
+        xvmem_shared* vmem = shared_create(heap, fd, size, nullptr);
+        if (vmem == nullptr)
+            close(fd);
+        return vmem;
+    }
+
+    xvmem_shared* gOpenSharedVirtualMemory(alloc_t* heap, s32 fd)
+    {
+        s32 const dupfd = fcntl(fd, F_DUPFD_CLOEXEC, 0);
+        if (dupfd < 0)
+            return nullptr;
+        xvmem_shared* vmem = shared_open(heap, dupfd, false);
+        if (vmem == nullptr)
+            close(dupfd);
+        return vmem;
+    }
+
+    // The file is locked, a persistent heap is used by one process at a time
+    xvmem_shared* gOpenPersistentVirtualMemory(alloc_t* heap, char const* path, u64 size, void* address)
+    {
+        s32 const fd = open(path, O_RDWR | O_CREAT | O_CLOEXEC, 0600);
+        if (fd < 0)
+            return nullptr;
+
+        xvmem_shared* vmem = nullptr;
+        struct stat   st;
+        if (flock(fd, LOCK_EX | LOCK_NB) == 0 && fstat(fd, &st) == 0)
+            vmem = (st.st_size == 0) ? shared_create(heap, fd, size, address) : shared_open(heap, fd, true);
+        if (vmem == nullptr)
+            close(fd);
+        return vmem;
+    }
+
+    void gReleaseSharedVirtualMemory(alloc_t* heap, xvmem_shared* vmem)
+    {
+        xvmem_shared_os* shared = static_cast<xvmem_shared_os*>(vmem);
+        munmap((void*)shared->m_header->m_address, shared->m_header->m_size);
+        close(shared->m_fd);
+        heap->deallocate(shared);
+    }
+
+#else
+
+    bool gVmCgroupMemoryLimits(u64& high, u64& max)
+    {
+        high = 0;
+        max  = 0;
+        return false;
+    }
+
+    xvmem_shared* gCreateSharedVirtualMemory(alloc_t* heap, u64 size) { return nullptr; }
+    xvmem_shared* gOpenSharedVirtualMemory(alloc_t* heap, s32 fd) { return nullptr; }
+    xvmem_shared* gOpenPersistentVirtualMemory(alloc_t* heap, char const* path, u64 size, void* address) { return nullptr; }
+    void          gReleaseSharedVirtualMemory(alloc_t* heap, xvmem_shared* vmem) {}
+
+#endif
+
 #elif defined TARGET_PC
 
     bool xvmem_os::reserve(u64 address_range, u32& page_size, u32 reserve_flags, void*& baseptr)
     {
-        unsigned int allocation_type = MEM_RESERVE | reserve_flags;
+        unsigned int allocation_type = MEM_RESERVE | (reserve_flags & ~ATTR_MANAGED);
         unsigned int protect         = 0;
         baseptr                      = ::VirtualAlloc(NULL, (SIZE_T)address_range, allocation_type, protect);
         page_size                    = m_pagesize;
@@ -112,6 +477,12 @@ namespace xcore
         return b;
     }
 
+    bool xvmem_os::prefault(void* page_address, u32 page_size, u32 page_count)
+    {
+        touch_pages(page_address, (u64)page_size * page_count);
+        return true;
+    }
+
     static xvmem_os sVMem;
 
     bool gInitVirtualMemory()
@@ -121,6 +492,18 @@ namespace xcore
         return sVMem.initialize(sysinfo.dwPageSize);
     }
 
+    bool gVmCgroupMemoryLimits(u64& high, u64& max)
+    {
+        high = 0;
+        max  = 0;
+        return false;
+    }
+
+    xvmem_shared* gCreateSharedVirtualMemory(alloc_t* heap, u64 size) { return nullptr; }
+    xvmem_shared* gOpenSharedVirtualMemory(alloc_t* heap, s32 fd) { return nullptr; }
+    xvmem_shared* gOpenPersistentVirtualMemory(alloc_t* heap, char const* path, u64 size, void* address) { return nullptr; }
+    void          gReleaseSharedVirtualMemory(alloc_t* heap, xvmem_shared* vmem) {}
+
 #else
 
 #error Unknown Platform/Compiler configuration for xvmem
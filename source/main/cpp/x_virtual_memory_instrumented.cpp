@@ -0,0 +1,301 @@
+#include "xbase/x_target.h"
+#include "xbase/x_debug.h"
+#include "xbase/x_allocator.h"
+#include "xbase/x_integer.h"
+#include "xbase/x_memory.h"
+
+#include "xvmem/x_virtual_memory.h"
+
+#include <chrono>
+#include <new>
+
+namespace xcore
+{
+    // Every reserved range has a bitmap of its committed pages, so the committed bytes are exact also when a range is
+    // committed twice or released while pages are still committed
+    class xvmem_instrumented_imp : public xvmem_instrumented
+    {
+    public:
+        xvmem_instrumented_imp(alloc_t* heap, xvmem* backend, bool simulate);
+
+        virtual bool initialize(u32 pagesize) { return m_backend->initialize(pagesize); }
+
+        virtual bool reserve(u64 address_range, u32& page_size, u32 attributes, void*& baseptr);
+        virtual bool release(void* baseptr, u64 address_range);
+
+        virtual bool commit(void* address, u32 page_size, u32 page_count);
+        virtual bool decommit(void* address, u32 page_size, u32 page_count);
+        virtual bool prefault(void* address, u32 page_size, u32 page_count);
+        virtual bool commit_mirrored(void* address, u32 page_size, u32 page_count);
+        virtual bool remap(void* from, void* to, u32 page_size, u32 page_count);
+
+        virtual void stats(xvmem_stats& stats) const { stats = m_stats; }
+        virtual void reset_stats();
+        virtual u64  committed(void* address, u64 size) const;
+        virtual void fail_commits_above(u64 bytes) { m_fail_above = bytes; }
+
+        void release_ranges();
+
+    private:
+        struct range_t
+        {
+            xbyte* m_base;
+            u64    m_size;
+            u64    m_committed;
+            u64*   m_pages; // A bit per page, set when it is committed
+            u32    m_page_shift;
+            bool   m_simulated;
+        };
+
+        typedef std::chrono::steady_clock clock_t;
+
+        range_t* find(void* address) const;
+        void     record(s32 op, u64 bytes, clock_t::time_point start);
+        s64      mark(range_t* range, void* address, u32 page_count, bool commit);
+        bool     fails(u32 page_size, u32 page_count) const;
+
+        static const s32 c_ranges_max = 32;
+
+        alloc_t*    m_heap;
+        xvmem*      m_backend;
+        bool        m_simulate;
+        s32         m_num_ranges;
+        range_t     m_ranges[c_ranges_max];
+        xvmem_stats m_stats;
+        u64         m_fail_above;
+    };
+
+    xvmem_instrumented_imp::xvmem_instrumented_imp(alloc_t* heap, xvmem* backend, bool simulate)
+        : m_heap(heap)
+        , m_backend(backend)
+        , m_simulate(simulate)
+        , m_num_ranges(0)
+        , m_fail_above(0)
+    {
+        x_memset(&m_stats, 0, sizeof(m_stats));
+    }
+
+    void xvmem_instrumented_imp::reset_stats()
+    {
+        u64 const committed = m_stats.m_committed;
+        x_memset(&m_stats, 0, sizeof(m_stats));
+        m_stats.m_committed      = committed;
+        m_stats.m_committed_peak = committed;
+    }
+
+    xvmem_instrumented_imp::range_t* xvmem_instrumented_imp::find(void* address) const
+    {
+        for (s32 i = 0; i < m_num_ranges; ++i)
+        {
+            range_t const& range = m_ranges[i];
+            if ((xbyte*)address >= range.m_base && (xbyte*)address < (range.m_base + range.m_size))
+                return (range_t*)&range;
+        }
+        return nullptr;
+    }
+
+    void xvmem_instrumented_imp::record(s32 op, u64 bytes, clock_t::time_point start)
+    {
+        u64 const ns     = (u64)std::chrono::duration_cast<std::chrono::nanoseconds>(clock_t::now() - start).count();
+        s32       bucket = (ns == 0) ? 0 : (63 - xcountLeadingZeros(ns));
+        if (bucket >= xvmem_stats::c_latency_buckets)
+            bucket = xvmem_stats::c_latency_buckets - 1;
+        xvmem_stats::op_t& stats = m_stats.m_ops[op];
+        stats.m_count += 1;
+        stats.m_bytes += bytes;
+        stats.m_latency[bucket] += 1;
+    }
+
+    // Returns the number of bytes that changed state
+    s64 xvmem_instrumented_imp::mark(range_t* range, void* address, u32 page_count, bool commit)
+    {
+        u64 const first   = (u64)((xbyte*)address - range->m_base) >> range->m_page_shift;
+        u64       changed = 0;
+        for (u64 p = first; p < (first + page_count); ++p)
+        {
+            u64&      word = range->m_pages[p >> 6];
+            u64 const bit  = (u64)1 << (p & 63);
+            if (((word & bit) != 0) != commit)
+            {
+                word ^= bit;
+                changed += 1;
+            }
+        }
+        s64 const bytes = (s64)(changed << range->m_page_shift);
+        return commit ? bytes : -bytes;
+    }
+
+    // The pages are counted as if none of them is committed yet, a failing commit leaves the range as it was
+    bool xvmem_instrumented_imp::fails(u32 page_size, u32 page_count) const { return m_fail_above != 0 && (m_stats.m_committed + (u64)page_size * page_count) > m_fail_above; }
+
+    bool xvmem_instrumented_imp::reserve(u64 address_range, u32& page_size, u32 attributes, void*& baseptr)
+    {
+        clock_t::time_point const start = clock_t::now();
+        bool const                ok    = m_backend->reserve(address_range, page_size, attributes, baseptr);
+        record(xvmem_stats::RESERVE, address_range, start);
+        if (!ok)
+            return false;
+
+        ASSERT(m_num_ranges < c_ranges_max); // The range is not tracked
+        if (m_num_ranges < c_ranges_max)
+        {
+            range_t& range     = m_ranges[m_num_ranges++];
+            u64 const pages    = address_range / page_size;
+            u32 const size     = (u32)(((pages + 63) >> 6) * sizeof(u64));
+            range.m_base       = (xbyte*)baseptr;
+            range.m_size       = address_range;
+            range.m_committed  = 0;
+            range.m_page_shift = xcountTrailingZeros(page_size);
+            range.m_simulated  = m_simulate && (attributes & ATTR_MANAGED) != 0;
+            range.m_pages      = (u64*)m_heap->allocate(size, sizeof(u64));
+            x_memset(range.m_pages, 0, size);
+        }
+        return true;
+    }
+
+    bool xvmem_instrumented_imp::release(void* baseptr, u64 address_range)
+    {
+        range_t* range = find(baseptr);
+        if (range != nullptr)
+        {
+            m_stats.m_committed -= range->m_committed;
+            m_heap->deallocate(range->m_pages);
+            *range = m_ranges[--m_num_ranges];
+        }
+
+        clock_t::time_point const start = clock_t::now();
+        bool const                ok    = m_backend->release(baseptr, address_range);
+        record(xvmem_stats::RELEASE, address_range, start);
+        return ok;
+    }
+
+    bool xvmem_instrumented_imp::commit(void* address, u32 page_size, u32 page_count)
+    {
+        clock_t::time_point const start = clock_t::now();
+        range_t* const            range = find(address);
+        bool                      ok    = !fails(page_size, page_count);
+        if (ok && (range == nullptr || !range->m_simulated))
+            ok = m_backend->commit(address, page_size, page_count);
+        if (ok && range != nullptr)
+        {
+            s64 const bytes = mark(range, address, page_count, true);
+            range->m_committed += bytes;
+            m_stats.m_committed += bytes;
+            if (m_stats.m_committed > m_stats.m_committed_peak)
+                m_stats.m_committed_peak = m_stats.m_committed;
+        }
+        record(xvmem_stats::COMMIT, (u64)page_size * page_count, start);
+        return ok;
+    }
+
+    bool xvmem_instrumented_imp::decommit(void* address, u32 page_size, u32 page_count)
+    {
+        clock_t::time_point const start = clock_t::now();
+        range_t* const            range = find(address);
+        bool                      ok    = true;
+        if (range == nullptr || !range->m_simulated)
+            ok = m_backend->decommit(address, page_size, page_count);
+        if (ok && range != nullptr)
+        {
+            s64 const bytes = mark(range, address, page_count, false);
+            range->m_committed += bytes;
+            m_stats.m_committed += bytes;
+        }
+        record(xvmem_stats::DECOMMIT, (u64)page_size * page_count, start);
+        return ok;
+    }
+
+    bool xvmem_instrumented_imp::prefault(void* address, u32 page_size, u32 page_count)
+    {
+        range_t* const range = find(address);
+        if (range != nullptr && range->m_simulated)
+            return true;
+        return m_backend->prefault(address, page_size, page_count);
+    }
+
+    // Only the first mapping is marked, the pages are committed once. A simulated range has no memory to mirror.
+    bool xvmem_instrumented_imp::commit_mirrored(void* address, u32 page_size, u32 page_count)
+    {
+        clock_t::time_point const start = clock_t::now();
+        range_t* const            range = find(address);
+        if ((range != nullptr && range->m_simulated) || fails(page_size, page_count))
+            return false;
+        bool const ok = m_backend->commit_mirrored(address, page_size, page_count);
+        if (ok && range != nullptr)
+        {
+            s64 const bytes = mark(range, address, page_count, true) + mark(range, (xbyte*)address + (u64)page_size * page_count, page_count, false);
+            range->m_committed += bytes;
+            m_stats.m_committed += bytes;
+            if (m_stats.m_committed > m_stats.m_committed_peak)
+                m_stats.m_committed_peak = m_stats.m_committed;
+        }
+        record(xvmem_stats::COMMIT, (u64)page_size * page_count, start);
+        return ok;
+    }
+
+    // A simulated range has no content, its pages are only moved in the bitmap
+    bool xvmem_instrumented_imp::remap(void* from, void* to, u32 page_size, u32 page_count)
+    {
+        clock_t::time_point const start = clock_t::now();
+        range_t* const            src   = find(from);
+        range_t* const            dst   = find(to);
+        bool                      ok    = true;
+        if ((src != nullptr && src->m_simulated) || (dst != nullptr && dst->m_simulated))
+            ok = src == dst;
+        else
+            ok = m_backend->remap(from, to, page_size, page_count);
+        if (ok && src != nullptr)
+        {
+            s64 const bytes = mark(src, from, page_count, false);
+            src->m_committed += bytes;
+            m_stats.m_committed += bytes;
+        }
+        if (ok && dst != nullptr)
+        {
+            s64 const bytes = mark(dst, to, page_count, true);
+            dst->m_committed += bytes;
+            m_stats.m_committed += bytes;
+            if (m_stats.m_committed > m_stats.m_committed_peak)
+                m_stats.m_committed_peak = m_stats.m_committed;
+        }
+        record(xvmem_stats::REMAP, (u64)page_size * page_count, start);
+        return ok;
+    }
+
+    u64 xvmem_instrumented_imp::committed(void* address, u64 size) const
+    {
+        range_t const* const range = find(address);
+        if (range == nullptr)
+            return 0;
+        u64 const first = (u64)((xbyte*)address - range->m_base) >> range->m_page_shift;
+        u64       last  = ((u64)((xbyte*)address - range->m_base) + size + ((u64)1 << range->m_page_shift) - 1) >> range->m_page_shift;
+        if (last > (range->m_size >> range->m_page_shift))
+            last = range->m_size >> range->m_page_shift;
+        u64 pages = 0;
+        for (u64 p = first; p < last; ++p)
+            pages += (range->m_pages[p >> 6] >> (p & 63)) & 1;
+        return pages << range->m_page_shift;
+    }
+
+    void xvmem_instrumented_imp::release_ranges()
+    {
+        for (s32 i = 0; i < m_num_ranges; ++i)
+            m_heap->deallocate(m_ranges[i].m_pages);
+        m_num_ranges = 0;
+    }
+
+    xvmem_instrumented* gCreateInstrumentedVirtualMemory(alloc_t* heap, xvmem* backend, bool simulate)
+    {
+        void* mem = heap->allocate(sizeof(xvmem_instrumented_imp), sizeof(void*));
+        return new (mem) xvmem_instrumented_imp(heap, backend, simulate);
+    }
+
+    void gReleaseInstrumentedVirtualMemory(alloc_t* heap, xvmem_instrumented* vmem)
+    {
+        xvmem_instrumented_imp* imp = (xvmem_instrumented_imp*)vmem;
+        imp->release_ranges();
+        imp->~xvmem_instrumented_imp();
+        heap->deallocate(imp);
+    }
+
+}; // namespace xcore
@@ -17,6 +17,8 @@ namespace xcore
         void clr(u32 count, u16* l1, u16* l2, u32 bin);
         bool get(u32 count, u16 const* l2, u32 bin) const;
         s32  find(u32 count, u16 const* l1, u16 const* l2) const;
+        s32  upper(u32 count, u16 const* l1, u16 const* l2, u32 pivot) const; // Find the first '0' bit at or after 'pivot'
+        s32  next(u32 count, u16 const* l2, u32 pivot) const;                  // Find the first '1' bit at or after 'pivot'
         s32  findandset(u32 count, u16* l1, u16* l2);
 
         u32 m_l0;
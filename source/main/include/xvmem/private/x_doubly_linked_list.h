@@ -44,26 +44,24 @@ namespace xcore
         inline void operator=(const llhead_t& head) { m_index = head.m_index; }
     };
 
+    // The nodes are items of 'm_itemsize' bytes in one flat array, an index is the item number in that array
     struct lldata_t
     {
         void* m_data;
-        u32 m_pagesize;
-        u32 m_itemsize;
+        u32   m_itemsize;
 
         llnode_t* idx2node(llindex_t i)
         {
             if (i == llnode_t::NIL)
                 return nullptr;
-            return (llnode_t*)((uptr)m_data + ((uptr)m_pagesize * (i >> 16)) + ((uptr)m_itemsize * (i & 0xFFFF)));
+            return (llnode_t*)((uptr)m_data + ((uptr)m_itemsize * i));
         }
 
         llindex_t node2idx(llnode_t* node)
         {
             if (node == nullptr)
-                return llindex_t();
-            u32 const page_index = (u32)(((uptr)node - (uptr)m_data) / m_pagesize);
-            u32 const item_index = (u32)(((uptr)node - (uptr)m_data) & (m_pagesize - 1)) / m_itemsize;
-            return (page_index << 16) | item_index;
+                return llnode_t::NIL;
+            return (llindex_t)(((uptr)node - (uptr)m_data) / m_itemsize);
         }
     };
 
@@ -74,7 +72,7 @@ namespace xcore
             , m_size_max(0)
         {
         }
-        inline llist_t(u16 size, u16 size_max)
+        inline llist_t(u32 size, u32 size_max)
             : m_size(size)
             , m_size_max(size_max)
         {
@@ -84,7 +82,7 @@ namespace xcore
         inline bool is_empty() const { return m_size == 0; }
         inline bool is_full() const { return m_size == m_size_max; }
 
-        void        initialize(lldata_t& data, u16 start, u16 size, u16 max_size);
+        void        initialize(lldata_t& data, u32 start, u32 size, u32 max_size);
         inline void reset()
         {
             m_size = 0;
@@ -112,8 +110,8 @@ namespace xcore
             return i;
         }
 
-        u16      m_size;
-        u16      m_size_max;
+        u32      m_size;
+        u32      m_size_max;
         llhead_t m_head;
     };
 
@@ -0,0 +1,49 @@
+#ifndef __X_ALLOCATOR_VIRTUAL_COALESCE_ALLOCATOR_H__
+#define __X_ALLOCATOR_VIRTUAL_COALESCE_ALLOCATOR_H__
+#include "xbase/x_target.h"
+#ifdef USE_PRAGMA_ONCE
+#pragma once
+#endif
+
+namespace xcore
+{
+    // Forward declares
+    class alloc_t;
+    class xvmem;
+
+    // Configuration of a 'Coalesce Allocator Direct', the default is the first tier:
+    //   - Size range: 4 KB <= Size <= 64 KB, size alignment 256 B
+    //   - Memory range 512 MB
+    // The second tier would be:
+    //   - Size range: 64 KB < Size <= 512 KB, size alignment 4 KB
+    //   - Memory range 512 MB
+    struct xcoalesce_config
+    {
+        static inline u32 KB(u32 value) { return value * (u32)1024; }
+        static inline u32 MB(u32 value) { return value * (u32)1024 * (u32)1024; }
+        static inline u64 MBx(u64 value) { return value * (u64)1024 * (u64)1024; }
+        static inline u64 GBx(u64 value) { return value * (u64)1024 * (u64)1024 * (u64)1024; }
+
+        xcoalesce_config()
+            : m_address_range(MBx(512))
+            , m_size_min(KB(4))
+            , m_size_max(KB(64))
+            , m_size_step(256)
+            , m_max_allocs(16384)
+        {
+        }
+
+        u64 m_address_range; // The memory range that is reserved and managed
+        u32 m_size_min;      // Minimum allocation size, smaller requests are rounded up to this size
+        u32 m_size_max;      // Maximum allocation size
+        u32 m_size_step;     // Size alignment (power-of-2), this is also the maximum supported alignment
+        u32 m_max_allocs;    // Maximum number of live allocations, determines the size of the bookkeeping
+    };
+
+    // A best-fit coalescing allocator, all bookkeeping data is outside of the managed memory and physical
+    // pages are committed on allocation and decommitted on deallocation. Suitable for GPU memory.
+    extern alloc_t* gCreateVmCoalesceAllocator(alloc_t* main_heap, xvmem* vmem, xcoalesce_config const& cfg);
+
+}; // namespace xcore
+
+#endif // __X_ALLOCATOR_VIRTUAL_COALESCE_ALLOCATOR_H__
@@ -10,6 +10,23 @@ namespace xcore
     // Forward declares
     class alloc_t;
     class xvmem;
+    class xvmem_shared;
+
+    // A histogram of allocation sizes, e.g. captured from a running application
+    struct xvmem_size_histogram
+    {
+        u32        m_count;  // Number of entries
+        u32 const* m_sizes;  // Allocation size of each entry
+        u64 const* m_counts; // Number of allocations of each entry
+    };
+
+    // Memory pressure, invoked when the committed memory of an allocator reaches its soft or hard limit after its
+    // caches have been flushed. Deallocating from within 'pressure' is allowed, allocating from the same allocator is not.
+    class xvmem_pressure
+    {
+    public:
+        virtual void pressure(u64 committed, u64 limit) = 0;
+    };
 
     struct xvmem_config
     {
@@ -18,15 +35,193 @@ namespace xcore
         static inline u64 MBx(u64 value) { return value * (u64)1024 * (u64)1024; }
         static inline u64 GBx(u64 value) { return value * (u64)1024 * (u64)1024 * (u64)1024; }
 
+        // Debug modes, every mode also does the checks of the modes before it
+        enum
+        {
+            DEBUG_OFF    = 0, // No checks, the production layout
+            DEBUG_CANARY = 1, // Canary bytes right after every allocation, verified on deallocation
+            DEBUG_POISON = 2, // Allocations are filled with 0xCD, freed allocations and internal bookkeeping with 0xFE
+            DEBUG_GUARD  = 3, // Single allocation chunks end flush against a decommitted page
+        };
+
         xvmem_config()
+            : m_debug_mode(DEBUG_OFF)
+            , m_internal_heap_pre_size(MB(2))
+            , m_internal_fsa_pre_size(MB(2))
+            , m_address_range(0)
+            , m_bin_shift(0)
+            , m_size_histogram(nullptr)
+            , m_num_bin_sizes(0)
+            , m_bin_sizes(nullptr)
+            , m_capture_sizes(false)
+            , m_thread_private_chunks(false)
+            , m_cache_coloring(false)
+            , m_per_cpu_caches(false)
+            , m_commit_soft_limit(0)
+            , m_commit_hard_limit(0)
+            , m_pressure(nullptr)
+            , m_cgroup_limits(false)
         {
         }
 
+        u32 m_debug_mode;
+        u32 m_internal_heap_pre_size; // Committed at initialization for the internal heap, 0 commits everything on demand
+        u32 m_internal_fsa_pre_size;  // Committed at initialization for the internal fsa, 0 commits everything on demand
+        u64 m_address_range;          // Address range of the chunks in 1 GB blocks, every chunk size in use takes a block, 0 is 128 GB
+
+        // Size classes, 0 uses the built-in table, otherwise a table with 2^m_bin_shift size classes per power of two
+        // is generated (2 = ~25%, 3 = ~12.5% and 4 = ~6% allocation waste). With a histogram the size classes that
+        // are rarely used are merged into their neighbour, only the classes on a ~25% grid are always kept.
+        // A list of size classes (e.g. from gVmParseSizeClasses) keeps exactly those and ignores the histogram.
+        u32                         m_bin_shift;
+        xvmem_size_histogram const* m_size_histogram;
+        u32                         m_num_bin_sizes;
+        u32 const*                  m_bin_sizes;
+
+        bool m_capture_sizes; // Records a histogram of the requested sizes, see gVmAllocatorSizeHistogram
+
+        // A thread never receives slots from a chunk that another thread is filling, so small objects of different
+        // threads do not share cache lines. Calls into the allocator still have to be serialized. Up to 127 live threads
+        // have chunks of their own, the others use the shared chunks. The chunks of a thread that exits without
+        // gVmAllocatorReleaseThread are shared again when a later thread reuses its owner.
+        bool m_thread_private_chunks;
+
+        // Large (single allocation) chunks place their allocation at an offset that cycles through the cache lines
+        // of a page, so power-of-2 sized buffers do not all map to the same cache sets. Ignored in the debug modes.
+        bool m_cache_coloring;
+
+        // Makes the allocator thread-safe. On Linux x86-64 the sizes up to 1 KB are served from a cache per CPU and
+        // size class without a lock or atomics (restartable sequences), so the cached memory scales with the number of
+        // cores and not with the number of threads. The caches are returned to the chunks before a compaction, walk,
+        // scavenge or flush. Ignored by a shared allocator, without rseq and membarrier (Linux 5.10), in the debug
+        // modes and while capturing sizes every call takes the lock.
+        bool m_per_cpu_caches;
+
+        // Limits on the committed bytes (chunks and bookkeeping), 0 is no limit. At the soft limit the caches are flushed
+        // and 'm_pressure' is called once, until the committed bytes are below the soft limit again. At the hard limit
+        // this happens for every request that needs memory to be committed, when it did not help 'allocate' returns nullptr.
+        // With 'm_cgroup_limits' the memory.high and memory.max of the cgroup (v2) lower the soft and hard limit.
+        u64             m_commit_soft_limit;
+        u64             m_commit_hard_limit;
+        xvmem_pressure* m_pressure;
+        bool            m_cgroup_limits;
     };
 
     // A virtual memory allocator, suitable for CPU as well as GPU memory
     extern alloc_t* gCreateVmAllocator(alloc_t* main_heap, xvmem* vmem, xvmem_config const* const cfg);
 
+    // An allocator in shared memory (see gCreateSharedVirtualMemory), the first call creates it with 'cfg' and the calls
+    // in other processes attach to it, so allocations can be handed between processes without copying. Calls are
+    // serialized by a process-shared mutex. Releasing it only releases the local handle, the allocator lives as long as
+    // the shared memory. Thread-private chunks and the pressure callback are not supported, nullptr on failure.
+    // On a persistent heap (gOpenPersistentVirtualMemory) that is opened again it attaches to the allocator in the file,
+    // this fails when the version does not match or the previous process died in the middle of a call.
+    // Attaching also fails when the process that creates the allocator dies before it is done.
+    // When a process dies in the middle of a call the allocator is poisoned, every later call in every process fails
+    // (allocate returns nullptr, the other calls return 0).
+    extern alloc_t* gCreateSharedVmAllocator(alloc_t* main_heap, xvmem_shared* vmem, xvmem_config const* const cfg);
+
+    // A pointer in the shared memory of a shared allocator for the application, e.g. to find its data structures again
+    // after a warm restart. nullptr for a process local allocator.
+    extern void** gVmAllocatorSharedRoot(alloc_t* vmalloc);
+
+    // Allocates zeroed memory from allocator 'vmalloc', freshly committed memory is known to be zero and is not cleared
+    extern void* gVmAllocatorAllocateZeroed(alloc_t* vmalloc, u32 size, u32 alignment);
+
+    // Grows allocation 'ptr' to 'size' bytes, a smaller size keeps it as it is. An allocation with a chunk of its own
+    // (a large one) is not copied, its chunk commits more pages or its pages are moved to a larger chunk (see
+    // xvmem::remap). Returns nullptr when it fails, 'ptr' is still valid then.
+    extern void* gVmAllocatorReallocate(alloc_t* vmalloc, void* ptr, u32 size, u32 alignment);
+
+    // A ring buffer for streaming I/O, its pages are mapped twice back to back so [ring, ring + 2 * size) can be read and
+    // written across the end of the ring without a split copy. 'size' is rounded up to a power of 2 of at least the page
+    // size. Returns nullptr when the xvmem does not support mirrored pages (only Linux does), in a debug mode or when it
+    // does not fit in a chunk. Release it with gVmAllocatorDeallocateRing, not with 'deallocate'.
+    extern void* gVmAllocatorAllocateRing(alloc_t* vmalloc, u32& size);
+    extern void  gVmAllocatorDeallocateRing(alloc_t* vmalloc, void* ring);
+
+    // Returns true when 'ptr' is inside the address range that is managed by allocator 'vmalloc'
+    extern bool gVmAllocatorOwns(alloc_t* vmalloc, void* ptr);
+
+    // Returns the usable size of allocation 'ptr', which was allocated from allocator 'vmalloc'
+    extern u32 gVmAllocatorGetSize(alloc_t* vmalloc, void* ptr);
+
+    // Compaction hints, for applications that are able to move some of their objects (e.g. hash tables, object pools).
+    // The allocator reports the chunks that have a low occupancy and the live allocations in them, an allocation is
+    // moved by allocating a new one, copying the object and deallocating the old one. Allocations are served from
+    // the fullest chunks, so moved objects end up in well occupied chunks and the drained chunks are released.
+    class xvmem_compactor
+    {
+    public:
+        // A chunk with 'used' out of 'capacity' allocations of 'alloc_size', return false to skip this chunk
+        virtual bool chunk(u32 alloc_size, u32 used, u32 capacity) = 0;
+
+        // A live allocation in the current chunk, deallocating 'ptr' is allowed
+        virtual void relocate(void* ptr, u32 size) = 0;
+    };
+
+    // Visits the chunks of allocator 'vmalloc' (created with gCreateVmAllocator) that are less than 'occupancy_percentage'
+    // occupied, returns the number of chunks that were drained and released.
+    extern u32 gVmAllocatorCompact(alloc_t* vmalloc, u32 occupancy_percentage, xvmem_compactor* compactor);
+
+    // Pre-warming, checks out and commits the chunks for 'count' allocations of 'size' ahead of a latency critical
+    // section, with 'prefault' their pages are also faulted in. These chunks are pinned, they are not released when
+    // they become empty. Returns the number of chunks that were checked out.
+    extern u32 gVmAllocatorPrewarm(alloc_t* vmalloc, u32 size, u32 count, bool prefault);
+
+    // Unpins the pre-warmed chunks for allocations of 'size', returns the number of (empty) chunks that were released
+    extern u32 gVmAllocatorUnpin(alloc_t* vmalloc, u32 size);
+
+    // Returns the committed bytes of allocator 'vmalloc', including the cached chunks and the bookkeeping data
+    extern u64 gVmAllocatorCommitted(alloc_t* vmalloc);
+
+    // Decommits the cached chunks, the free pages inside the used chunks (see gVmAllocatorScavenge) and the page cache
+    // of the bookkeeping data, returns the number of bytes
+    extern u64 gVmAllocatorFlush(alloc_t* vmalloc);
+
+    // Decommits the pages inside the partially used chunks that have no live allocation on them, e.g. from an idle
+    // timer. They are committed again when an allocation is placed on them. Returns the number of bytes.
+    extern u64 gVmAllocatorScavenge(alloc_t* vmalloc);
+
+    // Shares the chunks that the calling thread is filling (see xvmem_config::m_thread_private_chunks) with the other
+    // threads again, call it before a thread exits.
+    extern void gVmAllocatorReleaseThread(alloc_t* vmalloc);
+
+    // Workload adaptive size classes. Capture a histogram with xvmem_config::m_capture_sizes, fit size classes to
+    // it (see the xvmem_binfit tool) and load them at startup through xvmem_config::m_bin_sizes.
+
+    // Copies the captured histogram of allocator 'vmalloc', the sizes are rounded up to ~3%. Returns the number of entries.
+    extern u32 gVmAllocatorSizeHistogram(alloc_t* vmalloc, u32* sizes, u64* counts, u32 max_count);
+
+    // Picks at most 'max_bins' size classes out of the table with 'bin_shift' (0 is the built-in one) that minimize the
+    // internal waste plus the unused chunk tails for 'histogram'. Above the largest size in the histogram the classes of
+    // a ~25% grid are added. Returns the number of sizes written to 'bin_sizes', 'heap' is used for temporary memory.
+    extern u32 gVmFitSizeClasses(alloc_t* heap, xvmem_size_histogram const* histogram, u32 bin_shift, u32 max_bins, u32* bin_sizes, u32 max_sizes);
+
+    // The bytes that 'histogram' would waste with the given size classes, with 'num_bin_sizes' 0 all size classes of the
+    // table with 'bin_shift' are used.
+    extern u64 gVmSizeClassWaste(alloc_t* heap, xvmem_size_histogram const* histogram, u32 bin_shift, u32 const* bin_sizes, u32 num_bin_sizes);
+
+    // Parses the text written by xvmem_binfit ("bin_shift <n>" and "bins <size> <size> ..." lines, '#' comments).
+    // Returns the number of sizes written to 'bin_sizes', 0 when the text is not valid.
+    extern u32 gVmParseSizeClasses(char const* text, u32 length, u32& bin_shift, u32* bin_sizes, u32 max_sizes);
+
+    // Heap walking, enumerates all live allocations of an allocator in address order.
+    class xvmem_walker
+    {
+    public:
+        // A live allocation with its size and associated value (0xffffffff when not set), return false to stop
+        virtual bool allocation(void* ptr, u32 size, u32 assoc) = 0;
+    };
+
+    // Walks the live allocations of allocator 'vmalloc' (created with gCreateVmAllocator), do not allocate or deallocate
+    // from within 'walker'.
+    extern void gVmAllocatorWalk(alloc_t* vmalloc, xvmem_walker* walker);
+
+    // The same walk for an allocator that is paused (e.g. a crash handler), it does not allocate, lock or assert and
+    // verifies all bookkeeping data before using it. Returns false when it stopped at corrupted bookkeeping data.
+    extern bool gVmAllocatorWalkPaused(alloc_t* vmalloc, xvmem_walker* walker);
+
 }; // namespace xcore
 
-#endif // __X_ALLOCATOR_VIRTUAL_ALLOCATOR_H__
\ No newline at end of file
+#endif // __X_ALLOCATOR_VIRTUAL_ALLOCATOR_H__
\ No newline at end of file
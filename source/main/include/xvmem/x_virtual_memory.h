@@ -7,9 +7,22 @@
 
 namespace xcore
 {
+    class alloc_t;
+
+    // A range of pages for a batched commit or decommit
+    struct xvmem_range
+    {
+        void* m_address;
+        u32   m_page_count;
+    };
+
     class xvmem
     {
     public:
+        // Reserve attribute of a range that is handed out by an allocator that keeps its bookkeeping elsewhere, the
+        // allocator itself does not read or write it (except for zeroed allocations and the debug modes)
+        static const u32 ATTR_MANAGED = 0x40000000;
+
         virtual bool initialize(u32 pagesize) = 0;
 
         virtual bool reserve(u64 address_range, u32& page_size, u32 attributes, void*& baseptr) = 0;
@@ -17,11 +30,112 @@ namespace xcore
 
         virtual bool commit(void* address, u32 page_size, u32 page_count)   = 0;
         virtual bool decommit(void* address, u32 page_size, u32 page_count) = 0;
+
+        // Faults in committed pages ahead of their first use, the default does nothing
+        virtual bool prefault(void* address, u32 page_size, u32 page_count) { return true; }
+
+        // Commits or decommits a batch of ranges, 'ranges' is sorted in place. The default merges the ranges that are
+        // adjacent and calls commit or decommit once per merged run.
+        virtual bool commit_ranges(xvmem_range* ranges, u32 count, u32 page_size);
+        virtual bool decommit_ranges(xvmem_range* ranges, u32 count, u32 page_size);
+
+        // Commits 'page_count' pages that are mapped twice, at 'address' and right after it, in a reserved range of
+        // 2 * 'page_count' pages. A write through one of them is visible through the other one, a commit or decommit
+        // of the range replaces them. The default does not support it (only Linux does, with a memfd).
+        virtual bool commit_mirrored(void* address, u32 page_size, u32 page_count) { return false; }
+
+        // Moves 'page_count' committed pages from 'from' to 'to' without copying their content, the pages at 'to' are
+        // replaced and 'from' is left decommitted. The default does not support it (only Linux does, with mremap).
+        virtual bool remap(void* from, void* to, u32 page_size, u32 page_count) { return false; }
     };
 
     extern bool   gInitVirtualMemory();
     extern xvmem* gGetVirtualMemory();
 
+    // Virtual memory in a shared memory object (memfd) that every process maps at the same address, so pointers into
+    // it are valid in all of them. Every reserve is a range inside of it, commit allocates the backing pages and
+    // decommit releases them for all processes. The first page holds the header and a zero initialized root block.
+    class xvmem_shared : public xvmem
+    {
+    public:
+        // The file descriptor of the shared memory, hand it to another process (SCM_RIGHTS, /proc/<pid>/fd/<fd>)
+        virtual s32 fd() const = 0;
+
+        // The root block, the same in every process, nullptr when 'size' does not fit in the first page
+        virtual void* root(u32 size) = 0;
+
+        // True for a persistent heap that was left behind by an earlier process, no other process is using it
+        virtual bool reopened() const = 0;
+    };
+
+    // Creates shared memory with an address range of 'size' bytes, nullptr when not supported (only on Linux)
+    extern xvmem_shared* gCreateSharedVirtualMemory(alloc_t* heap, u64 size);
+
+    // Maps the shared memory of 'fd' (the fd is duplicated), nullptr when its address range is not free in this process.
+    // Open it early, before the address space of the process gets crowded.
+    extern xvmem_shared* gOpenSharedVirtualMemory(alloc_t* heap, s32 fd);
+
+    // A persistent heap, the same shared memory in file 'path' (MAP_SHARED). A new file gets 'size' bytes of address range
+    // at 'address' (nullptr lets the OS pick, pick a fixed one to be able to map it again after a restart), an existing
+    // one is mapped at the address it was created at. The file is locked (flock) while it is open. Returns nullptr when
+    // the file is in use, its header is not valid or its address range is taken.
+    extern xvmem_shared* gOpenPersistentVirtualMemory(alloc_t* heap, char const* path, u64 size, void* address);
+
+    // Unmaps the shared memory, it is freed when the last process has released it (a file keeps its content)
+    extern void gReleaseSharedVirtualMemory(alloc_t* heap, xvmem_shared* vmem);
+
+    // The calls of an instrumented xvmem per operation, with a latency histogram where bucket 'i' counts the calls that
+    // took [2^i, 2^(i+1)) nanoseconds
+    struct xvmem_stats
+    {
+        enum
+        {
+            RESERVE  = 0,
+            RELEASE  = 1,
+            COMMIT   = 2,
+            DECOMMIT = 3,
+            REMAP    = 4,
+            NUM_OPS  = 5,
+        };
+        static const s32 c_latency_buckets = 32;
+
+        struct op_t
+        {
+            u64 m_count;
+            u64 m_bytes;
+            u64 m_latency[c_latency_buckets];
+        };
+
+        op_t m_ops[NUM_OPS];
+        u64  m_committed;      // Committed bytes of the ranges that are reserved now
+        u64  m_committed_peak;
+    };
+
+    // Forwards to another xvmem and counts the calls, the bytes and their latency. A simulated one does not commit the
+    // ranges that are reserved with ATTR_MANAGED, it tracks their pages in a bitmap, so a test can check exactly what
+    // is committed and a benchmark can run an allocator with a 1 TB address range without using that memory. Calls
+    // have to be serialized, like the calls of the allocators that use it.
+    class xvmem_instrumented : public xvmem
+    {
+    public:
+        virtual void stats(xvmem_stats& stats) const = 0;
+        virtual void reset_stats()                   = 0; // Keeps the committed bytes
+
+        // The committed bytes of [address, address + size) in a range that is reserved now
+        virtual u64 committed(void* address, u64 size) const = 0;
+
+        // A commit that would take the committed bytes past 'bytes' fails, like one on a full tmpfs (ENOSPC). 0 lets
+        // every commit through.
+        virtual void fail_commits_above(u64 bytes) = 0;
+    };
+
+    extern xvmem_instrumented* gCreateInstrumentedVirtualMemory(alloc_t* heap, xvmem* backend, bool simulate);
+    extern void                gReleaseInstrumentedVirtualMemory(alloc_t* heap, xvmem_instrumented* vmem);
+
+    // Reads memory.high and memory.max of the cgroup (v2) of this process, 0 when there is no limit. Returns false when
+    // they are not available (not Linux, cgroup v1 or no cgroup file system).
+    extern bool gVmCgroupMemoryLimits(u64& high, u64& max);
+
 }; // namespace xcore
 
-#endif /// __X_VMEM_VIRTUAL_MEMORY_INTERFACE_H__
\ No newline at end of file
+#endif /// __X_VMEM_VIRTUAL_MEMORY_INTERFACE_H__
\ No newline at end of file
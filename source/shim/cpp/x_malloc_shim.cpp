@@ -0,0 +1,356 @@
+#include "xbase/x_target.h"
+#include "xbase/x_allocator.h"
+#include "xbase/x_integer.h"
+
+#include "xvmem/x_virtual_main_allocator.h"
+#include "xvmem/x_virtual_memory.h"
+
+// A drop-in replacement of malloc/free and the C++ new/delete operators, build it as a shared object and
+// use it with LD_PRELOAD. All requests are routed to a process global superallocator (gCreateVmAllocator),
+// requests that it cannot serve and every pointer outside of its address range go to the system allocator.
+//
+// Early initialization: the superallocator is created on the first request, a request that arrives while
+// it is being created (e.g. from the same thread or another thread) is served by the system allocator. All
+// state is constant initialized so that a request can arrive before any static constructor has run.
+
+#if defined TARGET_LINUX
+
+#include <dlfcn.h>
+#include <errno.h>
+#include <pthread.h>
+#include <string.h>
+#include <atomic>
+#include <new>
+
+// The glibc allocator under its internal names, these never call back into the shim
+extern "C" void* __libc_malloc(size_t size);
+extern "C" void  __libc_free(void* ptr);
+extern "C" void* __libc_calloc(size_t count, size_t size);
+extern "C" void* __libc_realloc(void* ptr, size_t size);
+extern "C" void* __libc_memalign(size_t alignment, size_t size);
+
+namespace xcore
+{
+    static const size_t c_shim_max_size      = 256 * 1024 * 1024; // Larger requests go to the system allocator
+    static const size_t c_shim_max_alignment = 4096;              // Larger alignments go to the system allocator
+    static const size_t c_shim_min_alignment = 16;                // The alignment that malloc guarantees
+
+    enum
+    {
+        SHIM_UNINITIALIZED = 0,
+        SHIM_INITIALIZING  = 1,
+        SHIM_READY         = 2,
+        SHIM_FAILED        = 3,
+    };
+
+    // Hands out the memory for the allocator object, we cannot use malloc for that
+    class xshim_heap_t : public alloc_t
+    {
+    public:
+        xshim_heap_t()
+            : m_used(0)
+        {
+        }
+
+    protected:
+        virtual void* v_allocate(u32 size, u32 alignment)
+        {
+            u32 const offset = xalignUp(m_used, alignment);
+            if ((offset + size) > sizeof(m_buffer))
+                return nullptr;
+            m_used = offset + size;
+            return &m_buffer[offset];
+        }
+
+        virtual u32  v_deallocate(void* ptr) { return 0; }
+        virtual void v_release() {}
+
+        u32   m_used;
+        xbyte m_buffer[8192];
+    };
+
+    static std::atomic<s32> s_shim_state(SHIM_UNINITIALIZED);
+    static pthread_mutex_t  s_shim_lock = PTHREAD_MUTEX_INITIALIZER;
+    static alloc_t*         s_shim_allocator;
+    static u64              s_shim_heap_mem[(sizeof(xshim_heap_t) + sizeof(u64) - 1) / sizeof(u64)];
+
+    typedef size_t (*xshim_usable_size_fn)(void*);
+    static std::atomic<xshim_usable_size_fn> s_shim_libc_usable_size(nullptr);
+
+    // The superallocator is not thread-safe, all calls into it are serialized. A waiter spins for a short while
+    // (the calls are short) and then sleeps on the mutex, so a preempted holder and the fork handler are not
+    // starved by threads that keep taking the lock.
+    static void shim_lock()
+    {
+        for (u32 spins = 0; spins < 64; ++spins)
+        {
+            if (pthread_mutex_trylock(&s_shim_lock) == 0)
+                return;
+#if defined __x86_64__ || defined __i386__
+            __builtin_ia32_pause();
+#elif defined __aarch64__
+            __asm__ __volatile__("yield");
+#endif
+        }
+        pthread_mutex_lock(&s_shim_lock);
+    }
+
+    static void shim_unlock() { pthread_mutex_unlock(&s_shim_lock); }
+
+    struct xshim_lock_t
+    {
+        xshim_lock_t() { shim_lock(); }
+        ~xshim_lock_t() { shim_unlock(); }
+    };
+
+    // The lock is held across fork, so the child does not inherit it from a thread that no longer exists there
+    // and the allocator is not in the middle of a call
+    static void shim_fork_prepare() { shim_lock(); }
+    static void shim_fork_parent() { shim_unlock(); }
+    static void shim_fork_child() { shim_unlock(); }
+
+    static bool shim_ready()
+    {
+        s32 const state = s_shim_state.load(std::memory_order_acquire);
+        if (state == SHIM_READY)
+            return true;
+        if (state != SHIM_UNINITIALIZED)
+            return false;
+
+        xshim_lock_t lock;
+        if (s_shim_state.load(std::memory_order_relaxed) == SHIM_UNINITIALIZED)
+        {
+            s_shim_state.store(SHIM_INITIALIZING, std::memory_order_relaxed);
+            bool ok = gInitVirtualMemory();
+            if (ok)
+            {
+                xshim_heap_t* heap = new (s_shim_heap_mem) xshim_heap_t();
+                s_shim_allocator   = gCreateVmAllocator(heap, gGetVirtualMemory(), nullptr);
+                ok                 = s_shim_allocator != nullptr;
+            }
+
+            // Registering may allocate, while initializing that is served by the system allocator
+            if (ok)
+                ok = pthread_atfork(shim_fork_prepare, shim_fork_parent, shim_fork_child) == 0;
+            s_shim_state.store(ok ? SHIM_READY : SHIM_FAILED, std::memory_order_release);
+        }
+        return s_shim_state.load(std::memory_order_acquire) == SHIM_READY;
+    }
+
+    static inline bool shim_owns(void* ptr) { return s_shim_state.load(std::memory_order_acquire) == SHIM_READY && gVmAllocatorOwns(s_shim_allocator, ptr); }
+
+    // Returns nullptr when the superallocator cannot serve this request
+    static void* shim_allocate(size_t size, size_t alignment, bool zero)
+    {
+        if (size > c_shim_max_size || alignment > c_shim_max_alignment || !shim_ready())
+            return nullptr;
+
+        if (alignment < c_shim_min_alignment)
+            alignment = c_shim_min_alignment;
+        if (size == 0)
+            size = 1;
+
+        void* ptr;
+        {
+            xshim_lock_t lock;
+            ptr = zero ? gVmAllocatorAllocateZeroed(s_shim_allocator, (u32)size, (u32)alignment) : s_shim_allocator->allocate((u32)size, (u32)alignment);
+            if (ptr != nullptr && ((uptr)ptr & (alignment - 1)) != 0)
+            {
+                // The bin does not give us this alignment
+                s_shim_allocator->deallocate(ptr);
+                ptr = nullptr;
+            }
+        }
+        return ptr;
+    }
+
+    static void shim_deallocate(void* ptr)
+    {
+        xshim_lock_t lock;
+        s_shim_allocator->deallocate(ptr);
+    }
+
+    static size_t shim_get_size(void* ptr)
+    {
+        xshim_lock_t lock;
+        return gVmAllocatorGetSize(s_shim_allocator, ptr);
+    }
+
+    static void* shim_malloc(size_t size, size_t alignment)
+    {
+        void* ptr = shim_allocate(size, alignment, false);
+        if (ptr == nullptr)
+            ptr = (alignment <= c_shim_min_alignment) ? __libc_malloc(size) : __libc_memalign(alignment, size);
+        return ptr;
+    }
+
+    static void shim_free(void* ptr)
+    {
+        if (ptr == nullptr)
+            return;
+        if (shim_owns(ptr))
+            shim_deallocate(ptr);
+        else
+            __libc_free(ptr);
+    }
+
+    static inline bool shim_is_valid_alignment(size_t alignment) { return alignment != 0 && (alignment & (alignment - 1)) == 0; }
+
+} // namespace xcore
+
+using namespace xcore;
+
+extern "C" void* malloc(size_t size) { return shim_malloc(size, c_shim_min_alignment); }
+
+extern "C" void free(void* ptr) { shim_free(ptr); }
+
+extern "C" void* calloc(size_t count, size_t size)
+{
+    if (size != 0 && count > ((size_t)-1 / size))
+    {
+        errno = ENOMEM;
+        return nullptr;
+    }
+    void* ptr = shim_allocate(count * size, c_shim_min_alignment, true);
+    if (ptr == nullptr)
+        return __libc_calloc(count, size);
+    return ptr;
+}
+
+extern "C" void* realloc(void* ptr, size_t size)
+{
+    if (ptr == nullptr)
+        return shim_malloc(size, c_shim_min_alignment);
+    if (size == 0)
+    {
+        shim_free(ptr);
+        return nullptr;
+    }
+    if (!shim_owns(ptr))
+        return __libc_realloc(ptr, size);
+
+    size_t const old_size = shim_get_size(ptr);
+    if (size <= old_size)
+        return ptr;
+
+    // A large allocation grows in place or its pages are moved, without copying
+    if (size <= c_shim_max_size)
+    {
+        void* new_ptr;
+        {
+            xshim_lock_t lock;
+            new_ptr = gVmAllocatorReallocate(s_shim_allocator, ptr, (u32)size, c_shim_min_alignment);
+        }
+        if (new_ptr != nullptr)
+            return new_ptr;
+    }
+
+    void* new_ptr = shim_malloc(size, c_shim_min_alignment);
+    if (new_ptr == nullptr)
+    {
+        errno = ENOMEM;
+        return nullptr;
+    }
+    memcpy(new_ptr, ptr, old_size);
+    shim_deallocate(ptr);
+    return new_ptr;
+}
+
+extern "C" int posix_memalign(void** out_ptr, size_t alignment, size_t size)
+{
+    if (!shim_is_valid_alignment(alignment) || (alignment % sizeof(void*)) != 0)
+        return EINVAL;
+    void* ptr = shim_malloc(size, alignment);
+    if (ptr == nullptr)
+        return ENOMEM;
+    *out_ptr = ptr;
+    return 0;
+}
+
+extern "C" void* aligned_alloc(size_t alignment, size_t size)
+{
+    if (!shim_is_valid_alignment(alignment))
+    {
+        errno = EINVAL;
+        return nullptr;
+    }
+    return shim_malloc(size, alignment);
+}
+
+extern "C" size_t malloc_usable_size(void* ptr)
+{
+    if (ptr == nullptr)
+        return 0;
+    if (shim_owns(ptr))
+        return shim_get_size(ptr);
+
+    // A pointer from the system allocator, dlsym may call malloc so do this outside of the lock
+    xshim_usable_size_fn fn = s_shim_libc_usable_size.load(std::memory_order_acquire);
+    if (fn == nullptr)
+    {
+        fn = (xshim_usable_size_fn)dlsym(RTLD_NEXT, "malloc_usable_size");
+        s_shim_libc_usable_size.store(fn, std::memory_order_release);
+    }
+    return fn != nullptr ? fn(ptr) : 0;
+}
+
+// C++ operators
+
+void* operator new(std::size_t size)
+{
+    void* ptr = shim_malloc(size, c_shim_min_alignment);
+    if (ptr == nullptr)
+        throw std::bad_alloc();
+    return ptr;
+}
+
+void* operator new[](std::size_t size)
+{
+    void* ptr = shim_malloc(size, c_shim_min_alignment);
+    if (ptr == nullptr)
+        throw std::bad_alloc();
+    return ptr;
+}
+
+void* operator new(std::size_t size, std::nothrow_t const&) noexcept { return shim_malloc(size, c_shim_min_alignment); }
+void* operator new[](std::size_t size, std::nothrow_t const&) noexcept { return shim_malloc(size, c_shim_min_alignment); }
+
+void operator delete(void* ptr) noexcept { shim_free(ptr); }
+void operator delete[](void* ptr) noexcept { shim_free(ptr); }
+void operator delete(void* ptr, std::nothrow_t const&) noexcept { shim_free(ptr); }
+void operator delete[](void* ptr, std::nothrow_t const&) noexcept { shim_free(ptr); }
+
+#if defined(__cpp_sized_deallocation)
+void operator delete(void* ptr, std::size_t size) noexcept { shim_free(ptr); }
+void operator delete[](void* ptr, std::size_t size) noexcept { shim_free(ptr); }
+#endif
+
+#if defined(__cpp_aligned_new)
+void* operator new(std::size_t size, std::align_val_t alignment)
+{
+    void* ptr = shim_malloc(size, (size_t)alignment);
+    if (ptr == nullptr)
+        throw std::bad_alloc();
+    return ptr;
+}
+
+void* operator new[](std::size_t size, std::align_val_t alignment)
+{
+    void* ptr = shim_malloc(size, (size_t)alignment);
+    if (ptr == nullptr)
+        throw std::bad_alloc();
+    return ptr;
+}
+
+void* operator new(std::size_t size, std::align_val_t alignment, std::nothrow_t const&) noexcept { return shim_malloc(size, (size_t)alignment); }
+void* operator new[](std::size_t size, std::align_val_t alignment, std::nothrow_t const&) noexcept { return shim_malloc(size, (size_t)alignment); }
+
+void operator delete(void* ptr, std::align_val_t alignment) noexcept { shim_free(ptr); }
+void operator delete[](void* ptr, std::align_val_t alignment) noexcept { shim_free(ptr); }
+void operator delete(void* ptr, std::size_t size, std::align_val_t alignment) noexcept { shim_free(ptr); }
+void operator delete[](void* ptr, std::size_t size, std::align_val_t alignment) noexcept { shim_free(ptr); }
+void operator delete(void* ptr, std::align_val_t alignment, std::nothrow_t const&) noexcept { shim_free(ptr); }
+void operator delete[](void* ptr, std::align_val_t alignment, std::nothrow_t const&) noexcept { shim_free(ptr); }
+#endif
+
+#endif // TARGET_LINUX
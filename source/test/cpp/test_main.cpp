@@ -12,6 +12,8 @@ UNITTEST_SUITE_LIST(xVMemUnitTest);
 UNITTEST_SUITE_DECLARE(xVMemUnitTest, doubly_linked_list);
 UNITTEST_SUITE_DECLARE(xVMemUnitTest, binmap);
 UNITTEST_SUITE_DECLARE(xVMemUnitTest, main_allocator);
+UNITTEST_SUITE_DECLARE(xVMemUnitTest, coalescealloc);
+UNITTEST_SUITE_DECLARE(xVMemUnitTest, malloc_shim);
 
 namespace xcore
 {
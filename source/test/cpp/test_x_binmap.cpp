@@ -52,6 +52,111 @@ UNITTEST_SUITE_BEGIN(binmap)
                 }
             }
         }
+
+        UNITTEST_TEST(next)
+        {
+            binmap_t bm;
+
+            u16 l1[16];
+            u16 l2[256];
+
+            // Small binmap, only uses level 0
+            bm.init(20, nullptr, 0, nullptr, 0);
+            CHECK_EQUAL(-1, bm.next(20, nullptr, 0));
+            bm.set(20, nullptr, nullptr, 3);
+            bm.set(20, nullptr, nullptr, 19);
+            CHECK_EQUAL(3, bm.next(20, nullptr, 0));
+            CHECK_EQUAL(3, bm.next(20, nullptr, 3));
+            CHECK_EQUAL(19, bm.next(20, nullptr, 4));
+            CHECK_EQUAL(-1, bm.next(20, nullptr, 20));
+
+            // Large binmap, sparse set bits separated by empty level 2 words
+            u32 const count = 2050;
+            bm.init(count, (u16*)&l1, 16, (u16*)&l2, 256);
+            CHECK_EQUAL(-1, bm.next(count, (u16*)&l2, 0));
+            for (u32 b = 5; b < count; b += 97)
+                bm.set(count, (u16*)&l1, (u16*)&l2, b);
+
+            u32 n = 0;
+            for (s32 b = bm.next(count, (u16*)&l2, 0); b >= 0; b = bm.next(count, (u16*)&l2, b + 1))
+            {
+                CHECK_EQUAL(5 + (n * 97), (u32)b);
+                n += 1;
+            }
+            CHECK_EQUAL((count - 5 + 96) / 97, n);
+        }
+
+        UNITTEST_TEST(find_past_first_level1_word)
+        {
+            binmap_t bm;
+
+            u16 l1[32];
+            u16 l2[256];
+
+            // The first free bit is in the second level 1 word
+            u32 const count = 2050;
+            bm.init(count, (u16*)&l1, 32, (u16*)&l2, 256);
+            for (u32 b = 0; b < 256 + 37; ++b)
+                bm.set(count, (u16*)&l1, (u16*)&l2, b);
+            CHECK_EQUAL(256 + 37, bm.find(count, (u16*)&l1, (u16*)&l2));
+
+            // And in the last one
+            for (u32 b = 256 + 37; b < count - 1; ++b)
+                bm.set(count, (u16*)&l1, (u16*)&l2, b);
+            CHECK_EQUAL(count - 1, bm.find(count, (u16*)&l1, (u16*)&l2));
+            bm.set(count, (u16*)&l1, (u16*)&l2, count - 1);
+            CHECK_EQUAL(-1, bm.find(count, (u16*)&l1, (u16*)&l2));
+        }
+
+        UNITTEST_TEST(upper)
+        {
+            binmap_t bm;
+
+            u16 l1[16];
+            u16 l2[256];
+
+            // Small binmap, only uses level 0
+            bm.init(20, nullptr, 0, nullptr, 0);
+            CHECK_EQUAL(0, bm.upper(20, nullptr, nullptr, 0));
+            CHECK_EQUAL(19, bm.upper(20, nullptr, nullptr, 19));
+            CHECK_EQUAL(-1, bm.upper(20, nullptr, nullptr, 20));
+            for (u32 b = 0; b < 20; b += 2)
+                bm.set(20, nullptr, nullptr, b);
+            CHECK_EQUAL(1, bm.upper(20, nullptr, nullptr, 0));
+            CHECK_EQUAL(5, bm.upper(20, nullptr, nullptr, 4));
+            CHECK_EQUAL(5, bm.upper(20, nullptr, nullptr, 5));
+            for (u32 b = 1; b < 20; b += 2)
+                bm.set(20, nullptr, nullptr, b);
+            CHECK_EQUAL(-1, bm.upper(20, nullptr, nullptr, 0));
+
+            // Large binmap, empty
+            u32 const count = 2050;
+            bm.init(count, (u16*)&l1, 16, (u16*)&l2, 256);
+            CHECK_EQUAL(0, bm.upper(count, (u16*)&l1, (u16*)&l2, 0));
+            CHECK_EQUAL(1000, bm.upper(count, (u16*)&l1, (u16*)&l2, 1000));
+            CHECK_EQUAL(count - 1, bm.upper(count, (u16*)&l1, (u16*)&l2, count - 1));
+            CHECK_EQUAL(-1, bm.upper(count, (u16*)&l1, (u16*)&l2, count));
+
+            // Partial, free bits in the same level 2 word, in a later level 2 word and in a later level 1 word
+            for (u32 b = 0; b < count; ++b)
+                bm.set(count, (u16*)&l1, (u16*)&l2, b);
+            bm.clr(count, (u16*)&l1, (u16*)&l2, 21);
+            bm.clr(count, (u16*)&l1, (u16*)&l2, 200);
+            bm.clr(count, (u16*)&l1, (u16*)&l2, 1500);
+            CHECK_EQUAL(21, bm.upper(count, (u16*)&l1, (u16*)&l2, 0));
+            CHECK_EQUAL(21, bm.upper(count, (u16*)&l1, (u16*)&l2, 16));
+            CHECK_EQUAL(21, bm.upper(count, (u16*)&l1, (u16*)&l2, 21));
+            CHECK_EQUAL(200, bm.upper(count, (u16*)&l1, (u16*)&l2, 22));
+            CHECK_EQUAL(1500, bm.upper(count, (u16*)&l1, (u16*)&l2, 201));
+            CHECK_EQUAL(-1, bm.upper(count, (u16*)&l1, (u16*)&l2, 1501));
+
+            // Full
+            bm.set(count, (u16*)&l1, (u16*)&l2, 21);
+            bm.set(count, (u16*)&l1, (u16*)&l2, 200);
+            bm.set(count, (u16*)&l1, (u16*)&l2, 1500);
+            CHECK_EQUAL(-1, bm.upper(count, (u16*)&l1, (u16*)&l2, 0));
+            CHECK_EQUAL(-1, bm.find(count, (u16*)&l1, (u16*)&l2));
+        }
     }
 }
 UNITTEST_SUITE_END
@@ -0,0 +1,243 @@
+#include "xbase/x_allocator.h"
+#include "xbase/x_integer.h"
+
+#include "xvmem/x_virtual_coalesce_allocator.h"
+#include "xvmem/x_virtual_memory.h"
+
+#include "xunittest/xunittest.h"
+
+using namespace xcore;
+
+extern alloc_t* gTestAllocator;
+
+// A virtual memory stand-in that never touches memory, it only tracks the committed pages in a plain array
+class xvmem_commit_tracker : public xvmem
+{
+public:
+    xvmem_commit_tracker()
+        : m_base((void*)((u64)1 << 40))
+        , m_page_size(4096)
+        , m_page_count(0)
+        , m_pages(nullptr)
+        , m_committed(0)
+        , m_errors(0)
+    {
+    }
+
+    virtual bool initialize(u32 pagesize)
+    {
+        m_page_size = pagesize;
+        return true;
+    }
+
+    virtual bool reserve(u64 address_range, u32& page_size, u32 attributes, void*& baseptr)
+    {
+        m_page_count = (u32)(address_range / m_page_size);
+        m_pages      = (u8*)gTestAllocator->allocate(m_page_count);
+        for (u32 i = 0; i < m_page_count; ++i)
+            m_pages[i] = 0;
+        page_size = m_page_size;
+        baseptr   = m_base;
+        return true;
+    }
+
+    virtual bool release(void* baseptr, u64 address_range)
+    {
+        gTestAllocator->deallocate(m_pages);
+        m_pages      = nullptr;
+        m_page_count = 0;
+        return true;
+    }
+
+    virtual bool commit(void* address, u32 page_size, u32 page_count)
+    {
+        u32 const page = (u32)(((u64)address - (u64)m_base) / m_page_size);
+        for (u32 i = page; i < (page + page_count); ++i)
+        {
+            m_errors += (m_pages[i] != 0) ? 1 : 0;
+            m_pages[i] = 1;
+        }
+        m_committed += page_count;
+        return true;
+    }
+
+    virtual bool decommit(void* address, u32 page_size, u32 page_count)
+    {
+        u32 const page = (u32)(((u64)address - (u64)m_base) / m_page_size);
+        for (u32 i = page; i < (page + page_count); ++i)
+        {
+            m_errors += (m_pages[i] != 1) ? 1 : 0;
+            m_pages[i] = 0;
+        }
+        m_committed -= page_count;
+        return true;
+    }
+
+    bool is_committed(void* address) const { return m_pages[((u64)address - (u64)m_base) / m_page_size] != 0; }
+
+    void* m_base;
+    u32   m_page_size;
+    u32   m_page_count;
+    u8*   m_pages;
+    u32   m_committed;
+    u32   m_errors;
+};
+
+UNITTEST_SUITE_BEGIN(coalescealloc)
+{
+    UNITTEST_FIXTURE(main)
+    {
+        xvmem_commit_tracker s_vmem;
+        xcoalesce_config     s_config;
+
+        UNITTEST_FIXTURE_SETUP()
+        {
+            s_vmem.initialize(4096);
+        }
+
+        UNITTEST_FIXTURE_TEARDOWN() {}
+
+        UNITTEST_TEST(alloc_dealloc)
+        {
+            alloc_t* a = gCreateVmCoalesceAllocator(gTestAllocator, &s_vmem, s_config);
+
+            void* p = a->allocate(4096, 256);
+            CHECK_EQUAL(s_vmem.m_base, p);
+            CHECK_TRUE(s_vmem.is_committed(p));
+            CHECK_EQUAL(1, s_vmem.m_committed);
+
+            CHECK_EQUAL(4096, a->deallocate(p));
+            CHECK_FALSE(s_vmem.is_committed(p));
+            CHECK_EQUAL(0, s_vmem.m_committed);
+
+            // Requests below the minimum size are rounded up, above the maximum size fail
+            p = a->allocate(100, 8);
+            CHECK_EQUAL(4096, a->deallocate(p));
+            CHECK_NULL(a->allocate(s_config.m_size_max + 1, 256));
+
+            CHECK_EQUAL(0, s_vmem.m_errors);
+            a->release();
+        }
+
+        UNITTEST_TEST(best_fit)
+        {
+            alloc_t* a    = gCreateVmCoalesceAllocator(gTestAllocator, &s_vmem, s_config);
+            xbyte*   base = (xbyte*)s_vmem.m_base;
+
+            void* p0 = a->allocate(8192, 256);
+            void* p1 = a->allocate(16384, 256);
+            void* p2 = a->allocate(4096, 256);
+            void* p3 = a->allocate(8192, 256);
+            void* p4 = a->allocate(4096, 256);
+            CHECK_EQUAL(base + 36864, (xbyte*)p4);
+
+            // Holes of 16 KB and 8 KB, an 8 KB request should take the 8 KB hole
+            a->deallocate(p1);
+            a->deallocate(p3);
+            void* p5 = a->allocate(8192, 256);
+            CHECK_EQUAL(p3, p5);
+
+            // A 12 KB request splits the 16 KB hole, a 4 KB request takes the 4 KB remainder
+            void* p6 = a->allocate(12288, 256);
+            CHECK_EQUAL(p1, p6);
+            void* p7 = a->allocate(4096, 256);
+            CHECK_EQUAL(base + 8192 + 12288, (xbyte*)p7);
+
+            a->deallocate(p0);
+            a->deallocate(p2);
+            a->deallocate(p4);
+            a->deallocate(p5);
+            a->deallocate(p6);
+            a->deallocate(p7);
+            CHECK_EQUAL(0, s_vmem.m_committed);
+            CHECK_EQUAL(0, s_vmem.m_errors);
+            a->release();
+        }
+
+        UNITTEST_TEST(coalesce)
+        {
+            alloc_t* a = gCreateVmCoalesceAllocator(gTestAllocator, &s_vmem, s_config);
+
+            void* p[16];
+            for (s32 i = 0; i < 16; ++i)
+                p[i] = a->allocate(4096, 256);
+            CHECK_EQUAL(16, s_vmem.m_committed);
+
+            // Freeing 3 neighbours should give us one 12 KB hole, freeing the middle one last
+            a->deallocate(p[2]);
+            a->deallocate(p[4]);
+            a->deallocate(p[3]);
+            void* q = a->allocate(12288, 256);
+            CHECK_EQUAL(p[2], q);
+            a->deallocate(q);
+
+            // Free the odd ones first so that the even ones merge with both neighbours
+            for (s32 i = 15; i >= 0; i -= 2)
+            {
+                if (i != 3)
+                    a->deallocate(p[i]);
+            }
+            for (s32 i = 0; i < 16; i += 2)
+            {
+                if (i != 2 && i != 4)
+                    a->deallocate(p[i]);
+            }
+            CHECK_EQUAL(0, s_vmem.m_committed);
+
+            // Everything is merged again, so the maximum size fits at the start of the range
+            q = a->allocate(s_config.m_size_max, 256);
+            CHECK_EQUAL(s_vmem.m_base, q);
+            a->deallocate(q);
+
+            CHECK_EQUAL(0, s_vmem.m_errors);
+            a->release();
+        }
+
+        UNITTEST_TEST(shared_pages)
+        {
+            alloc_t* a    = gCreateVmCoalesceAllocator(gTestAllocator, &s_vmem, s_config);
+            xbyte*   base = (xbyte*)s_vmem.m_base;
+
+            // 4.5 KB allocations share a page with their neighbour
+            void* p0 = a->allocate(4608, 256);
+            void* p1 = a->allocate(4608, 256);
+            CHECK_EQUAL(base + 4608, (xbyte*)p1);
+            CHECK_EQUAL(3, s_vmem.m_committed);
+
+            a->deallocate(p0);
+            CHECK_FALSE(s_vmem.is_committed(base));
+            CHECK_TRUE(s_vmem.is_committed(base + 4096));
+            CHECK_EQUAL(2, s_vmem.m_committed);
+
+            a->deallocate(p1);
+            CHECK_EQUAL(0, s_vmem.m_committed);
+            CHECK_EQUAL(0, s_vmem.m_errors);
+            a->release();
+        }
+
+        UNITTEST_TEST(max_allocs)
+        {
+            xcoalesce_config config;
+            config.m_max_allocs = 64;
+            alloc_t* a          = gCreateVmCoalesceAllocator(gTestAllocator, &s_vmem, config);
+
+            void* p[64];
+            for (s32 i = 0; i < 64; ++i)
+                p[i] = a->allocate(4096 + (i & 3) * 256, 256);
+            CHECK_NULL(a->allocate(4096, 256));
+
+            // Free every other allocation, the worst case for the number of nodes
+            for (s32 i = 0; i < 64; i += 2)
+                a->deallocate(p[i]);
+            for (s32 i = 0; i < 64; i += 2)
+                p[i] = a->allocate(4096, 256);
+            for (s32 i = 0; i < 64; ++i)
+                a->deallocate(p[i]);
+
+            CHECK_EQUAL(0, s_vmem.m_committed);
+            CHECK_EQUAL(0, s_vmem.m_errors);
+            a->release();
+        }
+    }
+}
+UNITTEST_SUITE_END
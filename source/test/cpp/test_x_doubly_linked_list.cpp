@@ -14,7 +14,6 @@ llnode_t* gCreateList(u32 count, lldata_t& lldata)
 	llnode_t* list = (llnode_t*)gTestAllocator->allocate(sizeof(llnode_t) * count);
 	lldata.m_data = list;
 	lldata.m_itemsize = sizeof(llnode_t);
-	lldata.m_pagesize = sizeof(llnode_t) * count;
 	return list;
 }
 
@@ -200,6 +199,30 @@ UNITTEST_SUITE_BEGIN(doubly_linked_list)
 			gDestroyList(list_data);
 		}
 
+		UNITTEST_TEST(more_than_64K_items)
+		{
+			const u32 count = 70000;
+			lldata_t lldata;
+			llnode_t* list_data = gCreateList(count, lldata);
+			llist_t list(0, count);
+
+			list.initialize(lldata, 0, count, count);
+			CHECK_EQUAL(count, list.size());
+			CHECK_TRUE(list.is_full());
+
+			// Indices above 65535 address their own node
+			llnode_t* node = list.remove_item(lldata, count - 1);
+			CHECK_TRUE(node == &list_data[count - 1]);
+			CHECK_EQUAL(count - 1, lldata.node2idx(node));
+			CHECK_EQUAL(count - 2, list_data[0].m_prev);
+
+			list.insert(lldata, count - 1);
+			CHECK_EQUAL(count - 1, list.m_head.m_index);
+			CHECK_EQUAL(count, list.size());
+
+			gDestroyList(list_data);
+		}
+
     }
 }
 UNITTEST_SUITE_END
@@ -1,11 +1,23 @@
 #include "xbase/x_allocator.h"
 #include "xbase/x_integer.h"
+#include "xbase/x_memory.h"
 
 #include "xvmem/x_virtual_main_allocator.h"
 #include "xvmem/x_virtual_memory.h"
 
 #include "xunittest/xunittest.h"
 
+#include <condition_variable>
+#include <mutex>
+#include <stdio.h>
+#include <thread>
+
+#if defined TARGET_LINUX
+#include <sched.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
+
 using namespace xcore;
 
 extern alloc_t* gTestAllocator;
@@ -51,6 +63,200 @@ public:
     }
 };
 
+// Moves every reported allocation, the first u32 of an object is its index in the object table
+class xvmem_test_compactor : public xvmem_compactor
+{
+public:
+    xvmem_test_compactor(alloc_t* allocator, void** objects)
+        : mAllocator(allocator)
+        , mObjects(objects)
+        , mNumChunks(0)
+        , mNumRelocated(0)
+    {
+    }
+
+    virtual bool chunk(u32 alloc_size, u32 used, u32 capacity)
+    {
+        mNumChunks++;
+        return true;
+    }
+
+    virtual void relocate(void* ptr, u32 size)
+    {
+        u32 const index = *(u32*)ptr;
+        void*     obj   = mAllocator->allocate(size, sizeof(void*));
+        *(u32*)obj      = index;
+        mAllocator->deallocate(ptr);
+        mObjects[index] = obj;
+        mNumRelocated++;
+    }
+
+    alloc_t* mAllocator;
+    void**   mObjects;
+    u32      mNumChunks;
+    u32      mNumRelocated;
+};
+
+// Counts the live allocations and verifies that they are visited in address order
+class xvmem_test_walker : public xvmem_walker
+{
+public:
+    xvmem_test_walker()
+        : mLast(nullptr)
+        , mNumAllocs(0)
+        , mNumOutOfOrder(0)
+        , mSize(0)
+        , mStopAt(0xffffffff)
+    {
+    }
+
+    virtual bool allocation(void* ptr, u32 size, u32 assoc)
+    {
+        mNumOutOfOrder += (ptr <= mLast) ? 1 : 0;
+        mLast = ptr;
+        mNumAllocs++;
+        mSize += size;
+        return mNumAllocs < mStopAt;
+    }
+
+    void* mLast;
+    u32   mNumAllocs;
+    u32   mNumOutOfOrder;
+    u64   mSize;
+    u32   mStopAt;
+};
+
+#if defined TARGET_LINUX
+// Dies at the first allocation, in the middle of a call into the allocator
+class xvmem_test_dying_walker : public xvmem_walker
+{
+public:
+    virtual bool allocation(void* ptr, u32 size, u32 assoc) { _exit(0); }
+};
+#endif
+
+class xvmem_test_pressure : public xvmem_pressure
+{
+public:
+    xvmem_test_pressure()
+        : mNumCalls(0)
+        , mLimit(0)
+    {
+    }
+
+    virtual void pressure(u64 committed, u64 limit)
+    {
+        mNumCalls++;
+        mLimit = limit;
+    }
+
+    u32 mNumCalls;
+    u64 mLimit;
+};
+
+// Frees a reserve from within the callback, like an application that drops a cache
+class xvmem_test_releasing_pressure : public xvmem_pressure
+{
+public:
+    xvmem_test_releasing_pressure()
+        : mAllocator(nullptr)
+        , mReserve(nullptr)
+        , mNumCalls(0)
+    {
+    }
+
+    virtual void pressure(u64 committed, u64 limit)
+    {
+        mNumCalls++;
+        if (mReserve != nullptr)
+            mAllocator->deallocate(mReserve);
+        mReserve = nullptr;
+    }
+
+    alloc_t* mAllocator;
+    void*    mReserve;
+    u32      mNumCalls;
+};
+
+// Forwards to the system virtual memory and counts the commit and prefault calls and the committed pages
+class xvmem_test_counter : public xvmem
+{
+public:
+    xvmem_test_counter(xvmem* vmem)
+        : mVMem(vmem)
+        , mNumCommits(0)
+        , mNumPrefaults(0)
+        , mNumPages(0)
+    {
+    }
+
+    virtual bool initialize(u32 pagesize) { return mVMem->initialize(pagesize); }
+    virtual bool reserve(u64 address_range, u32& page_size, u32 attributes, void*& baseptr) { return mVMem->reserve(address_range, page_size, attributes, baseptr); }
+    virtual bool release(void* baseptr, u64 address_range) { return mVMem->release(baseptr, address_range); }
+    virtual bool commit(void* address, u32 page_size, u32 page_count)
+    {
+        mNumCommits++;
+        mNumPages += page_count;
+        return mVMem->commit(address, page_size, page_count);
+    }
+    virtual bool decommit(void* address, u32 page_size, u32 page_count)
+    {
+        mNumPages -= page_count;
+        return mVMem->decommit(address, page_size, page_count);
+    }
+    virtual bool prefault(void* address, u32 page_size, u32 page_count)
+    {
+        mNumPrefaults++;
+        return mVMem->prefault(address, page_size, page_count);
+    }
+
+    xvmem* mVMem;
+    u32    mNumCommits;
+    u32    mNumPrefaults;
+    s32    mNumPages;
+};
+
+// Lets threads take turns, 'wait' returns when 'pass' was called with the same turn or a later one
+struct xvmem_test_turns_t
+{
+    xvmem_test_turns_t()
+        : mTurn(0)
+    {
+    }
+
+    void pass(u32 turn)
+    {
+        std::lock_guard<std::mutex> guard(mMutex);
+        mTurn = turn;
+        mCondition.notify_all();
+    }
+
+    void wait(u32 turn)
+    {
+        std::unique_lock<std::mutex> lock(mMutex);
+        mCondition.wait(lock, [this, turn]() { return mTurn >= turn; });
+    }
+
+    std::mutex              mMutex;
+    std::condition_variable mCondition;
+    u32                     mTurn;
+};
+
+// The number of pairs of objects, one of 'a' and one of 'b', that are in the same cache line
+static u32 xvmem_test_shared_lines(void* const* a, void* const* b, u32 count)
+{
+    u32 shared = 0;
+    for (u32 i = 0; i < count; ++i)
+    {
+        for (u32 j = 0; j < count; ++j)
+        {
+            if (((uptr)a[i] / 64) == ((uptr)b[j] / 64))
+                shared += 1;
+        }
+    }
+    return shared;
+}
+
 UNITTEST_SUITE_BEGIN(main_allocator)
 {
     UNITTEST_FIXTURE(main)
@@ -69,6 +275,1199 @@ UNITTEST_SUITE_BEGIN(main_allocator)
         UNITTEST_TEST(init)
         {
         }
+
+        UNITTEST_TEST(compact)
+        {
+            alloc_t* a = gCreateVmAllocator(&s_alloc, gGetVirtualMemory(), nullptr);
+
+            const u32 count   = 8192;
+            void**    objects = (void**)gTestAllocator->allocate(sizeof(void*) * count, sizeof(void*));
+            for (u32 i = 0; i < count; ++i)
+            {
+                objects[i]         = a->allocate(64, sizeof(void*));
+                *(u32*)objects[i] = i;
+            }
+
+            // Keep every 8th object, this leaves all chunks with a low occupancy
+            u32 live = 0;
+            for (u32 i = 0; i < count; ++i)
+            {
+                if ((i & 7) != 0)
+                {
+                    a->deallocate(objects[i]);
+                    objects[i] = nullptr;
+                }
+                else
+                {
+                    objects[live]     = objects[i];
+                    *(u32*)objects[i] = live++;
+                }
+            }
+
+            xvmem_test_compactor compactor(a, objects);
+            u32 const            released = gVmAllocatorCompact(a, 50, &compactor);
+            CHECK_TRUE(compactor.mNumChunks > 0);
+            CHECK_TRUE(released > 0);
+            CHECK_TRUE(compactor.mNumRelocated > 0);
+
+            // Every object should still be there
+            for (u32 i = 0; i < live; ++i)
+                CHECK_EQUAL(i, *(u32*)objects[i]);
+
+            for (u32 i = 0; i < live; ++i)
+                a->deallocate(objects[i]);
+            gTestAllocator->deallocate(objects);
+            a->release();
+        }
+
+        UNITTEST_TEST(compact_per_cpu_caches)
+        {
+            xvmem_config cfg;
+            cfg.m_per_cpu_caches = true;
+            alloc_t* a           = gCreateVmAllocator(&s_alloc, gGetVirtualMemory(), &cfg);
+
+            // The freed objects end up in the per-CPU caches first
+            const u32 count   = 8192;
+            void**    objects = (void**)gTestAllocator->allocate(sizeof(void*) * count, sizeof(void*));
+            u32       live    = 0;
+            for (u32 i = 0; i < count; ++i)
+                objects[i] = a->allocate(64, sizeof(void*));
+            for (u32 i = 0; i < count; ++i)
+            {
+                if ((i & 7) != 0)
+                {
+                    a->deallocate(objects[i]);
+                    continue;
+                }
+                objects[live]        = objects[i];
+                *(u32*)objects[live] = live;
+                live += 1;
+            }
+
+            // The walk only reports the live objects, not the slots in the caches
+            xvmem_test_walker walker;
+            gVmAllocatorWalk(a, &walker);
+            CHECK_EQUAL(live, walker.mNumAllocs);
+
+            // The relocated objects are freed into their chunks, so the chunks are drained and released
+            xvmem_test_compactor compactor(a, objects);
+            CHECK_TRUE(gVmAllocatorCompact(a, 50, &compactor) > 0);
+            CHECK_TRUE(compactor.mNumRelocated > 0);
+            for (u32 i = 0; i < live; ++i)
+                CHECK_EQUAL(i, *(u32*)objects[i]);
+
+            xvmem_test_walker after;
+            gVmAllocatorWalk(a, &after);
+            CHECK_EQUAL(live, after.mNumAllocs);
+
+            for (u32 i = 0; i < live; ++i)
+                a->deallocate(objects[i]);
+            gTestAllocator->deallocate(objects);
+            a->release();
+        }
+
+        UNITTEST_TEST(occupancy_buckets)
+        {
+            alloc_t* a = gCreateVmAllocator(&s_alloc, gGetVirtualMemory(), nullptr);
+
+            // Three full chunks of 16 pages
+            const u32 size      = 9216;
+            const u32 per_chunk = 113;
+            void*     objects[3 * per_chunk];
+            for (u32 i = 0; i < (3 * per_chunk); ++i)
+                objects[i] = a->allocate(size, sizeof(void*));
+
+            // The second chunk stays fuller, the first one becomes nearly empty and is the most recent partially used one
+            for (u32 i = per_chunk; i < (per_chunk + 30); ++i)
+                a->deallocate(objects[i]);
+            for (u32 i = 0; i < 100; ++i)
+                a->deallocate(objects[i]);
+
+            // New allocations go to the fuller chunk
+            xbyte* const fuller_begin = (xbyte*)objects[per_chunk + 30] - (30 * size);
+            xbyte* const fuller_end   = fuller_begin + (per_chunk * size);
+            for (u32 i = per_chunk; i < (per_chunk + 30); ++i)
+            {
+                objects[i] = a->allocate(size, sizeof(void*));
+                CHECK_TRUE((xbyte*)objects[i] >= fuller_begin && (xbyte*)objects[i] < fuller_end);
+            }
+
+            // The nearly empty chunk drains and is released
+            u64 const committed = gVmAllocatorCommitted(a);
+            for (u32 i = 100; i < per_chunk; ++i)
+                a->deallocate(objects[i]);
+            gVmAllocatorFlush(a);
+            CHECK_TRUE(gVmAllocatorCommitted(a) <= (committed - (u64)per_chunk * size));
+
+            for (u32 i = per_chunk; i < (3 * per_chunk); ++i)
+                a->deallocate(objects[i]);
+            a->release();
+        }
+
+        UNITTEST_TEST(allocate_zeroed)
+        {
+            alloc_t* a = gCreateVmAllocator(&s_alloc, gGetVirtualMemory(), nullptr);
+
+            // Dirty a couple of slots and hand them back, they are recycled before any fresh slot
+            const u32 count = 64;
+            u8*       objects[count];
+            for (u32 i = 0; i < count; ++i)
+            {
+                objects[i] = (u8*)a->allocate(200, sizeof(void*));
+                x_memset(objects[i], 0xAB, 200);
+            }
+            for (u32 i = 0; i < count; i += 2)
+                a->deallocate(objects[i]);
+
+            for (u32 i = 0; i < count; ++i)
+            {
+                u8* p = (u8*)gVmAllocatorAllocateZeroed(a, 200, sizeof(void*));
+                u32 n = 0;
+                for (u32 j = 0; j < 200; ++j)
+                    n += (p[j] == 0) ? 1 : 0;
+                CHECK_EQUAL(200, n);
+                x_memset(p, 0xCD, 200);
+                if (i < (count / 2))
+                    objects[i * 2] = p;
+                else
+                    a->deallocate(p);
+            }
+
+            // A single allocation chunk that reuses the pages of a cached chunk
+            u32 const size = 300 * 1024;
+            u8*       q    = (u8*)a->allocate(size, sizeof(void*));
+            x_memset(q, 0xAB, size);
+            a->deallocate(q);
+            q = (u8*)gVmAllocatorAllocateZeroed(a, size, sizeof(void*));
+            CHECK_EQUAL(0, q[0]);
+            CHECK_EQUAL(0, q[size / 2]);
+            CHECK_EQUAL(0, q[size - 1]);
+            a->deallocate(q);
+
+            for (u32 i = 0; i < count; ++i)
+                a->deallocate(objects[i]);
+            a->release();
+        }
+
+        UNITTEST_TEST(prewarm)
+        {
+            xvmem_test_counter vmem(gGetVirtualMemory());
+            alloc_t*           a = gCreateVmAllocator(&s_alloc, &vmem, nullptr);
+
+            const u32 count = 4096;
+            void**    objects = (void**)gTestAllocator->allocate(sizeof(void*) * count, sizeof(void*));
+            CHECK_TRUE(gVmAllocatorPrewarm(a, 64, count, true) > 0);
+            CHECK_TRUE(gVmAllocatorPrewarm(a, 300 * 1024, 2, true) > 0);
+            CHECK_TRUE(vmem.mNumPrefaults > 0);
+
+            // No commits in the critical section, also not after the chunks drained
+            u32 const commits = vmem.mNumCommits;
+            for (u32 round = 0; round < 2; ++round)
+            {
+                for (u32 i = 0; i < count; ++i)
+                    objects[i] = a->allocate(64, sizeof(void*));
+                void* p = a->allocate(300 * 1024, sizeof(void*));
+                void* q = a->allocate(300 * 1024, sizeof(void*));
+                CHECK_EQUAL(commits, vmem.mNumCommits);
+                for (u32 i = 0; i < count; ++i)
+                    a->deallocate(objects[i]);
+                a->deallocate(p);
+                a->deallocate(q);
+            }
+
+            CHECK_TRUE(gVmAllocatorUnpin(a, 64) > 0);
+            CHECK_EQUAL(2, gVmAllocatorUnpin(a, 300 * 1024));
+
+            gTestAllocator->deallocate(objects);
+            a->release();
+        }
+
+        UNITTEST_TEST(lazy_init)
+        {
+            xvmem_test_counter vmem(gGetVirtualMemory());
+            xvmem_config       cfg;
+            cfg.m_internal_heap_pre_size = 0;
+            cfg.m_internal_fsa_pre_size  = 0;
+            alloc_t* a                   = gCreateVmAllocator(&s_alloc, &vmem, &cfg);
+
+            // Only the page of the internal heap that holds the bin tables
+            CHECK_EQUAL(1, vmem.mNumPages);
+
+            void* p = a->allocate(64, sizeof(void*));
+            void* q = a->allocate(300 * 1024, sizeof(void*));
+            CHECK_TRUE(vmem.mNumPages > 1);
+            a->deallocate(p);
+            a->deallocate(q);
+            a->release();
+        }
+
+        UNITTEST_TEST(free_stack)
+        {
+            alloc_t* a = gCreateVmAllocator(&s_alloc, gGetVirtualMemory(), nullptr);
+
+            const u32 count = 256;
+            void*     objects[count];
+            for (u32 i = 0; i < count; ++i)
+                objects[i] = a->allocate(32, sizeof(void*));
+
+            // The most recently freed slots are handed out first
+            a->deallocate(objects[10]);
+            a->deallocate(objects[200]);
+            CHECK_EQUAL(objects[200], a->allocate(32, sizeof(void*)));
+            CHECK_EQUAL(objects[10], a->allocate(32, sizeof(void*)));
+
+            // Slots on the free stack are not reported as live
+            for (u32 i = 0; i < count; i += 2)
+                a->deallocate(objects[i]);
+            xvmem_test_walker walker;
+            gVmAllocatorWalk(a, &walker);
+            CHECK_EQUAL(count / 2, walker.mNumAllocs);
+            xvmem_test_walker paused;
+            CHECK_TRUE(gVmAllocatorWalkPaused(a, &paused));
+            CHECK_EQUAL(count / 2, paused.mNumAllocs);
+
+            for (u32 i = 0; i < count; i += 2)
+                objects[i] = a->allocate(32, sizeof(void*));
+            for (u32 i = 0; i < count; ++i)
+                a->deallocate(objects[i]);
+            a->release();
+        }
+
+        UNITTEST_TEST(thread_private_chunks)
+        {
+            xvmem_config cfg;
+            cfg.m_thread_private_chunks = true;
+            alloc_t* a                  = gCreateVmAllocator(&s_alloc, gGetVirtualMemory(), &cfg);
+
+            // Two live threads take turns, the allocator itself is not thread-safe. 63 objects of 24 bytes do not end
+            // on a cache line, shared chunks would put the first object of the second thread in the last line of the
+            // first thread.
+            const u32 count = 63;
+            void*     objects[2][count];
+            xvmem_test_turns_t turns;
+            std::thread first([&]() {
+                for (u32 i = 0; i < count; ++i)
+                    objects[0][i] = a->allocate(24, sizeof(void*));
+                turns.pass(1);
+                turns.wait(2);
+                gVmAllocatorReleaseThread(a);
+            });
+            turns.wait(1);
+            std::thread second([&]() {
+                for (u32 i = 0; i < count; ++i)
+                    objects[1][i] = a->allocate(24, sizeof(void*));
+                gVmAllocatorReleaseThread(a);
+            });
+            second.join();
+            turns.pass(2);
+            first.join();
+
+            CHECK_EQUAL(0, xvmem_test_shared_lines(objects[0], objects[1], count));
+
+            for (u32 t = 0; t < 2; ++t)
+            {
+                for (u32 i = 0; i < count; ++i)
+                    a->deallocate(objects[t][i]);
+            }
+            a->release();
+        }
+
+        UNITTEST_TEST(thread_private_owner_recycling)
+        {
+            xvmem_config cfg;
+            cfg.m_thread_private_chunks = true;
+            alloc_t* a                  = gCreateVmAllocator(&s_alloc, gGetVirtualMemory(), &cfg);
+
+            // The first thread stays alive while 126 threads come and go without releasing their chunks, the owner
+            // of the thread after them is not the one of the first thread
+            const u32 count = 63;
+            void*     objects[2][count];
+            xvmem_test_turns_t turns;
+            std::thread first([&]() {
+                for (u32 i = 0; i < count; ++i)
+                    objects[0][i] = a->allocate(24, sizeof(void*));
+                turns.pass(1);
+                turns.wait(2);
+            });
+            turns.wait(1);
+            for (u32 t = 0; t < 126; ++t)
+            {
+                std::thread passing([&]() { a->deallocate(a->allocate(24, sizeof(void*))); });
+                passing.join();
+            }
+            std::thread second([&]() {
+                for (u32 i = 0; i < count; ++i)
+                    objects[1][i] = a->allocate(24, sizeof(void*));
+            });
+            second.join();
+            turns.pass(2);
+            first.join();
+
+            CHECK_EQUAL(0, xvmem_test_shared_lines(objects[0], objects[1], count));
+
+            for (u32 t = 0; t < 2; ++t)
+            {
+                for (u32 i = 0; i < count; ++i)
+                    a->deallocate(objects[t][i]);
+            }
+            a->release();
+        }
+
+        UNITTEST_TEST(cache_coloring)
+        {
+            xvmem_config cfg;
+            cfg.m_cache_coloring = true;
+            alloc_t* a           = gCreateVmAllocator(&s_alloc, gGetVirtualMemory(), &cfg);
+
+            const u32 count = 8;
+            const u32 size  = 256 * 1024;
+            void*     buffers[count];
+            u32       offsets = 0;
+            for (u32 i = 0; i < count; ++i)
+            {
+                buffers[i] = a->allocate(size, 64);
+                CHECK_TRUE(gVmAllocatorGetSize(a, buffers[i]) >= size);
+                x_memset(buffers[i], 0, size);
+                offsets |= (u32)((uptr)buffers[i] & 4095);
+            }
+            CHECK_TRUE(offsets != 0);
+
+            // A page aligned allocation is not moved
+            void* aligned = a->allocate(size, 4096);
+            CHECK_EQUAL(0, (uptr)aligned & 4095);
+
+            xvmem_test_walker walker;
+            gVmAllocatorWalk(a, &walker);
+            CHECK_EQUAL(count + 1, walker.mNumAllocs);
+
+            a->deallocate(aligned);
+            for (u32 i = 0; i < count; ++i)
+                CHECK_EQUAL(gVmAllocatorGetSize(a, buffers[i]), a->deallocate(buffers[i]));
+            a->release();
+        }
+
+        UNITTEST_TEST(commit_limits)
+        {
+            xvmem_test_pressure pressure;
+            xvmem_config        cfg;
+            cfg.m_internal_heap_pre_size = 0;
+            cfg.m_internal_fsa_pre_size  = 0;
+            cfg.m_commit_soft_limit      = xvmem_config::MBx(4);
+            cfg.m_commit_hard_limit      = xvmem_config::MBx(8);
+            cfg.m_pressure               = &pressure;
+            alloc_t* a                   = gCreateVmAllocator(&s_alloc, gGetVirtualMemory(), &cfg);
+
+            // The soft limit is signaled once, at the hard limit the allocation fails
+            const u32 max_count = 64;
+            void*     buffers[max_count];
+            u32       count = 0;
+            while (count < max_count)
+            {
+                void* ptr = a->allocate(256 * 1024, sizeof(void*));
+                if (ptr == nullptr)
+                    break;
+                buffers[count++] = ptr;
+                if (count == 1)
+                    CHECK_EQUAL(0, pressure.mNumCalls);
+            }
+            CHECK_TRUE(count > 16 && count < max_count);
+            CHECK_TRUE(gVmAllocatorCommitted(a) <= cfg.m_commit_hard_limit);
+            CHECK_EQUAL(2, pressure.mNumCalls);
+            CHECK_EQUAL(cfg.m_commit_hard_limit, pressure.mLimit);
+
+            // The cached chunk of a deallocation is flushed to make room
+            a->deallocate(buffers[--count]);
+            buffers[count] = a->allocate(256 * 1024, sizeof(void*));
+            CHECK_TRUE(buffers[count] != nullptr);
+            count += 1;
+
+            for (u32 i = 1; i < count; ++i)
+                a->deallocate(buffers[i]);
+            CHECK_TRUE(gVmAllocatorFlush(a) > 0);
+            CHECK_EQUAL(0, gVmAllocatorFlush(a));
+            a->deallocate(buffers[0]);
+            a->release();
+        }
+
+        UNITTEST_TEST(pressure_deallocates)
+        {
+            // The per-CPU caches make the allocator thread-safe, the callback is invoked while the lock is held
+            xvmem_test_releasing_pressure pressure;
+            xvmem_config                  cfg;
+            cfg.m_per_cpu_caches    = true;
+            cfg.m_commit_hard_limit = xvmem_config::MBx(8);
+            cfg.m_pressure          = &pressure;
+            alloc_t* a              = gCreateVmAllocator(&s_alloc, gGetVirtualMemory(), &cfg);
+            pressure.mAllocator     = a;
+            pressure.mReserve       = a->allocate(1024 * 1024, sizeof(void*));
+
+            const u32 max_count = 64;
+            void*     buffers[max_count];
+            u32       count = 0;
+            while (count < max_count)
+            {
+                void* ptr = a->allocate(256 * 1024, sizeof(void*));
+                if (ptr == nullptr)
+                    break;
+                buffers[count++] = ptr;
+            }
+            CHECK_TRUE(count > 16 && count < max_count);
+            CHECK_TRUE(pressure.mNumCalls > 0);
+            CHECK_TRUE(pressure.mReserve == nullptr);
+
+            for (u32 i = 0; i < count; ++i)
+                a->deallocate(buffers[i]);
+            a->release();
+        }
+
+        UNITTEST_TEST(commit_hard_limit_bookkeeping)
+        {
+            // Every size class checks out a chunk, the bookkeeping of the chunks and blocks is committed by the internal
+            // fsa and the block array, that has to stay within the hard limit as well. The limit is stepped so that it
+            // is hit by a chunk as well as by its bookkeeping.
+            const u32 max_count = 4096;
+            void**    objects   = (void**)gTestAllocator->allocate(sizeof(void*) * max_count, sizeof(void*));
+            for (u32 step = 0; step < 16; ++step)
+            {
+                xvmem_config cfg;
+                cfg.m_internal_heap_pre_size = 0;
+                cfg.m_internal_fsa_pre_size  = 0;
+                cfg.m_commit_hard_limit      = xvmem_config::MBx(1) + step * 64 * 1024;
+                alloc_t* a                   = gCreateVmAllocator(&s_alloc, gGetVirtualMemory(), &cfg);
+
+                u32 count     = 0;
+                u64 committed = 0;
+                while (count < max_count)
+                {
+                    void* ptr = a->allocate(16 + (count % 256) * 16, sizeof(void*));
+                    if (ptr == nullptr)
+                        break;
+                    objects[count++] = ptr;
+                    if (gVmAllocatorCommitted(a) > committed)
+                        committed = gVmAllocatorCommitted(a);
+                }
+                CHECK_TRUE(count < max_count);
+                CHECK_TRUE(committed <= cfg.m_commit_hard_limit);
+
+                for (u32 i = 0; i < count; ++i)
+                    a->deallocate(objects[i]);
+                a->release();
+            }
+            gTestAllocator->deallocate(objects);
+        }
+
+        UNITTEST_TEST(commit_failure)
+        {
+            // The xvmem fails to commit like a full tmpfs behind a shared allocator, allocate returns nullptr and
+            // what was taken for the allocation is returned, the committed bytes stay in line with the xvmem
+            xvmem_instrumented* vmem = gCreateInstrumentedVirtualMemory(gTestAllocator, gGetVirtualMemory(), false);
+            xvmem_config        cfg;
+            cfg.m_internal_heap_pre_size = 0;
+            cfg.m_internal_fsa_pre_size  = 0;
+            alloc_t* a                   = gCreateVmAllocator(&s_alloc, vmem, &cfg);
+
+            const u32 max_count = 4096;
+            void**    objects   = (void**)gTestAllocator->allocate(sizeof(void*) * max_count, sizeof(void*));
+            for (u32 step = 0; step < 16; ++step)
+            {
+                xvmem_stats stats;
+                vmem->stats(stats);
+                vmem->fail_commits_above(stats.m_committed + xvmem_config::MBx(1) + step * 64 * 1024);
+
+                u32 count = 0;
+                while (count < max_count)
+                {
+                    u32 const   size = ((count % 8) == 7) ? (96 * 1024) : (16 + (count % 256) * 16);
+                    void* const ptr  = a->allocate(size, sizeof(void*));
+                    if (ptr == nullptr)
+                        break;
+                    x_memset(ptr, 0xA5A5A5A5, size);
+                    objects[count++] = ptr;
+                }
+                CHECK_TRUE(count > 0 && count < max_count);
+                vmem->stats(stats);
+                CHECK_EQUAL(gVmAllocatorCommitted(a), stats.m_committed);
+
+                // Growing in place fails as well
+                if (count > 7)
+                {
+                    void* const grown = gVmAllocatorReallocate(a, objects[7], 4 * 1024 * 1024, sizeof(void*));
+                    CHECK_TRUE(grown == nullptr);
+                }
+
+                vmem->fail_commits_above(0);
+                for (u32 i = 0; i < count; ++i)
+                    a->deallocate(objects[i]);
+                gVmAllocatorScavenge(a);
+                vmem->stats(stats);
+                CHECK_EQUAL(gVmAllocatorCommitted(a), stats.m_committed);
+            }
+
+            // Once commits succeed again the allocator works as before
+            void* const ptr = a->allocate(256 * 1024, sizeof(void*));
+            CHECK_TRUE(ptr != nullptr);
+            x_memset(ptr, 0, 256 * 1024);
+            a->deallocate(ptr);
+
+            gTestAllocator->deallocate(objects);
+            a->release();
+            gReleaseInstrumentedVirtualMemory(gTestAllocator, vmem);
+        }
+
+        UNITTEST_TEST(instrumented_vmem)
+        {
+            // A simulated 1 TB address range, the chunks are never committed in the system
+            xvmem_instrumented* vmem = gCreateInstrumentedVirtualMemory(gTestAllocator, gGetVirtualMemory(), true);
+            xvmem_config        cfg;
+            cfg.m_address_range = xvmem_config::GBx(1024);
+            alloc_t* a          = gCreateVmAllocator(&s_alloc, vmem, &cfg);
+
+            const u32 count = 64;
+            const u32 size  = 200 * 1024 * 1024;
+            void*     buffers[count];
+            for (u32 i = 0; i < count; ++i)
+                buffers[i] = a->allocate(size, sizeof(void*));
+
+            xvmem_stats stats;
+            vmem->stats(stats);
+            CHECK_EQUAL(gVmAllocatorCommitted(a), stats.m_committed);
+            CHECK_TRUE(stats.m_committed > (u64)count * size);
+            CHECK_EQUAL((u64)size, vmem->committed(buffers[0], size));
+            CHECK_TRUE(stats.m_ops[xvmem_stats::COMMIT].m_count >= count);
+            CHECK_EQUAL(5, stats.m_ops[xvmem_stats::RESERVE].m_count); // Heap, fsa and its pages, chunks and blocks
+
+            vmem->reset_stats();
+            for (u32 i = 0; i < count; ++i)
+                a->deallocate(buffers[i]);
+            gVmAllocatorFlush(a);
+            vmem->stats(stats);
+            CHECK_EQUAL(gVmAllocatorCommitted(a), stats.m_committed);
+            CHECK_EQUAL(0, vmem->committed(buffers[0], size));
+            CHECK_EQUAL(0, stats.m_ops[xvmem_stats::COMMIT].m_count);
+            CHECK_TRUE(stats.m_ops[xvmem_stats::DECOMMIT].m_bytes >= (u64)count * size);
+
+            a->release();
+            vmem->stats(stats);
+            CHECK_EQUAL(0, stats.m_committed);
+            gReleaseInstrumentedVirtualMemory(gTestAllocator, vmem);
+        }
+
+        UNITTEST_TEST(many_partial_chunks)
+        {
+            // More partially used chunks in one bin than one fsa item can track, on a simulated address range
+            xvmem_instrumented* vmem = gCreateInstrumentedVirtualMemory(gTestAllocator, gGetVirtualMemory(), true);
+            alloc_t*            a    = gCreateVmAllocator(&s_alloc, vmem, nullptr);
+
+            const u32 size      = 24576; // 8 slots per chunk
+            const u32 per_chunk = 8;
+            const u32 chunks    = 20000;
+            const u32 count     = chunks * per_chunk;
+            void**    objects   = (void**)gTestAllocator->allocate(sizeof(void*) * count, sizeof(void*));
+            for (u32 i = 0; i < count; ++i)
+                objects[i] = a->allocate(size, sizeof(void*));
+            for (u32 i = 0; i < count; i += per_chunk)
+                a->deallocate(objects[i]);
+
+            // Every freed slot is found again, no chunk is added
+            u64 const committed = gVmAllocatorCommitted(a);
+            for (u32 i = 0; i < count; i += per_chunk)
+                objects[i] = a->allocate(size, sizeof(void*));
+            CHECK_EQUAL(committed, gVmAllocatorCommitted(a));
+
+            for (u32 i = 0; i < count; ++i)
+                a->deallocate(objects[i]);
+            gTestAllocator->deallocate(objects);
+            a->release();
+            gReleaseInstrumentedVirtualMemory(gTestAllocator, vmem);
+        }
+
+        UNITTEST_TEST(batched_decommit)
+        {
+            xvmem_instrumented* vmem = gCreateInstrumentedVirtualMemory(gTestAllocator, gGetVirtualMemory(), true);
+            xvmem_config        cfg;
+            cfg.m_address_range = xvmem_config::GBx(64);
+            alloc_t* a          = gCreateVmAllocator(&s_alloc, vmem, &cfg);
+
+            // Hundreds of chunks in one block, they are cached when released and the block goes when the last one does
+            const u32 count = 400;
+            const u32 size  = 1000 * 1024;
+            void*     buffers[count];
+            for (u32 i = 0; i < count; ++i)
+                buffers[i] = a->allocate(size, sizeof(void*));
+
+            xvmem_stats stats;
+            vmem->reset_stats();
+            for (u32 i = 0; i < count; ++i)
+                a->deallocate(buffers[i]);
+            vmem->stats(stats);
+            CHECK_EQUAL(gVmAllocatorCommitted(a), stats.m_committed);
+            CHECK_EQUAL(0, vmem->committed(buffers[0], size));
+            CHECK_TRUE(stats.m_ops[xvmem_stats::DECOMMIT].m_bytes >= (u64)count * size);
+            CHECK_TRUE(stats.m_ops[xvmem_stats::DECOMMIT].m_count <= 2);
+
+            // The scattered cached chunks of blocks that stay are merged where they are adjacent
+            for (u32 i = 0; i < count; ++i)
+                buffers[i] = a->allocate(size, sizeof(void*));
+            for (u32 i = 1; i < count; ++i)
+                a->deallocate(buffers[i]);
+            vmem->reset_stats();
+            gVmAllocatorFlush(a);
+            vmem->stats(stats);
+            CHECK_EQUAL(gVmAllocatorCommitted(a), stats.m_committed);
+            CHECK_TRUE(stats.m_ops[xvmem_stats::DECOMMIT].m_count <= 4);
+            a->deallocate(buffers[0]);
+
+            a->release();
+            gReleaseInstrumentedVirtualMemory(gTestAllocator, vmem);
+        }
+
+#if defined TARGET_LINUX
+        UNITTEST_TEST(shared_memory)
+        {
+            xvmem_shared* vmem = gCreateSharedVirtualMemory(gTestAllocator, xvmem_config::GBx(2));
+            CHECK_TRUE(vmem != nullptr);
+
+            // The second handle attaches to the allocator that the first one created
+            xvmem_config cfg;
+            cfg.m_address_range = xvmem_config::GBx(1);
+            alloc_t* a          = gCreateSharedVmAllocator(&s_alloc, vmem, &cfg);
+            alloc_t* b          = gCreateSharedVmAllocator(&s_alloc, vmem, &cfg);
+            CHECK_TRUE(a != nullptr && b != nullptr);
+
+            // A child process allocates from the shared heap and hands the allocation over through it
+            void** mailbox = (void**)a->allocate(sizeof(void*), sizeof(void*));
+            *mailbox       = nullptr;
+            pid_t const pid = fork();
+            if (pid == 0)
+            {
+                char* text = (char*)b->allocate(64, sizeof(void*));
+                x_memcpy(text, "shared", 7);
+                *mailbox = text;
+                _exit(0);
+            }
+            waitpid(pid, nullptr, 0);
+
+            char const* text = (char const*)*mailbox;
+            CHECK_TRUE(text != nullptr && gVmAllocatorOwns(a, (void*)text));
+            CHECK_TRUE(text[0] == 's' && text[5] == 'd' && text[6] == 0);
+            a->deallocate((void*)text);
+            a->deallocate(mailbox);
+
+            // The address range is taken in this process, it can only be opened by another one
+            CHECK_TRUE(gOpenSharedVirtualMemory(gTestAllocator, vmem->fd()) == nullptr);
+
+            b->release();
+            a->release();
+            gReleaseSharedVirtualMemory(gTestAllocator, vmem);
+        }
+
+        UNITTEST_TEST(shared_creator_died)
+        {
+            xvmem_shared* vmem = gCreateSharedVirtualMemory(gTestAllocator, xvmem_config::GBx(2));
+            CHECK_TRUE(vmem != nullptr);
+
+            // A child claims the root block as its creator (the state and the pid come first) and dies before it is done
+            pid_t const pid = fork();
+            if (pid == 0)
+            {
+                u32* root = (u32*)vmem->root(sizeof(u32) * 2);
+                root[1]   = (u32)getpid();
+                root[0]   = 1;
+                _exit(0);
+            }
+            waitpid(pid, nullptr, 0);
+
+            // Attaching gives up instead of waiting for it forever
+            CHECK_TRUE(gCreateSharedVmAllocator(&s_alloc, vmem, nullptr) == nullptr);
+            gReleaseSharedVirtualMemory(gTestAllocator, vmem);
+        }
+
+        UNITTEST_TEST(shared_compact)
+        {
+            xvmem_shared* vmem = gCreateSharedVirtualMemory(gTestAllocator, xvmem_config::GBx(2));
+            CHECK_TRUE(vmem != nullptr);
+
+            xvmem_config cfg;
+            cfg.m_address_range = xvmem_config::GBx(1);
+            alloc_t* a          = gCreateSharedVmAllocator(&s_alloc, vmem, &cfg);
+
+            // The compactor relocates through the allocator while the lock of the compaction is held
+            const u32 count   = 4096;
+            void**    objects = (void**)gTestAllocator->allocate(sizeof(void*) * count, sizeof(void*));
+            u32       live    = 0;
+            for (u32 i = 0; i < count; ++i)
+                objects[i] = a->allocate(64, sizeof(void*));
+            for (u32 i = 0; i < count; ++i)
+            {
+                if ((i & 7) != 0)
+                {
+                    a->deallocate(objects[i]);
+                    continue;
+                }
+                objects[live]       = objects[i];
+                *(u32*)objects[live] = live;
+                live += 1;
+            }
+
+            xvmem_test_compactor compactor(a, objects);
+            CHECK_TRUE(gVmAllocatorCompact(a, 50, &compactor) > 0);
+            CHECK_TRUE(compactor.mNumRelocated > 0);
+            for (u32 i = 0; i < live; ++i)
+                CHECK_EQUAL(i, *(u32*)objects[i]);
+
+            // The lock is released by the compaction
+            void* ptr = a->allocate(64, sizeof(void*));
+            CHECK_TRUE(ptr != nullptr);
+            a->deallocate(ptr);
+
+            for (u32 i = 0; i < live; ++i)
+                a->deallocate(objects[i]);
+            gTestAllocator->deallocate(objects);
+            a->release();
+            gReleaseSharedVirtualMemory(gTestAllocator, vmem);
+        }
+
+        UNITTEST_TEST(shared_owner_died)
+        {
+            xvmem_shared* vmem = gCreateSharedVirtualMemory(gTestAllocator, xvmem_config::GBx(2));
+            CHECK_TRUE(vmem != nullptr);
+
+            xvmem_config cfg;
+            cfg.m_address_range = xvmem_config::GBx(1);
+            alloc_t* a          = gCreateSharedVmAllocator(&s_alloc, vmem, &cfg);
+            alloc_t* b          = gCreateSharedVmAllocator(&s_alloc, vmem, &cfg);
+            void*    ptr        = a->allocate(64, sizeof(void*));
+            CHECK_TRUE(ptr != nullptr);
+
+            // A child dies while it holds the lock in the middle of a walk
+            pid_t const pid = fork();
+            if (pid == 0)
+            {
+                xvmem_test_dying_walker walker;
+                gVmAllocatorWalk(b, &walker);
+                _exit(1);
+            }
+            int status = -1;
+            waitpid(pid, &status, 0);
+            CHECK_TRUE(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+
+            // The allocator is poisoned, every call fails from now on
+            CHECK_TRUE(a->allocate(64, sizeof(void*)) == nullptr);
+            CHECK_EQUAL(0, a->deallocate(ptr));
+            CHECK_EQUAL(0, gVmAllocatorGetSize(a, ptr));
+            CHECK_EQUAL(0, gVmAllocatorCommitted(a));
+            CHECK_TRUE(b->allocate(64, sizeof(void*)) == nullptr);
+
+            b->release();
+            a->release();
+            gReleaseSharedVirtualMemory(gTestAllocator, vmem);
+        }
+
+        UNITTEST_TEST(persistent_heap)
+        {
+            char path[64];
+            snprintf(path, sizeof(path), "/tmp/xvmem_test_%d.heap", (int)getpid());
+            unlink(path);
+
+            xvmem_config cfg;
+            cfg.m_address_range = xvmem_config::GBx(4);
+
+            xvmem_shared* vmem = gOpenPersistentVirtualMemory(gTestAllocator, path, xvmem_config::GBx(8), nullptr);
+            CHECK_TRUE(vmem != nullptr && !vmem->reopened());
+            CHECK_TRUE(gOpenPersistentVirtualMemory(gTestAllocator, path, xvmem_config::GBx(8), nullptr) == nullptr); // Locked
+            alloc_t* a     = gCreateSharedVmAllocator(&s_alloc, vmem, &cfg);
+            u32*     table = (u32*)a->allocate(sizeof(u32) * 1024, sizeof(void*));
+            for (u32 i = 0; i < 1024; ++i)
+                table[i] = i * 7;
+            *gVmAllocatorSharedRoot(a) = table;
+            a->release();
+            gReleaseSharedVirtualMemory(gTestAllocator, vmem);
+
+            // A warm restart maps the heap at the same address and attaches to the allocator in it
+            vmem = gOpenPersistentVirtualMemory(gTestAllocator, path, xvmem_config::GBx(8), nullptr);
+            CHECK_TRUE(vmem != nullptr && vmem->reopened());
+            a     = gCreateSharedVmAllocator(&s_alloc, vmem, &cfg);
+            table = (u32*)*gVmAllocatorSharedRoot(a);
+            CHECK_TRUE(table != nullptr && gVmAllocatorOwns(a, table));
+            u32 n = 0;
+            for (u32 i = 0; i < 1024; ++i)
+                n += (table[i] == i * 7) ? 1 : 0;
+            CHECK_EQUAL(1024, n);
+            CHECK_EQUAL(sizeof(u32) * 1024, gVmAllocatorGetSize(a, table));
+
+            void* ptr = a->allocate(100, sizeof(void*));
+            CHECK_TRUE(ptr != nullptr && ptr != table);
+            a->deallocate(ptr);
+            a->deallocate(table);
+            a->release();
+            gReleaseSharedVirtualMemory(gTestAllocator, vmem);
+            unlink(path);
+        }
+
+        UNITTEST_TEST(ring_buffer)
+        {
+            alloc_t* a = gCreateVmAllocator(&s_alloc, gGetVirtualMemory(), nullptr);
+
+            u32   size = 100000;
+            u8*   ring = (u8*)gVmAllocatorAllocateRing(a, size);
+            CHECK_TRUE(ring != nullptr);
+            CHECK_EQUAL(128 * 1024, size);
+            CHECK_TRUE(gVmAllocatorOwns(a, ring));
+
+            // A write across the end of the ring wraps around to its start
+            for (u32 i = 0; i < 16; ++i)
+                ring[size - 8 + i] = (u8)i;
+            CHECK_EQUAL(8, ring[0]);
+            CHECK_EQUAL(15, ring[7]);
+            ring[size + 100] = 0x5A;
+            CHECK_EQUAL(0x5A, ring[100]);
+            gVmAllocatorDeallocateRing(a, ring);
+
+            // The chunk is reused as ordinary memory
+            u8* ptr = (u8*)a->allocate(size * 2, sizeof(void*));
+            CHECK_TRUE(ptr == ring);
+            ptr[0]    = 1;
+            ptr[size] = 2;
+            CHECK_EQUAL(1, ptr[0]);
+            a->deallocate(ptr);
+
+            a->release();
+        }
+
+        UNITTEST_TEST(reallocate)
+        {
+            xvmem_instrumented* vmem = gCreateInstrumentedVirtualMemory(gTestAllocator, gGetVirtualMemory(), false);
+            alloc_t*            a    = gCreateVmAllocator(&s_alloc, vmem, nullptr);
+
+            const u32 size = 200 * 1024 * 1024;
+            u8*       ptr  = (u8*)a->allocate(size, sizeof(void*));
+            ptr[0]         = 0x11;
+            ptr[size - 1]  = 0x22;
+
+            // The chunk of 256 MB has room, more pages are committed in place
+            xvmem_stats stats;
+            vmem->reset_stats();
+            u8* grown = (u8*)gVmAllocatorReallocate(a, ptr, size + size / 4, sizeof(void*));
+            vmem->stats(stats);
+            CHECK_TRUE(grown == ptr);
+            CHECK_EQUAL(size + size / 4, gVmAllocatorGetSize(a, grown));
+            CHECK_EQUAL(1, stats.m_ops[xvmem_stats::COMMIT].m_count);
+
+            // A larger chunk, the pages are moved and not copied
+            vmem->reset_stats();
+            u8* moved = (u8*)gVmAllocatorReallocate(a, grown, size + size / 2, sizeof(void*));
+            vmem->stats(stats);
+            CHECK_TRUE(moved != nullptr && moved != grown);
+            CHECK_EQUAL(1, stats.m_ops[xvmem_stats::REMAP].m_count);
+            CHECK_EQUAL(0x11, moved[0]);
+            CHECK_EQUAL(0x22, moved[size - 1]);
+            CHECK_EQUAL(0, vmem->committed(grown, size));
+            CHECK_EQUAL(gVmAllocatorCommitted(a), stats.m_committed);
+
+            // A small allocation is copied
+            u8* small = (u8*)a->allocate(100, sizeof(void*));
+            small[99] = 0x33;
+            small     = (u8*)gVmAllocatorReallocate(a, small, 1000, sizeof(void*));
+            CHECK_EQUAL(0x33, small[99]);
+
+            a->deallocate(small);
+            a->deallocate(moved);
+            a->release();
+            gReleaseInstrumentedVirtualMemory(gTestAllocator, vmem);
+        }
+
+        UNITTEST_TEST(per_cpu_caches)
+        {
+            xvmem_config cfg;
+            cfg.m_per_cpu_caches = true;
+            alloc_t* a           = gCreateVmAllocator(&s_alloc, gGetVirtualMemory(), &cfg);
+
+            // A freed slot is handed out again by the cache of the CPU, the thread is pinned so it cannot migrate to
+            // another CPU in between
+#if defined TARGET_LINUX
+            cpu_set_t affinity;
+            bool      pinned  = false;
+            s32 const current = sched_getcpu();
+            if (current >= 0 && sched_getaffinity(0, sizeof(affinity), &affinity) == 0)
+            {
+                cpu_set_t cpu;
+                CPU_ZERO(&cpu);
+                CPU_SET(current, &cpu);
+                pinned = sched_setaffinity(0, sizeof(cpu), &cpu) == 0;
+            }
+#else
+            bool const pinned = false;
+#endif
+            void* ptr = a->allocate(48, sizeof(void*));
+            CHECK_EQUAL(48, a->deallocate(ptr));
+            void* again = a->allocate(48, sizeof(void*));
+            if (pinned)
+            {
+                CHECK_TRUE(again == ptr);
+            }
+            a->deallocate(again);
+#if defined TARGET_LINUX
+            if (pinned)
+                sched_setaffinity(0, sizeof(affinity), &affinity);
+#endif
+
+            // The allocator is thread-safe, every thread checks the pattern of its own objects. In the meantime this
+            // thread drains the caches of all CPUs (scavenge) while the other threads push and pop.
+            const u32   num_threads = 8;
+            const u32   count       = 512;
+            u32         corrupted   = 0;
+            u32         finished    = 0;
+            std::thread threads[num_threads];
+            for (u32 t = 0; t < num_threads; ++t)
+            {
+                threads[t] = std::thread([&, t]() {
+                    u8* objects[count];
+                    for (u32 round = 0; round < 64; ++round)
+                    {
+                        for (u32 i = 0; i < count; ++i)
+                        {
+                            u32 const size = 8 + ((i * 37 + round) % 1500);
+                            objects[i]     = (u8*)a->allocate(size, sizeof(void*));
+                            objects[i][0]  = (u8)(t + i);
+                            objects[i][size - 1] = (u8)(t + i);
+                        }
+                        for (u32 i = 0; i < count; ++i)
+                        {
+                            u32 const size = 8 + ((i * 37 + round) % 1500);
+                            if (objects[i][0] != (u8)(t + i) || objects[i][size - 1] != (u8)(t + i))
+                                __atomic_add_fetch(&corrupted, 1, __ATOMIC_RELAXED);
+                            a->deallocate(objects[i]);
+                        }
+                    }
+                    __atomic_add_fetch(&finished, 1, __ATOMIC_RELEASE);
+                });
+            }
+            u32 drains = 0;
+            while (__atomic_load_n(&finished, __ATOMIC_ACQUIRE) < num_threads)
+            {
+                gVmAllocatorScavenge(a);
+                drains += 1;
+            }
+            for (u32 t = 0; t < num_threads; ++t)
+                threads[t].join();
+            CHECK_EQUAL(0, corrupted);
+            CHECK_TRUE(drains > 0);
+
+            a->release();
+        }
+#endif
+
+        UNITTEST_TEST(scavenge)
+        {
+            xvmem_config cfg;
+            alloc_t*     a = gCreateVmAllocator(&s_alloc, gGetVirtualMemory(), &cfg);
+
+            // Only the first and the last allocation of the chunk stay, the pages in between are decommitted
+            const u32 max_count = 113; // A chunk of 16 pages
+            void*     buffers[max_count];
+            for (u32 i = 0; i < max_count; ++i)
+                buffers[i] = a->allocate(9216, sizeof(void*));
+            for (u32 i = 1; i < (max_count - 1); ++i)
+                a->deallocate(buffers[i]);
+
+            u64 const committed = gVmAllocatorCommitted(a);
+            u64 const scavenged   = gVmAllocatorScavenge(a);
+            CHECK_TRUE(scavenged > 0);
+            CHECK_EQUAL(committed - scavenged, gVmAllocatorCommitted(a));
+            CHECK_EQUAL(0, gVmAllocatorScavenge(a));
+
+            // The decommitted pages are committed again when they are handed out
+            for (u32 i = 1; i < (max_count - 1); ++i)
+            {
+                buffers[i] = a->allocate(9216, sizeof(void*));
+                x_memset(buffers[i], 0x5A, 9216);
+            }
+            CHECK_EQUAL(committed, gVmAllocatorCommitted(a));
+
+            for (u32 i = 0; i < max_count; ++i)
+                a->deallocate(buffers[i]);
+            a->release();
+        }
+
+        UNITTEST_TEST(size_classes)
+        {
+            u32 const sizes[]  = {72, 1536};
+            u64 const counts[] = {1000, 1000};
+
+            xvmem_size_histogram histogram;
+            histogram.m_count  = 2;
+            histogram.m_sizes  = sizes;
+            histogram.m_counts = counts;
+
+            // 16 size classes per power of two
+            xvmem_config cfg;
+            cfg.m_bin_shift = 4;
+            alloc_t* a      = gCreateVmAllocator(&s_alloc, gGetVirtualMemory(), &cfg);
+            void*    p      = a->allocate(73, 4);
+            CHECK_EQUAL(76, gVmAllocatorGetSize(a, p));
+            a->deallocate(p);
+            a->release();
+
+            // Only the observed size classes and the ones on the coarse grid are kept
+            cfg.m_size_histogram = &histogram;
+            a                    = gCreateVmAllocator(&s_alloc, gGetVirtualMemory(), &cfg);
+            void* q[4];
+            q[0] = a->allocate(70, sizeof(void*));
+            q[1] = a->allocate(73, 4);
+            q[2] = a->allocate(1500, sizeof(void*));
+            q[3] = a->allocate(1100, sizeof(void*));
+            CHECK_EQUAL(72, gVmAllocatorGetSize(a, q[0]));
+            CHECK_EQUAL(80, gVmAllocatorGetSize(a, q[1]));
+            CHECK_EQUAL(1536, gVmAllocatorGetSize(a, q[2]));
+            CHECK_EQUAL(1280, gVmAllocatorGetSize(a, q[3]));
+            for (s32 i = 0; i < 4; ++i)
+                a->deallocate(q[i]);
+            a->release();
+        }
+
+        UNITTEST_TEST(size_class_fit)
+        {
+            xvmem_config cfg;
+            cfg.m_capture_sizes = true;
+            alloc_t* a          = gCreateVmAllocator(&s_alloc, gGetVirtualMemory(), &cfg);
+            for (s32 i = 0; i < 100; ++i)
+            {
+                a->deallocate(a->allocate(72, sizeof(void*)));
+                a->deallocate(a->allocate(1500, sizeof(void*)));
+            }
+
+            u32 sizes[16];
+            u64 counts[16];
+            u32 n = gVmAllocatorSizeHistogram(a, sizes, counts, 16);
+            a->release();
+            CHECK_EQUAL(2, n);
+            CHECK_EQUAL(72, sizes[0]);
+            CHECK_EQUAL(100, counts[0]);
+            CHECK_EQUAL(1504, sizes[1]);
+
+            xvmem_size_histogram histogram;
+            histogram.m_count  = n;
+            histogram.m_sizes  = sizes;
+            histogram.m_counts = counts;
+
+            u32 bin_sizes[512];
+            n = gVmFitSizeClasses(&s_alloc, &histogram, 4, 2, bin_sizes, 512);
+            CHECK_TRUE(n > 2);
+            CHECK_EQUAL(72, bin_sizes[0]);
+            CHECK_EQUAL(1536, bin_sizes[1]);
+            CHECK_TRUE(gVmSizeClassWaste(&s_alloc, &histogram, 4, bin_sizes, n) < gVmSizeClassWaste(&s_alloc, &histogram, 2, nullptr, 0));
+
+            // Load the size classes from text
+            char const text[] = "# fitted\nbin_shift 4\nbins 72 1536 2048\n";
+            u32        shift  = 0;
+            n                 = gVmParseSizeClasses(text, sizeof(text) - 1, shift, bin_sizes, 512);
+            CHECK_EQUAL(3, n);
+            CHECK_EQUAL(4, shift);
+            CHECK_EQUAL(0, gVmParseSizeClasses("bin_shift 4\nsizes 72\n", 21, shift, bin_sizes, 512));
+
+            xvmem_config loaded;
+            loaded.m_bin_shift     = shift;
+            loaded.m_bin_sizes     = bin_sizes;
+            loaded.m_num_bin_sizes = n;
+            a                      = gCreateVmAllocator(&s_alloc, gGetVirtualMemory(), &loaded);
+            void* p                = a->allocate(40, sizeof(void*));
+            void* q                = a->allocate(1000, sizeof(void*));
+            void* r                = a->allocate(1600, sizeof(void*));
+            CHECK_EQUAL(72, gVmAllocatorGetSize(a, p));
+            CHECK_EQUAL(1536, gVmAllocatorGetSize(a, q));
+            CHECK_EQUAL(2048, gVmAllocatorGetSize(a, r));
+            a->deallocate(p);
+            a->deallocate(q);
+            a->deallocate(r);
+            a->release();
+        }
+
+        UNITTEST_TEST(debug_modes)
+        {
+            xvmem_config cfg;
+            cfg.m_debug_mode = xvmem_config::DEBUG_GUARD;
+            alloc_t* a       = gCreateVmAllocator(&s_alloc, gGetVirtualMemory(), &cfg);
+
+            // New allocations are poisoned
+            u8* p = (u8*)a->allocate(100, sizeof(void*));
+            CHECK_EQUAL(0xCD, p[0]);
+            CHECK_EQUAL(0xCD, p[99]);
+
+            // The canary starts right after the requested size, in the padding of the size class
+            u8* const c    = (u8*)a->allocate(99, 1);
+            u32 const slot = gVmAllocatorGetSize(a, c);
+            CHECK_TRUE(slot >= 104);
+            CHECK_EQUAL(0xCD, c[98]);
+            CHECK_EQUAL(0xFD, c[99]);
+            CHECK_EQUAL(0xFD, c[slot - 5]);
+            CHECK_EQUAL(99, *(u32*)(c + slot - 4));
+            a->deallocate(c);
+            x_memset(p, 0, 100);
+            a->deallocate(p);
+
+            // A single allocation chunk puts the allocation against the end of its committed pages
+            u32 const size = 300 * 1024 + 8;
+            u8*       q    = (u8*)a->allocate(size, sizeof(void*));
+            CHECK_EQUAL(0, (u32)((uptr)(q + size) & (4096 - 1)));
+            x_memset(q, 0, size);
+            a->deallocate(q);
+
+            a->release();
+        }
+
+        UNITTEST_TEST(walk)
+        {
+            alloc_t* a = gCreateVmAllocator(&s_alloc, gGetVirtualMemory(), nullptr);
+
+            const u32 count = 1024;
+            void*     objects[count];
+            u64       size = 0;
+            for (u32 i = 0; i < count; ++i)
+            {
+                u32 const s = 16 + ((i * 37) % 4096);
+                objects[i]  = a->allocate(s, sizeof(void*));
+            }
+            for (u32 i = 0; i < count; i += 3)
+            {
+                a->deallocate(objects[i]);
+                objects[i] = nullptr;
+            }
+            u32 live = 0;
+            for (u32 i = 0; i < count; ++i)
+            {
+                if (objects[i] != nullptr)
+                {
+                    live += 1;
+                    size += a->deallocate(objects[i]);
+                    objects[i] = a->allocate(16 + ((i * 37) % 4096), sizeof(void*));
+                }
+            }
+
+            xvmem_test_walker walker;
+            gVmAllocatorWalk(a, &walker);
+            CHECK_EQUAL(live, walker.mNumAllocs);
+            CHECK_EQUAL(0, walker.mNumOutOfOrder);
+            CHECK_EQUAL(size, walker.mSize);
+
+            xvmem_test_walker paused;
+            CHECK_TRUE(gVmAllocatorWalkPaused(a, &paused));
+            CHECK_EQUAL(live, paused.mNumAllocs);
+            CHECK_EQUAL(size, paused.mSize);
+
+            // The walk stops when the walker asks for it
+            xvmem_test_walker partial;
+            partial.mStopAt = 10;
+            gVmAllocatorWalk(a, &partial);
+            CHECK_EQUAL(10, partial.mNumAllocs);
+
+            for (u32 i = 0; i < count; ++i)
+                a->deallocate(objects[i]);
+
+            xvmem_test_walker empty;
+            gVmAllocatorWalk(a, &empty);
+            CHECK_EQUAL(0, empty.mNumAllocs);
+            a->release();
+        }
     }
 }
 UNITTEST_SUITE_END
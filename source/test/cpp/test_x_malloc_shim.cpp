@@ -0,0 +1,221 @@
+#include "xbase/x_target.h"
+#include "xbase/x_allocator.h"
+#include "xbase/x_memory.h"
+
+#include "xunittest/xunittest.h"
+
+#if defined TARGET_LINUX
+#include <dlfcn.h>
+#include <limits.h>
+#include <string.h>
+#include <unistd.h>
+#endif
+
+using namespace xcore;
+
+#if defined TARGET_LINUX
+
+// The glibc allocator under its internal names, a pointer that the shim hands to the system allocator can be freed here
+extern "C" void* __libc_malloc(size_t size);
+extern "C" void  __libc_free(void* ptr);
+
+// The shim is opened next to the test executable and its functions are called directly, it does not replace the
+// allocator of the test itself
+struct xshim_functions_t
+{
+    typedef void* (*malloc_fn)(size_t);
+    typedef void (*free_fn)(void*);
+    typedef void* (*realloc_fn)(void*, size_t);
+    typedef size_t (*usable_size_fn)(void*);
+    typedef void* (*new_aligned_fn)(size_t, size_t);                 // operator new(size_t, std::align_val_t)
+    typedef void (*delete_aligned_fn)(void*, size_t);                // operator delete(void*, std::align_val_t)
+    typedef void (*delete_sized_aligned_fn)(void*, size_t, size_t);  // operator delete(void*, size_t, std::align_val_t)
+
+    xshim_functions_t()
+        : m_handle(nullptr)
+        , m_malloc(nullptr)
+        , m_free(nullptr)
+        , m_realloc(nullptr)
+        , m_usable_size(nullptr)
+        , m_new_aligned(nullptr)
+        , m_delete_aligned(nullptr)
+        , m_delete_sized_aligned(nullptr)
+    {
+    }
+
+    bool open()
+    {
+        char    path[PATH_MAX];
+        ssize_t len = readlink("/proc/self/exe", path, sizeof(path) - 1);
+        if (len <= 0)
+            return false;
+        path[len] = 0;
+        char* dir = strrchr(path, '/');
+        if (dir == nullptr || (size_t)((dir + 1 - path) + sizeof("libxvmem_shim.so")) > sizeof(path))
+            return false;
+        strcpy(dir + 1, "libxvmem_shim.so");
+
+        m_handle = dlopen(path, RTLD_NOW | RTLD_LOCAL);
+        if (m_handle == nullptr)
+            return false;
+        m_malloc      = (malloc_fn)dlsym(m_handle, "malloc");
+        m_free        = (free_fn)dlsym(m_handle, "free");
+        m_realloc     = (realloc_fn)dlsym(m_handle, "realloc");
+        m_usable_size = (usable_size_fn)dlsym(m_handle, "malloc_usable_size");
+
+        // The C++17 overloads, when the shim is not compiled as C++17 these are the ones of libstdc++
+        m_new_aligned          = (new_aligned_fn)dlsym(m_handle, "_ZnwmSt11align_val_t");
+        m_delete_aligned       = (delete_aligned_fn)dlsym(m_handle, "_ZdlPvSt11align_val_t");
+        m_delete_sized_aligned = (delete_sized_aligned_fn)dlsym(m_handle, "_ZdlPvmSt11align_val_t");
+        return m_malloc != nullptr && m_free != nullptr && m_realloc != nullptr && m_usable_size != nullptr;
+    }
+
+    void*          m_handle;
+    malloc_fn      m_malloc;
+    free_fn        m_free;
+    realloc_fn     m_realloc;
+    usable_size_fn m_usable_size;
+
+    new_aligned_fn          m_new_aligned;
+    delete_aligned_fn       m_delete_aligned;
+    delete_sized_aligned_fn m_delete_sized_aligned;
+};
+
+static xshim_functions_t s_shim;
+
+#endif
+
+UNITTEST_SUITE_BEGIN(malloc_shim)
+{
+    UNITTEST_FIXTURE(main)
+    {
+        UNITTEST_FIXTURE_SETUP() {}
+        UNITTEST_FIXTURE_TEARDOWN() {}
+
+#if defined TARGET_LINUX
+        UNITTEST_TEST(open)
+        {
+            CHECK_TRUE(s_shim.m_handle != nullptr || s_shim.open());
+        }
+
+        UNITTEST_TEST(served_by_superallocator)
+        {
+            if (s_shim.m_handle == nullptr)
+                return;
+
+            // Slots of a bin are packed without a header, glibc puts one in front of every allocation
+            const u32 count = 16;
+            void*     ptrs[count];
+            for (u32 i = 0; i < count; ++i)
+                ptrs[i] = s_shim.m_malloc(64);
+            u32 packed = 0;
+            for (u32 i = 1; i < count; ++i)
+            {
+                if (((xbyte*)ptrs[i] - (xbyte*)ptrs[i - 1]) == 64)
+                    packed += 1;
+            }
+            CHECK_TRUE(packed >= (count / 2));
+
+            // The size of the bin
+            CHECK_EQUAL(64, s_shim.m_usable_size(ptrs[0]));
+            void* ptr = s_shim.m_malloc(100);
+            CHECK_TRUE(s_shim.m_usable_size(ptr) >= 100 && s_shim.m_usable_size(ptr) <= 128);
+            s_shim.m_free(ptr);
+
+            for (u32 i = 0; i < count; ++i)
+                s_shim.m_free(ptrs[i]);
+        }
+
+        UNITTEST_TEST(foreign_pointers)
+        {
+            if (s_shim.m_handle == nullptr)
+                return;
+
+            // A pointer from glibc goes back to glibc, for free, realloc and malloc_usable_size
+            u8* ptr = (u8*)__libc_malloc(100);
+            ptr[99] = 0x5A;
+            CHECK_TRUE(s_shim.m_usable_size(ptr) >= 100);
+            ptr = (u8*)s_shim.m_realloc(ptr, 200);
+            CHECK_EQUAL(0x5A, ptr[99]);
+            CHECK_TRUE(s_shim.m_usable_size(ptr) >= 200);
+            s_shim.m_free(ptr);
+
+            // A request above 256 MB is served by glibc, so glibc can free it
+            const size_t large = (size_t)300 * 1024 * 1024;
+            void*        huge  = s_shim.m_malloc(large);
+            CHECK_TRUE(huge != nullptr);
+            CHECK_TRUE(s_shim.m_usable_size(huge) >= large);
+            __libc_free(huge);
+        }
+
+        UNITTEST_TEST(realloc_growth)
+        {
+            if (s_shim.m_handle == nullptr)
+                return;
+
+            // A small allocation is copied to a larger bin
+            u8* ptr = (u8*)s_shim.m_malloc(1000);
+            for (u32 i = 0; i < 1000; ++i)
+                ptr[i] = (u8)i;
+            ptr = (u8*)s_shim.m_realloc(ptr, 100000);
+            CHECK_TRUE(s_shim.m_usable_size(ptr) >= 100000);
+            u32 mismatches = 0;
+            for (u32 i = 0; i < 1000; ++i)
+                mismatches += (ptr[i] != (u8)i) ? 1 : 0;
+            CHECK_EQUAL(0, mismatches);
+
+            // A large allocation grows without copying, the content is kept
+            const size_t size = (size_t)64 * 1024 * 1024;
+            ptr               = (u8*)s_shim.m_realloc(ptr, size);
+            ptr[size - 1]     = 0xA5;
+            ptr               = (u8*)s_shim.m_realloc(ptr, size * 3);
+            CHECK_TRUE(s_shim.m_usable_size(ptr) >= (size * 3));
+            CHECK_EQUAL(1, ptr[1]);
+            CHECK_EQUAL(0xA5, ptr[size - 1]);
+
+            // Shrinking keeps the pointer
+            CHECK_TRUE(s_shim.m_realloc(ptr, size) == ptr);
+            s_shim.m_free(ptr);
+        }
+
+        UNITTEST_TEST(aligned_new)
+        {
+            if (s_shim.m_handle == nullptr)
+                return;
+
+            CHECK_TRUE(s_shim.m_new_aligned != nullptr && s_shim.m_delete_aligned != nullptr && s_shim.m_delete_sized_aligned != nullptr);
+            if (s_shim.m_new_aligned == nullptr || s_shim.m_delete_aligned == nullptr || s_shim.m_delete_sized_aligned == nullptr)
+                return;
+
+            // Over-aligned objects come from the bins as well, packed without a header. This fails when the overloads
+            // of the shim were compiled out and libstdc++ serves them through aligned_alloc.
+            const u32 count = 16;
+            void*     ptrs[count];
+            for (u32 i = 0; i < count; ++i)
+                ptrs[i] = s_shim.m_new_aligned(64, 64);
+            u32 packed  = 0;
+            u32 aligned = 0;
+            for (u32 i = 0; i < count; ++i)
+            {
+                aligned += (((uptr)ptrs[i] & (64 - 1)) == 0) ? 1 : 0;
+                if (i > 0 && ((xbyte*)ptrs[i] - (xbyte*)ptrs[i - 1]) == 64)
+                    packed += 1;
+            }
+            CHECK_EQUAL(count, aligned);
+            CHECK_TRUE(packed >= (count / 2));
+            for (u32 i = 0; i < count; ++i)
+                s_shim.m_delete_aligned(ptrs[i], 64);
+
+            for (u32 alignment = 128; alignment <= 4096; alignment *= 2)
+            {
+                void* ptr = s_shim.m_new_aligned(100, alignment);
+                CHECK_EQUAL(0, (u32)((uptr)ptr & (alignment - 1)));
+                CHECK_TRUE(s_shim.m_usable_size(ptr) >= 100);
+                x_memset(ptr, 0x5A, 100);
+                s_shim.m_delete_sized_aligned(ptr, 100, alignment);
+            }
+        }
+#endif
+    }
+}
+UNITTEST_SUITE_END
@@ -0,0 +1,166 @@
+#include "xbase/x_target.h"
+#include "xbase/x_allocator.h"
+
+#include "xvmem/x_virtual_memory.h"
+#include "xvmem/x_virtual_main_allocator.h"
+
+#include <chrono>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined TARGET_LINUX
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+// Churn of small objects with a live set of a fixed size: every operation frees a random live object and allocates
+// a new one of 16 to 256 bytes in its place. Reported are the nanoseconds per operation and, when the hardware
+// counters are available (Linux perf_event_open), the cache misses and L1 data cache read misses per operation.
+// The counters include the accesses of the benchmark to its own object table, compare runs with the same live set.
+//
+//   xvmem_churn [live objects = 1000000] [operations = 20000000]
+
+using namespace xcore;
+
+class xbench_heap_t : public alloc_t
+{
+protected:
+    virtual void* v_allocate(u32 size, u32 alignment)
+    {
+        void* ptr = nullptr;
+        return (posix_memalign(&ptr, alignment < sizeof(void*) ? sizeof(void*) : alignment, size) == 0) ? ptr : nullptr;
+    }
+    virtual u32 v_deallocate(void* ptr)
+    {
+        free(ptr);
+        return 0;
+    }
+    virtual void v_release() {}
+};
+
+// A hardware counter of the calling thread, user space only, -1 when it is not available
+struct xbench_counter_t
+{
+    xbench_counter_t(u32 type, u64 config)
+        : m_fd(-1)
+    {
+#if defined TARGET_LINUX
+        perf_event_attr attr;
+        memset(&attr, 0, sizeof(attr));
+        attr.type           = type;
+        attr.size           = sizeof(attr);
+        attr.config         = config;
+        attr.disabled       = 1;
+        attr.exclude_kernel = 1;
+        attr.exclude_hv     = 1;
+        m_fd                = (s32)syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0);
+#endif
+    }
+
+    ~xbench_counter_t()
+    {
+#if defined TARGET_LINUX
+        if (m_fd >= 0)
+            close(m_fd);
+#endif
+    }
+
+    void start()
+    {
+#if defined TARGET_LINUX
+        if (m_fd >= 0)
+        {
+            ioctl(m_fd, PERF_EVENT_IOC_RESET, 0);
+            ioctl(m_fd, PERF_EVENT_IOC_ENABLE, 0);
+        }
+#endif
+    }
+
+    s64 stop()
+    {
+        u64 value = 0;
+#if defined TARGET_LINUX
+        if (m_fd >= 0)
+        {
+            ioctl(m_fd, PERF_EVENT_IOC_DISABLE, 0);
+            if (read(m_fd, &value, sizeof(value)) == sizeof(value))
+                return (s64)value;
+        }
+#endif
+        return -1;
+    }
+
+    s32 m_fd;
+};
+
+static inline u32 bench_random(u32& state)
+{
+    state ^= state << 13;
+    state ^= state >> 17;
+    state ^= state << 5;
+    return state;
+}
+
+static void print_per_op(char const* name, s64 count, u64 operations)
+{
+    if (count < 0)
+        printf(", n/a %s", name);
+    else
+        printf(", %.2f %s", (double)count / (double)operations, name);
+}
+
+int main(int argc, char** argv)
+{
+    u32 const num_live   = (argc > 1) ? (u32)atoi(argv[1]) : 1000000;
+    u32 const operations = (argc > 2) ? (u32)atoi(argv[2]) : 20000000;
+    if (num_live == 0)
+    {
+        fprintf(stderr, "usage: xvmem_churn [live objects] [operations]\n");
+        return 1;
+    }
+
+    gInitVirtualMemory();
+    xbench_heap_t heap;
+    alloc_t*      allocator = gCreateVmAllocator(&heap, gGetVirtualMemory(), nullptr);
+
+    void** live  = (void**)malloc(sizeof(void*) * num_live);
+    u32    state = 0x9E3779B9u;
+    for (u32 i = 0; i < num_live; ++i)
+        live[i] = allocator->allocate(16 + (bench_random(state) % 241), sizeof(void*));
+
+#if defined TARGET_LINUX
+    xbench_counter_t cache_misses(PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES);
+    xbench_counter_t l1d_misses(PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_L1D | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16));
+#else
+    xbench_counter_t cache_misses(0, 0);
+    xbench_counter_t l1d_misses(0, 0);
+#endif
+    cache_misses.start();
+    l1d_misses.start();
+    std::chrono::steady_clock::time_point const start = std::chrono::steady_clock::now();
+    for (u32 i = 0; i < operations; ++i)
+    {
+        u32 const r    = bench_random(state);
+        u32 const slot = r % num_live;
+        allocator->deallocate(live[slot]);
+        live[slot] = allocator->allocate(16 + ((r >> 8) % 241), sizeof(void*));
+    }
+    double const seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    s64 const    misses  = cache_misses.stop();
+    s64 const    l1d     = l1d_misses.stop();
+
+    printf("live %u: %.1f ns per operation", num_live, (seconds * 1.0e9) / (double)(operations ? operations : 1));
+    print_per_op("cache misses", misses, operations ? operations : 1);
+    print_per_op("L1D read misses", l1d, operations ? operations : 1);
+    printf(" per operation\n");
+
+    for (u32 i = 0; i < num_live; ++i)
+        allocator->deallocate(live[i]);
+    free(live);
+    allocator->release();
+    return 0;
+}
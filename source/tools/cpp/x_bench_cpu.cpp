@@ -0,0 +1,175 @@
+#include "xbase/x_target.h"
+#include "xbase/x_allocator.h"
+
+#include "xvmem/x_virtual_memory.h"
+#include "xvmem/x_virtual_main_allocator.h"
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include <stdio.h>
+#include <stdlib.h>
+
+// Compares the per-thread mode (xvmem_config::m_thread_private_chunks, calls serialized by a mutex) with the per-CPU
+// mode (xvmem_config::m_per_cpu_caches) for a service with many threads that are mostly idle. Every thread keeps a few
+// small objects alive, the active threads churn small allocations. Reported are the nanoseconds per allocation and
+// deallocation pair and the committed bytes while all threads are alive.
+//
+//   xvmem_bench [threads = 1000] [active threads = 4] [operations per active thread = 2000000]
+
+using namespace xcore;
+
+class xbench_heap_t : public alloc_t
+{
+protected:
+    virtual void* v_allocate(u32 size, u32 alignment)
+    {
+        void* ptr = nullptr;
+        return (posix_memalign(&ptr, alignment < sizeof(void*) ? sizeof(void*) : alignment, size) == 0) ? ptr : nullptr;
+    }
+    virtual u32 v_deallocate(void* ptr)
+    {
+        free(ptr);
+        return 0;
+    }
+    virtual void v_release() {}
+};
+
+struct xbench_t
+{
+    alloc_t*    m_allocator;
+    std::mutex* m_lock; // The per-thread mode is not thread-safe, nullptr in the per-CPU mode
+    bool        m_thread_private;
+
+    std::mutex              m_mutex;
+    std::condition_variable m_condition;
+    bool                    m_done;
+    std::atomic<u32>        m_ready;
+
+    void* allocate(u32 size)
+    {
+        if (m_lock == nullptr)
+            return m_allocator->allocate(size, sizeof(void*));
+        std::lock_guard<std::mutex> guard(*m_lock);
+        return m_allocator->allocate(size, sizeof(void*));
+    }
+
+    void deallocate(void* ptr)
+    {
+        if (m_lock == nullptr)
+        {
+            m_allocator->deallocate(ptr);
+            return;
+        }
+        std::lock_guard<std::mutex> guard(*m_lock);
+        m_allocator->deallocate(ptr);
+    }
+
+    void release_thread()
+    {
+        if (!m_thread_private)
+            return;
+        std::lock_guard<std::mutex> guard(*m_lock);
+        gVmAllocatorReleaseThread(m_allocator);
+    }
+};
+
+static void bench_thread(xbench_t* bench, u32 index, u32 operations)
+{
+    // The state of a connection, alive as long as the thread
+    static const u32 c_live_sizes[] = {16, 32, 48, 64, 96, 128, 256, 512};
+    static const u32 c_num_live     = sizeof(c_live_sizes) / sizeof(c_live_sizes[0]);
+    void*            live[c_num_live];
+    for (u32 i = 0; i < c_num_live; ++i)
+        live[i] = bench->allocate(c_live_sizes[i]);
+
+    // Small objects with a short lifetime
+    const u32 c_ring = 64;
+    void*     ring[c_ring];
+    for (u32 i = 0; i < c_ring; ++i)
+        ring[i] = nullptr;
+    u32 random = 0x9E3779B9u * (index + 1);
+    for (u32 i = 0; i < operations; ++i)
+    {
+        random ^= random << 13;
+        random ^= random >> 17;
+        random ^= random << 5;
+        u32 const slot = i & (c_ring - 1);
+        if (ring[slot] != nullptr)
+            bench->deallocate(ring[slot]);
+        ring[slot] = bench->allocate(8 + (random & 1015));
+    }
+    for (u32 i = 0; i < c_ring; ++i)
+    {
+        if (ring[i] != nullptr)
+            bench->deallocate(ring[i]);
+    }
+
+    bench->m_ready.fetch_add(1);
+    {
+        std::unique_lock<std::mutex> lock(bench->m_mutex);
+        bench->m_condition.wait(lock, [bench]() { return bench->m_done; });
+    }
+
+    for (u32 i = 0; i < c_num_live; ++i)
+        bench->deallocate(live[i]);
+    bench->release_thread();
+}
+
+static void bench_mode(char const* name, bool per_cpu, u32 num_threads, u32 num_active, u32 operations)
+{
+    xbench_heap_t heap;
+    xvmem_config  cfg;
+    cfg.m_thread_private_chunks = !per_cpu;
+    cfg.m_per_cpu_caches        = per_cpu;
+
+    std::mutex lock;
+    xbench_t   bench;
+    bench.m_allocator      = gCreateVmAllocator(&heap, gGetVirtualMemory(), &cfg);
+    bench.m_lock           = per_cpu ? nullptr : &lock;
+    bench.m_thread_private = !per_cpu;
+    bench.m_done           = false;
+    bench.m_ready          = 0;
+
+    std::chrono::steady_clock::time_point const start = std::chrono::steady_clock::now();
+    std::vector<std::thread>                    threads;
+    for (u32 t = 0; t < num_threads; ++t)
+        threads.push_back(std::thread(bench_thread, &bench, t, (t < num_active) ? operations : 0));
+    while (bench.m_ready.load() < num_threads)
+        std::this_thread::yield();
+    double const seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    u64 const committed = gVmAllocatorCommitted(bench.m_allocator);
+    {
+        std::lock_guard<std::mutex> guard(bench.m_mutex);
+        bench.m_done = true;
+    }
+    bench.m_condition.notify_all();
+    for (u32 t = 0; t < num_threads; ++t)
+        threads[t].join();
+
+    u64 const pairs = (u64)num_active * operations;
+    printf("%-10s: %6.1f ns per allocation + deallocation, %8.2f MB committed with %u threads\n", name, (seconds * 1.0e9) / (double)(pairs ? pairs : 1), (double)committed / (1024.0 * 1024.0), num_threads);
+    bench.m_allocator->release();
+}
+
+int main(int argc, char** argv)
+{
+    u32 const num_threads = (argc > 1) ? (u32)atoi(argv[1]) : 1000;
+    u32 const num_active  = (argc > 2) ? (u32)atoi(argv[2]) : 4;
+    u32 const operations  = (argc > 3) ? (u32)atoi(argv[3]) : 2000000;
+    if (num_threads == 0 || num_active > num_threads)
+    {
+        fprintf(stderr, "usage: xvmem_bench [threads] [active threads] [operations per active thread]\n");
+        return 1;
+    }
+
+    gInitVirtualMemory();
+    bench_mode("per-thread", false, num_threads, num_active, operations);
+    bench_mode("per-CPU", true, num_threads, num_active, operations);
+    return 0;
+}
@@ -0,0 +1,90 @@
+#include "xbase/x_target.h"
+#include "xbase/x_allocator.h"
+#include "xbase/x_memory.h"
+
+#include "xvmem/x_virtual_memory.h"
+#include "xvmem/x_virtual_main_allocator.h"
+
+#include <chrono>
+
+#include <stdio.h>
+#include <stdlib.h>
+
+// Grows a large allocation whose pages are all touched, once with gVmAllocatorReallocate (pages are committed in
+// place or remapped, see xvmem::remap) and once with allocate + copy + deallocate. Reported are the milliseconds of
+// the grow, the best of a number of rounds.
+//
+//   xvmem_realloc [from MB = 200] [to MB = 300] [rounds = 5]
+
+using namespace xcore;
+
+class xbench_heap_t : public alloc_t
+{
+protected:
+    virtual void* v_allocate(u32 size, u32 alignment)
+    {
+        void* ptr = nullptr;
+        return (posix_memalign(&ptr, alignment < sizeof(void*) ? sizeof(void*) : alignment, size) == 0) ? ptr : nullptr;
+    }
+    virtual u32 v_deallocate(void* ptr)
+    {
+        free(ptr);
+        return 0;
+    }
+    virtual void v_release() {}
+};
+
+static double bench_grow(alloc_t* allocator, u32 from, u32 to, bool copy)
+{
+    xbyte* ptr = (xbyte*)allocator->allocate(from, sizeof(void*));
+    x_memset(ptr, 0x5A5A5A5A, from);
+
+    std::chrono::steady_clock::time_point const start = std::chrono::steady_clock::now();
+    xbyte*                                      grown = nullptr;
+    if (copy)
+    {
+        grown = (xbyte*)allocator->allocate(to, sizeof(void*));
+        x_memcpy(grown, ptr, from);
+        allocator->deallocate(ptr);
+    }
+    else
+    {
+        grown = (xbyte*)gVmAllocatorReallocate(allocator, ptr, to, sizeof(void*));
+    }
+    double const ms = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count() * 1000.0;
+
+    if (grown[from - 1] != 0x5A)
+        fprintf(stderr, "the content was not kept\n");
+    allocator->deallocate(grown);
+    return ms;
+}
+
+int main(int argc, char** argv)
+{
+    u32 const from   = ((argc > 1) ? (u32)atoi(argv[1]) : 200) * 1024 * 1024;
+    u32 const to     = ((argc > 2) ? (u32)atoi(argv[2]) : 300) * 1024 * 1024;
+    u32 const rounds = (argc > 3) ? (u32)atoi(argv[3]) : 5;
+    if (from == 0 || to <= from || rounds == 0)
+    {
+        fprintf(stderr, "usage: xvmem_realloc [from MB] [to MB] [rounds]\n");
+        return 1;
+    }
+
+    gInitVirtualMemory();
+    xbench_heap_t heap;
+    alloc_t*      allocator = gCreateVmAllocator(&heap, gGetVirtualMemory(), nullptr);
+
+    double best_realloc = 0.0;
+    double best_copy    = 0.0;
+    for (u32 r = 0; r < rounds; ++r)
+    {
+        double const ms_realloc = bench_grow(allocator, from, to, false);
+        double const ms_copy    = bench_grow(allocator, from, to, true);
+        best_realloc            = (r == 0 || ms_realloc < best_realloc) ? ms_realloc : best_realloc;
+        best_copy               = (r == 0 || ms_copy < best_copy) ? ms_copy : best_copy;
+    }
+    printf("%u MB -> %u MB: %8.2f ms reallocate, %8.2f ms allocate + copy\n", from >> 20, to >> 20, best_realloc, best_copy);
+
+    allocator->release();
+    return 0;
+}
@@ -0,0 +1,112 @@
+#include "xbase/x_target.h"
+#include "xbase/x_allocator.h"
+
+#include "xvmem/x_virtual_main_allocator.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+// Fits the superallocator size classes to a histogram of allocation sizes, e.g. one that was captured with
+// xvmem_config::m_capture_sizes and gVmAllocatorSizeHistogram. The histogram is a text file with a 'size count'
+// pair per line ('#' starts a comment), the size classes are written to stdout in the format that
+// gVmParseSizeClasses reads and a comparison of the waste with the built-in tables goes to stderr.
+//
+//   xvmem_binfit <histogram file> [maximum number of size classes = 64] [bin shift = 4] > bins.txt
+
+using namespace xcore;
+
+class xbinfit_heap_t : public alloc_t
+{
+protected:
+    virtual void* v_allocate(u32 size, u32 alignment) { return malloc(size); } // Only used for u64 and smaller
+    virtual u32 v_deallocate(void* ptr)
+    {
+        free(ptr);
+        return 0;
+    }
+    virtual void v_release() {}
+};
+
+static bool read_histogram(char const* filename, u32*& sizes, u64*& counts, u32& count)
+{
+    FILE* file = fopen(filename, "r");
+    if (file == nullptr)
+        return false;
+
+    u32  capacity = 0;
+    char line[256];
+    count = 0;
+    while (fgets(line, sizeof(line), file) != nullptr)
+    {
+        unsigned long      size;
+        unsigned long long n;
+        if (line[0] == '#' || sscanf(line, "%lu %llu", &size, &n) != 2)
+            continue;
+        if (count == capacity)
+        {
+            capacity = (capacity == 0) ? 1024 : (capacity * 2);
+            sizes    = (u32*)realloc(sizes, sizeof(u32) * capacity);
+            counts   = (u64*)realloc(counts, sizeof(u64) * capacity);
+        }
+        sizes[count]  = (u32)size;
+        counts[count] = (u64)n;
+        count += 1;
+    }
+    fclose(file);
+    return true;
+}
+
+int main(int argc, char** argv)
+{
+    if (argc < 2)
+    {
+        fprintf(stderr, "usage: %s <histogram file> [max size classes = 64] [bin shift = 4]\n", argv[0]);
+        return 1;
+    }
+    u32 const max_bins  = (argc > 2) ? (u32)atoi(argv[2]) : 64;
+    u32 const bin_shift = (argc > 3) ? (u32)atoi(argv[3]) : 4;
+    if (max_bins == 0 || bin_shift < 2 || bin_shift > 4)
+    {
+        fprintf(stderr, "the maximum number of size classes must be > 0 and the bin shift 2, 3 or 4\n");
+        return 1;
+    }
+
+    xvmem_size_histogram histogram;
+    u32*                 sizes  = nullptr;
+    u64*                 counts = nullptr;
+    if (!read_histogram(argv[1], sizes, counts, histogram.m_count))
+    {
+        fprintf(stderr, "cannot read '%s'\n", argv[1]);
+        return 1;
+    }
+    histogram.m_sizes  = sizes;
+    histogram.m_counts = counts;
+
+    xbinfit_heap_t heap;
+    u32            bin_sizes[512];
+    u32 const      num = gVmFitSizeClasses(&heap, &histogram, bin_shift, max_bins, bin_sizes, 512);
+    if (num == 0)
+    {
+        fprintf(stderr, "the histogram is empty\n");
+        return 1;
+    }
+
+    printf("# size classes for xvmem_config::m_bin_sizes, fitted by xvmem_binfit to '%s'\n", argv[1]);
+    printf("bin_shift %u\n", bin_shift);
+    printf("bins");
+    for (u32 i = 0; i < num; ++i)
+        printf(" %u", bin_sizes[i]);
+    printf("\n");
+
+    u64 const waste_builtin = gVmSizeClassWaste(&heap, &histogram, 0, nullptr, 0);
+    u64 const waste_25p     = gVmSizeClassWaste(&heap, &histogram, 2, nullptr, 0);
+    u64 const waste_fitted  = gVmSizeClassWaste(&heap, &histogram, bin_shift, bin_sizes, num);
+    fprintf(stderr, "waste (internal + chunk tails) for the histogram:\n");
+    fprintf(stderr, "  built-in table : %llu bytes\n", (unsigned long long)waste_builtin);
+    fprintf(stderr, "  ~25%% table     : %llu bytes\n", (unsigned long long)waste_25p);
+    fprintf(stderr, "  fitted (%3u)   : %llu bytes\n", num, (unsigned long long)waste_fitted);
+
+    free(sizes);
+    free(counts);
+    return 0;
+}
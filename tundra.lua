@@ -13,6 +13,10 @@ Build {
 			{ "TARGET_MAC_DEV_RELEASE", "TARGET_MAC", "PLATFORM_64BIT"; Config = "macosx-*-release-dev" },
 			{ "TARGET_MAC_TEST_DEBUG", "TARGET_MAC", "PLATFORM_64BIT"; Config = "macosx-*-debug-test" },
 			{ "TARGET_MAC_TEST_RELEASE", "TARGET_MAC", "PLATFORM_64BIT"; Config = "macosx-*-release-test" },
+			{ "TARGET_LINUX_DEV_DEBUG", "TARGET_LINUX", "PLATFORM_64BIT"; Config = "linux-*-debug-dev" },
+			{ "TARGET_LINUX_DEV_RELEASE", "TARGET_LINUX", "PLATFORM_64BIT"; Config = "linux-*-release-dev" },
+			{ "TARGET_LINUX_TEST_DEBUG", "TARGET_LINUX", "PLATFORM_64BIT"; Config = "linux-*-debug-test" },
+			{ "TARGET_LINUX_TEST_RELEASE", "TARGET_LINUX", "PLATFORM_64BIT"; Config = "linux-*-release-test" },
 		},
 	},
 	Units = function ()
@@ -68,8 +72,48 @@ Build {
 			Sources = { SourceGlobCommon("source/test/cpp"), SourceGlobPlatform("source/test/cpp") },
 			Includes = { "source/main/include","source/test/include","..//xunittest/source/main/include","..//xentry/source/main/include","..//xbase/source/main/include","..//xvmem/source/main/include" },
 			Depends = { xunittest_library,xentry_library,xbase_library,xvmem_library },
+			Libs = { { "dl"; Config = "linux-*-*-*" } },
+		}
+		local xvmem_shim = SharedLibrary {
+			Name = "xvmem_shim",
+			Config = "linux-*-*-*",
+			Sources = { "source/shim/cpp/x_malloc_shim.cpp" },
+			Includes = { "..//xvmem/source/main/include","..//xbase/source/main/include" },
+			Depends = { xbase_library,xvmem_library },
+			Libs = { "dl" },
+			Env = { CXXOPTS = { "-std=c++17" } }, -- The sized and aligned operator new/delete overloads
+		}
+		local xvmem_binfit = Program {
+			Name = "xvmem_binfit",
+			Config = "*-*-*-*",
+			Sources = { "source/tools/cpp/x_binfit.cpp" },
+			Includes = { "..//xvmem/source/main/include","..//xbase/source/main/include" },
+			Depends = { xbase_library,xvmem_library },
+		}
+		local xvmem_bench = Program {
+			Name = "xvmem_bench",
+			Config = "linux-*-*-*",
+			Sources = { "source/tools/cpp/x_bench_cpu.cpp" },
+			Includes = { "..//xvmem/source/main/include","..//xbase/source/main/include" },
+			Depends = { xbase_library,xvmem_library },
+			Libs = { "pthread" },
+		}
+		local xvmem_churn = Program {
+			Name = "xvmem_churn",
+			Config = "*-*-*-*",
+			Sources = { "source/tools/cpp/x_bench_churn.cpp" },
+			Includes = { "..//xvmem/source/main/include","..//xbase/source/main/include" },
+			Depends = { xbase_library,xvmem_library },
+		}
+		local xvmem_realloc = Program {
+			Name = "xvmem_realloc",
+			Config = "*-*-*-*",
+			Sources = { "source/tools/cpp/x_bench_realloc.cpp" },
+			Includes = { "..//xvmem/source/main/include","..//xbase/source/main/include" },
+			Depends = { xbase_library,xvmem_library },
 		}
 		Default(unittest)
+		Default(xvmem_shim) -- The unit test opens it from the directory of the executable
 	end,
 	Configs = {
 		Config {
@@ -100,6 +144,9 @@ Build {
 				OBJECTROOT = "target",
 			},
 			Name = "linux-gcc",
+			Env = {
+				CXXOPTS = { "-std=c++11", "-fPIC" },
+			},
 			DefaultOnHost = "linux",
 			Tools = { "gcc" },
 		},